@@ -130,8 +130,8 @@ void ChassisInit()
 #endif                                          // CHASSIS_BOARD
 
 #ifdef ONE_BOARD // 单板控制整车,则通过pubsub来传递消息
-    chassis_sub = SubRegister("chassis_cmd", sizeof(Chassis_Ctrl_Cmd_s));
-    chassis_pub = PubRegister("chassis_feed", sizeof(Chassis_Upload_Data_s));
+    chassis_sub = SubRegisterTopic(TOPIC_CHASSIS_CMD);
+    chassis_pub = PubRegisterTopic(TOPIC_CHASSIS_FEED);
 #endif // ONE_BOARD
 }
 
@@ -186,7 +186,7 @@ void ChassisTask()
     // 后续增加没收到消息的处理(双板的情况)
     // 获取新的控制信息
 #ifdef ONE_BOARD
-    SubGetMessage(chassis_sub, &chassis_cmd_recv);
+    SubGetTopic(chassis_sub, TOPIC_CHASSIS_CMD, &chassis_cmd_recv);
 #endif
 #ifdef CHASSIS_BOARD
     chassis_cmd_recv = *(Chassis_Ctrl_Cmd_s *)CANCommGet(chasiss_can_comm);
@@ -249,7 +249,7 @@ void ChassisTask()
 
     // 推送反馈消息
 #ifdef ONE_BOARD
-    PubPushMessage(chassis_pub, (void *)&chassis_feedback_data);
+    PubPushTopic(chassis_pub, TOPIC_CHASSIS_FEED, &chassis_feedback_data);
 #endif
 #ifdef CHASSIS_BOARD
     CANCommSend(chasiss_can_comm, (void *)&chassis_feedback_data);
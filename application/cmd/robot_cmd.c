@@ -94,14 +94,14 @@ void RobotCMDInit()
    rc_data = RemoteControlInit(&huart3);   // 修改为对应串口,注意如果是自研板dbus协议串口需选用添加了反相器的那个
     vision_recv_data = VisionInit(&huart1); // 视觉通信串口
 
-    gimbal_cmd_pub = PubRegister("gimbal_cmd", sizeof(Gimbal_Ctrl_Cmd_s));
-    gimbal_feed_sub = SubRegister("gimbal_feed", sizeof(Gimbal_Upload_Data_s));
-    shoot_cmd_pub = PubRegister("shoot_cmd", sizeof(Shoot_Ctrl_Cmd_s));
-    shoot_feed_sub = SubRegister("shoot_feed", sizeof(Shoot_Upload_Data_s));
+    gimbal_cmd_pub = PubRegisterTopic(TOPIC_GIMBAL_CMD);
+    gimbal_feed_sub = SubRegisterTopic(TOPIC_GIMBAL_FEED);
+    shoot_cmd_pub = PubRegisterTopic(TOPIC_SHOOT_CMD);
+    shoot_feed_sub = SubRegisterTopic(TOPIC_SHOOT_FEED);
 
 #ifdef ONE_BOARD // 双板兼容
-    chassis_cmd_pub = PubRegister("chassis_cmd", sizeof(Chassis_Ctrl_Cmd_s));
-    chassis_feed_sub = SubRegister("chassis_feed", sizeof(Chassis_Upload_Data_s));
+    chassis_cmd_pub = PubRegisterTopic(TOPIC_CHASSIS_CMD);
+    chassis_feed_sub = SubRegisterTopic(TOPIC_CHASSIS_FEED);
 #endif // ONE_BOARD
 #ifdef GIMBAL_BOARD
     CANComm_Init_Config_s comm_conf = {
@@ -322,13 +322,13 @@ void RobotCMDTask()
    // BMI088Acquire(bmi088_test,&bmi088_data) ;
     // 从其他应用获取回传数据
 #ifdef ONE_BOARD
-    SubGetMessage(chassis_feed_sub, (void *)&chassis_fetch_data);
+    SubGetTopic(chassis_feed_sub, TOPIC_CHASSIS_FEED, &chassis_fetch_data);
 #endif // ONE_BOARD
 #ifdef GIMBAL_BOARD
     chassis_fetch_data = *(Chassis_Upload_Data_s *)CANCommGet(cmd_can_comm);
 #endif // GIMBAL_BOARD
-    SubGetMessage(shoot_feed_sub, &shoot_fetch_data);
-    SubGetMessage(gimbal_feed_sub, &gimbal_fetch_data);
+    SubGetTopic(shoot_feed_sub, TOPIC_SHOOT_FEED, &shoot_fetch_data);
+    SubGetTopic(gimbal_feed_sub, TOPIC_GIMBAL_FEED, &gimbal_fetch_data);
 
     // 根据gimbal的反馈值计算云台和底盘正方向的夹角,不需要传参,通过static私有变量完成
     CalcOffsetAngle();
@@ -346,11 +346,11 @@ void RobotCMDTask()
     // 推送消息,双板通信,视觉通信等
     // 其他应用所需的控制数据在remotecontrolsetmode和mousekeysetmode中完成设置
 #ifdef ONE_BOARD
-    PubPushMessage(chassis_cmd_pub, (void *)&chassis_cmd_send);
+    PubPushTopic(chassis_cmd_pub, TOPIC_CHASSIS_CMD, &chassis_cmd_send);
 #endif // ONE_BOARD
 #ifdef GIMBAL_BOARD
     CANCommSend(cmd_can_comm, (void *)&chassis_cmd_send);
 #endif // GIMBAL_BOARD
-    PubPushMessage(shoot_cmd_pub, (void *)&shoot_cmd_send);
-    PubPushMessage(gimbal_cmd_pub, (void *)&gimbal_cmd_send);
+    PubPushTopic(shoot_cmd_pub, TOPIC_SHOOT_CMD, &shoot_cmd_send);
+    PubPushTopic(gimbal_cmd_pub, TOPIC_GIMBAL_CMD, &gimbal_cmd_send);
 }
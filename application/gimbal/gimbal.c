@@ -14,6 +14,8 @@ static Subscriber_t *gimbal_sub;                  // cmd控制消息订阅者
 static Gimbal_Upload_Data_s gimbal_feedback_data; // 回传给cmd的云台状态信息
 static Gimbal_Ctrl_Cmd_s gimbal_cmd_recv;         // 来自cmd的控制信息
 
+#define GIMBAL_CMD_WAIT_MS 10 // 等待cmd控制消息的最长时间,超时后按上一次的控制信息继续控制
+
 // static BMI088Instance *bmi088; // 云台IMU
 void GimbalInit()
 {   
@@ -95,16 +97,16 @@ void GimbalInit()
     yaw_motor = DJIMotorInit(&yaw_config);
     pitch_motor = DJIMotorInit(&pitch_config);
 
-    gimbal_pub = PubRegister("gimbal_feed", sizeof(Gimbal_Upload_Data_s));
-    gimbal_sub = SubRegister("gimbal_cmd", sizeof(Gimbal_Ctrl_Cmd_s));
+    gimbal_pub = PubRegisterTopic(TOPIC_GIMBAL_FEED);
+    gimbal_sub = SubRegisterTopic(TOPIC_GIMBAL_CMD);
 }
 
 /* 机器人云台控制核心任务,后续考虑只保留IMU控制,不再需要电机的反馈 */
 void GimbalTask()
 {
-    // 获取云台控制数据
+    // 等待cmd发布控制数据,收到后立即执行;超时说明cmd没有运行,仍然刷新一次反馈
     // 后续增加未收到数据的处理
-    SubGetMessage(gimbal_sub, &gimbal_cmd_recv);
+    SubWaitTopic(gimbal_sub, TOPIC_GIMBAL_CMD, &gimbal_cmd_recv, GIMBAL_CMD_WAIT_MS);
 
     // @todo:现在已不再需要电机反馈,实际上可以始终使用IMU的姿态数据来作为云台的反馈,yaw电机的offset只是用来跟随底盘
     // 根据控制模式进行电机反馈切换和过渡,视觉模式在robot_cmd模块就已经设置好,gimbal只看yaw_ref和pitch_ref
@@ -150,5 +152,5 @@ void GimbalTask()
     gimbal_feedback_data.yaw_motor_single_round_angle = yaw_motor->measure.angle_single_round;
 
     // 推送消息
-    PubPushMessage(gimbal_pub, (void *)&gimbal_feedback_data);
+    PubPushTopic(gimbal_pub, TOPIC_GIMBAL_FEED, &gimbal_feedback_data);
 }
\ No newline at end of file
@@ -8,7 +8,8 @@
 void GimbalInit();
 
 /**
- * @brief 云台任务
+ * @brief 云台任务,由StartGIMBALTASK()循环调用
+ *        每次调用会等待robot_cmd发布的控制消息,收到后立即计算,不需要额外的延时
  * 
  */
 void GimbalTask();
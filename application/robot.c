@@ -48,8 +48,7 @@ void RobotInit()
 void RobotTask()
 {
 #if defined(ONE_BOARD) || defined(GIMBAL_BOARD)
-    RobotCMDTask();
-    GimbalTask();
+    RobotCMDTask(); // 发布gimbal_cmd后StartGIMBALTASK()中的GimbalTask()会立即运行
     ShootTask();
 #endif
 
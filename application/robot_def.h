@@ -15,6 +15,7 @@
 #include "ins_task.h"
 #include "master_process.h"
 #include "stdint.h"
+#include "message_center.h"
 
 /* 开发板类型定义,烧录时注意不要弄错对应功能;修改定义后需要重新编译,只能存在一个定义! */
 #define ONE_BOARD // 单板控制整车
@@ -210,4 +211,7 @@ typedef struct
 
 #pragma pack() // 开启字节对齐,结束前面的#pragma pack(1)
 
+/* 为话题表(message_topic.h)中的每个话题定义消息类型TOPIC_XXX_t,message_center的类型化接口据此检查消息长度 */
+MESSAGE_TOPIC_TABLE(MESSAGE_TOPIC_TYPEDEF)
+
 #endif // !ROBOT_DEF_H
\ No newline at end of file
@@ -9,11 +9,19 @@
 #include "robot.h"
 #include "ins_task.h"
 #include "motor_task.h"
+#include "dji_motor.h"
 #include "referee_task.h"
 #include "master_process.h"
 #include "daemon.h"
 #include "HT04.h"
 #include "buzzer.h"
+#include "bsp_can.h"
+#include "bsp_tools.h"
+#include "message_center.h"
+
+#if defined(ONE_BOARD) || defined(GIMBAL_BOARD)
+#include "gimbal.h"
+#endif
 
 #include "bsp_log.h"
 
@@ -22,12 +30,33 @@ osThreadId robotTaskHandle;
 osThreadId motorTaskHandle;
 osThreadId daemonTaskHandle;
 osThreadId uiTaskHandle;
+osThreadId gimbalTaskHandle;
+
+// INS/电机/守护任务不会把栈上的缓冲区交给DMA,它们的栈和TCB可以静态分配在CCM中
+// robot和UI任务会通过DMA发送栈上的数据(如referee_UI),始终从SRAM中的FreeRTOS堆分配
+#ifndef TASK_STACK_IN_CCM
+#define TASK_STACK_IN_CCM 1 // 置0则这三个任务的栈也从FreeRTOS堆分配,用于在开发板上比较栈放入CCM前后的耗时,见bsp.md
+#endif
+
+#if TASK_STACK_IN_CCM
+static uint32_t ins_task_stack[1024] CCMRAM;
+static osStaticThreadDef_t ins_task_tcb CCMRAM;
+static uint32_t motor_task_stack[256] CCMRAM;
+static osStaticThreadDef_t motor_task_tcb CCMRAM;
+static uint32_t daemon_task_stack[256] CCMRAM;
+static osStaticThreadDef_t daemon_task_tcb CCMRAM;
+#endif
+
+// INS_Task()和MotorControlTask()最近一次和启动以来最长的耗时,单位为时钟周期,读取方法见bsp.md
+uint32_t ins_task_cycle, ins_task_cycle_max;
+uint32_t motor_task_cycle, motor_task_cycle_max;
 
 void StartINSTASK(void const *argument);
 void StartMOTORTASK(void const *argument);
 void StartDAEMONTASK(void const *argument);
 void StartROBOTTASK(void const *argument);
 void StartUITASK(void const *argument);
+void StartGIMBALTASK(void const *argument);
 
 /**
  * @brief 初始化机器人任务,所有持续运行的任务都在这里初始化
@@ -35,14 +64,20 @@ void StartUITASK(void const *argument);
  */
 void OSTaskInit()
 {
+#if TASK_STACK_IN_CCM
+    osThreadStaticDef(instask, StartINSTASK, osPriorityAboveNormal, 0, 1024, ins_task_stack, &ins_task_tcb);
+    osThreadStaticDef(motortask, StartMOTORTASK, osPriorityNormal, 0, 256, motor_task_stack, &motor_task_tcb);
+    osThreadStaticDef(daemontask, StartDAEMONTASK, osPriorityNormal, 0, 256, daemon_task_stack, &daemon_task_tcb);
+#else
     osThreadDef(instask, StartINSTASK, osPriorityAboveNormal, 0, 1024);
+    osThreadDef(motortask, StartMOTORTASK, osPriorityNormal, 0, 256);
+    osThreadDef(daemontask, StartDAEMONTASK, osPriorityNormal, 0, 256);
+#endif
     insTaskHandle = osThreadCreate(osThread(instask), NULL); // 由于是阻塞读取传感器,为姿态解算设置较高优先级,确保以1khz的频率执行
     // // 后续修改为读取传感器数据准备好的中断处理,
 
-    osThreadDef(motortask, StartMOTORTASK, osPriorityNormal, 0, 256);
     motorTaskHandle = osThreadCreate(osThread(motortask), NULL);
 
-    osThreadDef(daemontask, StartDAEMONTASK, osPriorityNormal, 0, 128);
     daemonTaskHandle = osThreadCreate(osThread(daemontask), NULL);
 
     osThreadDef(robottask, StartROBOTTASK, osPriorityNormal, 0, 1024);
@@ -51,20 +86,29 @@ void OSTaskInit()
     osThreadDef(uitask, StartUITASK, osPriorityNormal, 0, 512);
     uiTaskHandle = osThreadCreate(osThread(uitask), NULL);
 
-    HTMotorControlInit(); // 没有注册HT电机则不会执行
+#if defined(ONE_BOARD) || defined(GIMBAL_BOARD)
+    // 云台任务等待robot_cmd的控制消息,优先级高于robot任务,消息发布后立即抢占执行,读取消息时也不会被发布打断
+    osThreadDef(gimbaltask, StartGIMBALTASK, osPriorityAboveNormal, 0, 256);
+    gimbalTaskHandle = osThreadCreate(osThread(gimbaltask), NULL);
+#endif
 }
 
 __attribute__((noreturn)) void StartINSTASK(void const *argument)
 {
     static float ins_start;
     static float ins_dt;
+    uint32_t cycle_start;
     INS_Init(); // 确保BMI088被正确初始化.
     LOGINFO("[freeRTOS] INS Task Start");
     for (;;)
     {
         // 1kHz
         ins_start = DWT_GetTimeline_ms();
+        cycle_start = DWT->CYCCNT;
         INS_Task();
+        ins_task_cycle = DWT->CYCCNT - cycle_start;
+        if (ins_task_cycle > ins_task_cycle_max)
+            ins_task_cycle_max = ins_task_cycle;
         ins_dt = DWT_GetTimeline_ms() - ins_start;
         if (ins_dt > 1)
             LOGERROR("[freeRTOS] INS Task is being DELAY! dt = [%f]", &ins_dt);
@@ -77,22 +121,49 @@ __attribute__((noreturn)) void StartMOTORTASK(void const *argument)
 {
     static float motor_dt;
     static float motor_start;
+    uint32_t cycle_start;
     LOGINFO("[freeRTOS] MOTOR Task Start");
+#if DJI_MOTOR_FEEDBACK_SYNC
+    static float motor_tick; // 上一次执行MotorControlTask()的时间
     for (;;)
     {
+        DJIMotorSyncControl(1); // 等待DJI电机的反馈,一组反馈到齐后立即计算并发送,至多等待1ms
+        if (DWT_GetTimeline_ms() - motor_tick < 1)
+            continue;
+        motor_tick = DWT_GetTimeline_ms(); // 其余电机仍按1kHz控制
         motor_start = DWT_GetTimeline_ms();
+        cycle_start = DWT->CYCCNT;
         MotorControlTask();
+        motor_task_cycle = DWT->CYCCNT - cycle_start;
+        if (motor_task_cycle > motor_task_cycle_max)
+            motor_task_cycle_max = motor_task_cycle;
+        motor_dt = DWT_GetTimeline_ms() - motor_start;
+        if (motor_dt > 1)
+            LOGERROR("[freeRTOS] MOTOR Task is being DELAY! dt = [%f]", &motor_dt);
+    }
+#else
+    for (;;)
+    {
+        motor_start = DWT_GetTimeline_ms();
+        cycle_start = DWT->CYCCNT;
+        MotorControlTask();
+        motor_task_cycle = DWT->CYCCNT - cycle_start;
+        if (motor_task_cycle > motor_task_cycle_max)
+            motor_task_cycle_max = motor_task_cycle;
         motor_dt = DWT_GetTimeline_ms() - motor_start;
         if (motor_dt > 1)
             LOGERROR("[freeRTOS] MOTOR Task is being DELAY! dt = [%f]", &motor_dt);
         osDelay(1);
     }
+#endif
 }
 
 __attribute__((noreturn)) void StartDAEMONTASK(void const *argument)
 {
     static float daemon_dt;
     static float daemon_start;
+    static CAN_Bus_Stat_s can_stat[DEVICE_CAN_CNT]; // 两条总线的统计信息,每秒发布一次,可以订阅"can_stat"话题获取
+    Publisher_t *can_stat_pub = PubRegister("can_stat", sizeof(can_stat));
     BuzzerInit();
     LOGINFO("[freeRTOS] Daemon Task Start");
     for (;;)
@@ -101,6 +172,14 @@ __attribute__((noreturn)) void StartDAEMONTASK(void const *argument)
         daemon_start = DWT_GetTimeline_ms();
         DaemonTask();
         BuzzerTask();
+        if (CANStatUpdate())
+        {
+            can_stat[0] = *CANGetBusStat(&hcan1);
+            can_stat[1] = *CANGetBusStat(&hcan2);
+            PubPushMessage(can_stat_pub, can_stat);
+        }
+        if (MessageStatUpdate() && MESSAGE_STAT_DUMP) // 各话题的发布频率,丢弃数和延迟,每秒更新一次
+            MessageStatDump();
         daemon_dt = DWT_GetTimeline_ms() - daemon_start;
         if (daemon_dt > 10)
             LOGERROR("[freeRTOS] Daemon Task is being DELAY! dt = [%f]", &daemon_dt);
@@ -125,6 +204,15 @@ __attribute__((noreturn)) void StartROBOTTASK(void const *argument)
     }
 }
 
+#if defined(ONE_BOARD) || defined(GIMBAL_BOARD)
+__attribute__((noreturn)) void StartGIMBALTASK(void const *argument)
+{
+    LOGINFO("[freeRTOS] GIMBAL Task Start");
+    for (;;)
+        GimbalTask(); // 在GimbalTask()中等待robot_cmd的控制消息,事件驱动,不需要osDelay()
+}
+#endif
+
 __attribute__((noreturn)) void StartUITASK(void const *argument)
 {
     LOGINFO("[freeRTOS] UI Task Start");
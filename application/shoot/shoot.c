@@ -100,15 +100,15 @@ void ShootInit()
     };
     loader = DJIMotorInit(&loader_config);
 
-    shoot_pub = PubRegister("shoot_feed", sizeof(Shoot_Upload_Data_s));
-    shoot_sub = SubRegister("shoot_cmd", sizeof(Shoot_Ctrl_Cmd_s));
+    shoot_pub = PubRegisterTopic(TOPIC_SHOOT_FEED);
+    shoot_sub = SubRegisterTopic(TOPIC_SHOOT_CMD);
 }
 
 /* 机器人发射机构控制核心任务 */
 void ShootTask()
 {
     // 从cmd获取控制数据
-    SubGetMessage(shoot_sub, &shoot_cmd_recv);
+    SubGetTopic(shoot_sub, TOPIC_SHOOT_CMD, &shoot_cmd_recv);
 
     // 对shoot mode等于SHOOT_STOP的情况特殊处理,直接停止所有电机(紧急停止)
     if (shoot_cmd_recv.shoot_mode == SHOOT_OFF)
@@ -209,5 +209,5 @@ void ShootTask()
     }
 
     // 反馈数据,目前暂时没有要设定的反馈数据,后续可能增加应用离线监测以及卡弹反馈
-    PubPushMessage(shoot_pub, (void *)&shoot_feedback_data);
+    PubPushTopic(shoot_pub, TOPIC_SHOOT_FEED, &shoot_feedback_data);
 }
\ No newline at end of file
@@ -1,10 +1,13 @@
 #include <stdarg.h>
+#include <string.h>
 
+#include "main.h"
 #include "cmsis_os.h"
 #include "bsp_log.h"
 #include "bsp_tools.h"
 
-#define MX_SIG_LIST_SIZE 32 // 不可修改,最大信号量数量
+#define MX_SIG_LIST_SIZE 32          // 不可修改,最大信号量数量
+#define CALLBACK_TASK_STACK_SIZE 256 // 回调任务的栈大小,单位为字(4字节),回调中可能会打印日志,不宜过小
 
 typedef struct
 {
@@ -49,8 +52,32 @@ uint32_t CreateCallbackTask(char *name, void *cbk, void *ins, osPriority priorit
     threadDef.pthread = &CallbackTaskBase;
     threadDef.tpriority = priority;
     threadDef.instances = 0;
-    threadDef.stacksize = 128;
+    threadDef.stacksize = CALLBACK_TASK_STACK_SIZE;
     cbkid_list[sig_idx] = osThreadCreate(&threadDef, (void *)&cbkinfo_list[sig_idx]);
 
     return cbkinfo_list[sig_idx++].sig; // 返回信号量,同时增加索引
-}
\ No newline at end of file
+}
+
+void WakeCallbackTask(uint32_t sig)
+{
+    // 信号量为1<<idx,通过前导零个数得到任务在列表中的下标
+    osSignalSet(cbkid_list[31 - __CLZ(sig)], sig);
+}
+
+extern uint8_t _eccmram[]; // CCMRAM变量的结束地址,见链接脚本
+extern uint8_t _eccm[];    // CCM的结束地址
+static uint8_t *ccm_free = NULL;
+
+void *CCMMalloc(size_t size)
+{
+    uint8_t *ptr;
+    if (ccm_free == NULL)
+        ccm_free = _eccmram;
+    ptr = (uint8_t *)(((uintptr_t)ccm_free + 7) & ~(uintptr_t)7);
+    if (ptr + size > _eccm)
+        while (1)
+            LOGERROR("[rtos:ccm] CCMMalloc: CCM RAM exhausted, request [%d] bytes", (int)size);
+    ccm_free = ptr + size;
+    memset(ptr, 0, size); // 启动时只清零了CCMRAM变量所在的区域
+    return ptr;
+}
@@ -1,6 +1,15 @@
 #include "cmsis_os.h"
 #include "bsp_log.h"
 
+/**
+ * @brief 将变量放入CCM RAM(0x10000000,64KB,零等待,只有内核可以访问,不会和DMA争用总线)
+ *        适合控制任务频繁访问的数据,如电机实例/滤波器矩阵/任务栈等
+ *
+ * @attention 1. DMA无法访问CCM,DMA的收发缓冲区(包括在栈上分配后交给DMA发送的缓冲区)不能放在CCM中
+ *            2. 启动时CCM被清零,不支持有初值的变量,初值会被忽略
+ */
+#define CCMRAM __attribute__((section(".ccmram")))
+
 /**
  * @brief 创建一个新的任务,该任务收到osSignalSet信号时会被唤醒,否则保持挂起状态
  * 
@@ -15,3 +24,20 @@
  */
 uint32_t CreateCallbackTask(char *name, void *cbk, void *ins, osPriority priority);
 
+/**
+ * @brief 从CCM RAM中分配内存,用于代替malloc()分配不会被DMA访问的实例
+ *        分配的内存已经清零且8字节对齐,不能释放,因此只应在初始化时调用
+ *        CCM中CCMRAM变量之后的空间都可以分配,不足时进入死循环
+ *
+ * @param size 字节数
+ * @return void* 分配的内存
+ */
+void *CCMMalloc(size_t size);
+
+/**
+ * @brief 唤醒由CreateCallbackTask()创建的任务,可以在中断中调用
+ *
+ * @param sig CreateCallbackTask()返回的信号量
+ */
+void WakeCallbackTask(uint32_t sig);
+
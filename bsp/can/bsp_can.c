@@ -4,13 +4,175 @@
 #include "stdlib.h"
 #include "bsp_dwt.h"
 #include "bsp_log.h"
+#include "bsp_tools.h"
 
 /* can instance ptrs storage, used for recv callback */
-// 在CAN产生接收中断会遍历数组,选出hcan和rxid与发生中断的实例相同的那个,调用其回调函数
-// @todo: 后续为每个CAN总线单独添加一个can_instance指针数组,提高回调查找的性能
 static CANInstance *can_instance[CAN_MX_REGISTER_CNT] = {NULL};
 static uint8_t idx; // 全局CAN实例索引,每次有新的模块注册会自增
 
+/**
+ * @brief 每条总线一张以rx_id为键的开放寻址哈希表,在CANRegister()时建立
+ *        接收中断中根据(总线,StdId)直接查表找到实例,查找耗时与注册的实例数量无关
+ *
+ * @note  同一个rx_id只会被过滤器分配到一个FIFO中,因此不需要再按FIFO区分
+ *        表长取2的幂且不小于CAN_MX_REGISTER_CNT的两倍,装载率不超过0.5,线性探测几乎不会发生
+ */
+static CANInstance *can_rx_table[DEVICE_CAN_CNT][CAN_RX_TABLE_SIZE] = {NULL};
+#if (CAN_RX_TABLE_SIZE & (CAN_RX_TABLE_SIZE - 1)) || (CAN_RX_TABLE_SIZE < 2 * CAN_MX_REGISTER_CNT)
+#error CAN_RX_TABLE_SIZE must be a power of 2 and no less than 2*CAN_MX_REGISTER_CNT
+#endif
+
+/* 软件发送队列中的一帧报文,入队时会拷贝id和数据 */
+typedef struct
+{
+    uint32_t stamp;       // 入队时的DWT->CYCCNT,用于统计排队时间和判断是否超过截止时间
+    uint16_t std_id;      // 标准id只有11位
+    uint16_t deadline_us; // 截止时间,0表示不限
+    uint8_t dlc;
+    uint8_t data[8];
+} CANTxQueueItem_t;
+
+/* 一个优先级的发送队列(环形缓冲区) */
+typedef struct
+{
+    CANTxQueueItem_t item[CAN_TX_QUEUE_LEN];
+    uint8_t head;  // 出队位置,即最早入队的报文
+    uint8_t tail;  // 入队位置
+    uint8_t depth; // 队列中的报文数
+} CANTxRing_t;
+
+/**
+ * @brief 每条总线一个软件发送队列,每个优先级一个环形缓冲区,下标0为最高优先级
+ *        CANTransmit()在邮箱满时入队,发送完成中断中按优先级从高到低出队并填入空出的邮箱
+ */
+typedef struct
+{
+    CANTxRing_t ring[CAN_TX_PRIO_CNT];
+    CAN_Tx_Queue_Stat_s stat;
+} CANTxQueue_t;
+
+static CANTxQueue_t can_tx_queue[DEVICE_CAN_CNT];
+
+/* 延迟解析模式下,中断放入环形缓冲区的一帧报文 */
+typedef struct
+{
+    CANInstance *instance;
+    uint32_t stamp;
+    uint16_t hw_stamp;
+    uint8_t len;
+    uint8_t data[8];
+} CANRxRingItem_t;
+
+/**
+ * @brief 接收中断(生产者)和解析任务(消费者)之间的单生产者单消费者环形缓冲区
+ *        四个接收中断的优先级相同,不会互相抢占,因此可以视为同一个生产者,读写双方都不需要加锁
+ *        head只由解析任务修改,tail只由中断修改
+ */
+static struct
+{
+    CANRxRingItem_t item[CAN_RX_RING_LEN];
+    volatile uint16_t head; // 读位置,解析任务修改
+    volatile uint16_t tail; // 写位置,接收中断修改
+} can_rx_ring;
+#if (CAN_RX_RING_LEN & (CAN_RX_RING_LEN - 1))
+#error CAN_RX_RING_LEN must be a power of 2
+#endif
+
+/* 每条总线每个FIFO正在填充的过滤器,16位id list模式下一个过滤器可以放4个id */
+typedef struct
+{
+    uint8_t bank;    // 过滤器编号
+    uint8_t cnt;     // 已放入的id数量
+    uint16_t id[4];  // 已经左移到寄存器位置的id
+} CANFilterBank_t;
+
+static CANFilterBank_t can_open_bank[DEVICE_CAN_CNT][2];
+static CAN_Rx_Fifo_Stat_s can_fifo_stat[DEVICE_CAN_CNT];
+
+/**
+ * @brief 总线统计的内部状态
+ *        累计位数和帧数只增不减,统计周期内的增量由CANStatUpdate()做差得到,中断和任务之间不需要同步清零
+ */
+typedef struct
+{
+    CAN_Bus_Stat_s stat;
+    uint32_t bit_cnt;      // 累计收发的位数(估计值)
+    uint32_t last_bit_cnt; // 上一个统计周期结束时的bit_cnt
+    uint32_t last_tx_cnt;
+    uint32_t last_rx_cnt;
+    uint32_t window_start; // 本统计周期开始时的DWT->CYCCNT
+} CANBusStat_t;
+
+static CANBusStat_t can_bus_stat[DEVICE_CAN_CNT];
+static CAN_HandleTypeDef *const can_bus_handle[DEVICE_CAN_CNT] = {&hcan1, &hcan2};
+static const uint16_t can_tx_wait_bound_us[CAN_TX_WAIT_HIST_BINS - 2] = {100, 250, 500, 1000}; // 直方图第1-4个区间的上界,第5个区间为>=1ms
+
+// 一帧标准数据帧在总线上占用的位数:44位帧结构+3位帧间隔+数据,再加上最坏情况下的填充位
+#define CAN_FRAME_BITS(dlc) (47 + 8 * (dlc) + (34 + 8 * (dlc)-1) / 4)
+
+/* 聚合发送帧,在第一个槽位注册时分配 */
+static CANTxGroupInstance can_tx_group[CAN_TX_GROUP_CNT];
+static uint8_t tx_group_idx;
+
+static uint32_t can_rx_sig; // 解析任务的信号量,第一个延迟解析的实例注册时创建任务
+static CAN_Rx_Stat_s can_rx_stat;
+
+/* ----------------static functions used by rx dispatch table-------------------- */
+
+// 获取总线在查找表中的下标,CAN1为0,CAN2为1
+static inline uint8_t CANBusIndex(CAN_HandleTypeDef *_hcan)
+{
+    return _hcan == &hcan1 ? 0 : 1;
+}
+
+// 将11位标准id折叠到表长范围内,DJI电机等连续id会落在连续的槽位上
+static inline uint32_t CANRxHash(uint32_t std_id)
+{
+    return (std_id ^ (std_id >> 5)) & (CAN_RX_TABLE_SIZE - 1);
+}
+
+/**
+ * @brief 在对应总线的查找表中查找rx_id相同的实例
+ *
+ * @param _hcan 总线句柄
+ * @param rx_id 接收id
+ * @return CANInstance* 找到则返回实例指针,否则返回NULL
+ */
+static CANInstance *CANRxLookup(CAN_HandleTypeDef *_hcan, uint32_t rx_id)
+{
+    CANInstance **table = can_rx_table[CANBusIndex(_hcan)];
+    uint32_t slot = CANRxHash(rx_id);
+    while (table[slot] != NULL) // 遇到空槽说明该id没有注册
+    {
+        if (table[slot]->rx_id == rx_id)
+            return table[slot];
+        slot = (slot + 1) & (CAN_RX_TABLE_SIZE - 1); // 线性探测
+    }
+    return NULL;
+}
+
+/**
+ * @brief 延迟解析任务,被唤醒后取出环形缓冲区中的所有报文,依次写入实例并调用回调函数
+ *        通过CreateCallbackTask()注册,每次执行完毕后等待接收中断的信号
+ */
+static void CANRxDeferredDrain(void const *unused)
+{
+    CANRxRingItem_t *item;
+    CANInstance *instance;
+    while (can_rx_ring.head != can_rx_ring.tail)
+    {
+        item = &can_rx_ring.item[can_rx_ring.head & (CAN_RX_RING_LEN - 1)];
+        instance = item->instance;
+        instance->rx_len = item->len;
+        instance->rx_stamp = item->stamp;
+        instance->rx_hw_stamp = item->hw_stamp;
+        memcpy(instance->rx_buff, item->data, item->len);
+        __DMB();               // 数据取出后再释放槽位
+        can_rx_ring.head++;    // 释放后中断即可覆写此槽位,回调只访问实例中的数据
+        instance->can_module_callback(instance);
+    }
+}
+
 /* ----------------two static function called by CANRegister()-------------------- */
 
 /**
@@ -18,44 +180,69 @@ static uint8_t idx; // 全局CAN实例索引,每次有新的模块注册会自
  *        给CAN添加过滤器后,BxCAN会根据接收到的报文的id进行消息过滤,符合规则的id会被填入FIFO触发中断
  *
  * @note f407的bxCAN有28个过滤器,这里将其配置为前14个过滤器给CAN1使用,后14个被CAN2使用
- *       初始化时,奇数id的模块会被分配到FIFO0,偶数id的模块会被分配到FIFO1
- *       注册到CAN1的模块使用过滤器0-13,CAN2使用过滤器14-27
+ *       过滤器工作在16位id list模式下,每个过滤器可以放4个id,因此每条总线最多可以接收56个id
+ *       每条总线的每个FIFO各有一个"正在填充"的过滤器,放满4个id后再启用下一个过滤器
+ *       新的id会被分配到当前负载(已分配id的声明接收频率之和)较小的FIFO,使两个FIFO的负载尽量相等
  *
  * @attention 你不需要完全理解这个函数的作用,因为它主要是用于初始化,在开发过程中不需要关心底层的实现
  *            享受开发的乐趣吧!如果你真的想知道这个函数在干什么,请联系作者或自己查阅资料(请直接查阅官方的reference manual)
  *
  * @param _instance can instance owned by specific module
+ * @param rx_rate_hz 该实例预期的接收频率
  */
-static void CANAddFilter(CANInstance *_instance)
+static void CANAddFilter(CANInstance *_instance, uint16_t rx_rate_hz)
 {
     CAN_FilterTypeDef can_filter_conf;
-    static uint8_t can1_filter_idx = 0, can2_filter_idx = 14; // 0-13给can1用,14-27给can2用
+    uint8_t bus = CANBusIndex(_instance->can_handle);
+    CAN_Rx_Fifo_Stat_s *stat = &can_fifo_stat[bus];
+    uint8_t fifo = stat->load_hz[0] <= stat->load_hz[1] ? 0 : 1; // 选择负载较小的FIFO
+    CANFilterBank_t *bank = &can_open_bank[bus][fifo];
+
+    if (bank->cnt == 0 || bank->cnt == 4) // 该FIFO还没有过滤器或已经放满,启用一个新的过滤器
+    {
+        if (stat->bank_cnt >= MX_CAN_FILTER_CNT / DEVICE_CAN_CNT)
+        {
+            while (1)
+                LOGERROR("[bsp_can] CAN filter bank exhausted, too many rx id on one bus");
+        }
+        bank->bank = bus * (MX_CAN_FILTER_CNT / DEVICE_CAN_CNT) + stat->bank_cnt++; // 0-13给can1用,14-27给can2用
+        bank->cnt = 0;
+    }
+    bank->id[bank->cnt++] = _instance->rx_id << 5; // 16位模式下只有高11位为STDID,低5位要填0
 
-    can_filter_conf.FilterMode = CAN_FILTERMODE_IDLIST;                                                       // 使用id list模式,即只有将rxid添加到过滤器中才会接收到,其他报文会被过滤
-    can_filter_conf.FilterScale = CAN_FILTERSCALE_16BIT;                                                      // 使用16位id模式,即只有低16位有效
-    can_filter_conf.FilterFIFOAssignment = (_instance->tx_id & 1) ? CAN_RX_FIFO0 : CAN_RX_FIFO1;              // 奇数id的模块会被分配到FIFO0,偶数id的模块会被分配到FIFO1
-    can_filter_conf.SlaveStartFilterBank = 14;                                                                // 从第14个过滤器开始配置从机过滤器(在STM32的BxCAN控制器中CAN2是CAN1的从机)
-    can_filter_conf.FilterIdLow = _instance->rx_id << 5;                                                      // 过滤器寄存器的低16位,因为使用STDID,所以只有低11位有效,高5位要填0
-    can_filter_conf.FilterBank = _instance->can_handle == &hcan1 ? (can1_filter_idx++) : (can2_filter_idx++); // 根据can_handle判断是CAN1还是CAN2,然后自增
-    can_filter_conf.FilterActivation = CAN_FILTER_ENABLE;                                                     // 启用过滤器
+    can_filter_conf.FilterMode = CAN_FILTERMODE_IDLIST;                                     // 使用id list模式,即只有将rxid添加到过滤器中才会接收到,其他报文会被过滤
+    can_filter_conf.FilterScale = CAN_FILTERSCALE_16BIT;                                    // 使用16位id模式,一个过滤器可以放4个id
+    can_filter_conf.FilterFIFOAssignment = fifo ? CAN_RX_FIFO1 : CAN_RX_FIFO0;              // 该过滤器中的id都进入同一个FIFO
+    can_filter_conf.SlaveStartFilterBank = 14;                                              // 从第14个过滤器开始配置从机过滤器(在STM32的BxCAN控制器中CAN2是CAN1的从机)
+    can_filter_conf.FilterIdHigh = bank->id[0];                                             // 4个16位寄存器各放一个id
+    can_filter_conf.FilterIdLow = bank->id[bank->cnt > 1 ? 1 : 0];                          // 尚未使用的位置重复填入第一个id
+    can_filter_conf.FilterMaskIdHigh = bank->id[bank->cnt > 2 ? 2 : 0];                     // list模式下mask寄存器同样用于存放id
+    can_filter_conf.FilterMaskIdLow = bank->id[bank->cnt > 3 ? 3 : 0];
+    can_filter_conf.FilterBank = bank->bank;
+    can_filter_conf.FilterActivation = CAN_FILTER_ENABLE; // 启用过滤器
 
-    HAL_CAN_ConfigFilter(_instance->can_handle, &can_filter_conf);
+    HAL_CAN_ConfigFilter(_instance->can_handle, &can_filter_conf); // 同一个过滤器会随id的加入被重新配置
+
+    stat->load_hz[fifo] += rx_rate_hz;
+    stat->id_cnt[fifo]++;
 }
 
 /**
  * @brief 在第一个CAN实例初始化的时候会自动调用此函数,启动CAN服务
  *
- * @note 此函数会启动CAN1和CAN2,开启CAN1和CAN2的FIFO0 & FIFO1溢出通知
+ * @note 此函数会启动CAN1和CAN2,开启CAN1和CAN2的FIFO0 & FIFO1新消息通知、溢出通知以及发送邮箱空闲通知
  *
  */
 static void CANServiceInit()
 {
     HAL_CAN_Start(&hcan1);
-    HAL_CAN_ActivateNotification(&hcan1, CAN_IT_RX_FIFO0_MSG_PENDING);
-    HAL_CAN_ActivateNotification(&hcan1, CAN_IT_RX_FIFO1_MSG_PENDING);
+    HAL_CAN_ActivateNotification(&hcan1, CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_RX_FIFO0_OVERRUN);
+    HAL_CAN_ActivateNotification(&hcan1, CAN_IT_RX_FIFO1_MSG_PENDING | CAN_IT_RX_FIFO1_OVERRUN);
+    HAL_CAN_ActivateNotification(&hcan1, CAN_IT_TX_MAILBOX_EMPTY);
     HAL_CAN_Start(&hcan2);
-    HAL_CAN_ActivateNotification(&hcan2, CAN_IT_RX_FIFO0_MSG_PENDING);
-    HAL_CAN_ActivateNotification(&hcan2, CAN_IT_RX_FIFO1_MSG_PENDING);
+    HAL_CAN_ActivateNotification(&hcan2, CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_RX_FIFO0_OVERRUN);
+    HAL_CAN_ActivateNotification(&hcan2, CAN_IT_RX_FIFO1_MSG_PENDING | CAN_IT_RX_FIFO1_OVERRUN);
+    HAL_CAN_ActivateNotification(&hcan2, CAN_IT_TX_MAILBOX_EMPTY);
 }
 
 /* ----------------------- two extern callable function -----------------------*/
@@ -72,60 +259,335 @@ CANInstance *CANRegister(CAN_Init_Config_s *config)
         while (1)
             LOGERROR("[bsp_can] CAN instance exceeded MAX num, consider balance the load of CAN bus");
     }
-    for (size_t i = 0; i < idx; i++)
-    { // 重复注册 | id重复
-        if (can_instance[i]->rx_id == config->rx_id && can_instance[i]->can_handle == config->can_handle)
-        {
-            while (1)
-                LOGERROR("[}bsp_can] CAN id crash ,tx [%d] or rx [%d] already registered", &config->tx_id, &config->rx_id);
-        }
+    if (CANRxLookup(config->can_handle, config->rx_id) != NULL) // 重复注册 | id重复
+    {
+        while (1)
+            LOGERROR("[bsp_can] CAN id crash ,tx [%d] or rx [%d] already registered", config->tx_id, config->rx_id);
     }
-    
+
+
     CANInstance *instance = (CANInstance *)malloc(sizeof(CANInstance)); // 分配空间
     memset(instance, 0, sizeof(CANInstance));                           // 分配的空间未必是0,所以要先清空
-    // 进行发送报文的配置
-    instance->txconf.StdId = config->tx_id; // 发送id
-    instance->txconf.IDE = CAN_ID_STD;      // 使用标准id,扩展id则使用CAN_ID_EXT(目前没有需求)
-    instance->txconf.RTR = CAN_RTR_DATA;    // 发送数据帧
-    instance->txconf.DLC = 0x08;            // 默认发送长度为8
     // 设置回调函数和接收发送id
     instance->can_handle = config->can_handle;
-    instance->tx_id = config->tx_id; // 好像没用,可以删掉
+    instance->tx_id = config->tx_id; // 发送id
+    instance->tx_dlc = 0x08;         // 默认发送长度为8
     instance->rx_id = config->rx_id;
     instance->can_module_callback = config->can_module_callback;
     instance->id = config->id;
+    instance->rx_mode = config->rx_mode;
+    instance->tx_priority = config->tx_priority;
+    instance->tx_deadline_us = config->tx_deadline_us;
+
+    if (instance->rx_mode == CAN_RX_DEFERRED && !can_rx_sig) // 第一个延迟解析的实例,创建解析任务
+        can_rx_sig = CreateCallbackTask("can_rx", CANRxDeferredDrain, NULL, osPriorityRealtime);
 
-    CANAddFilter(instance);         // 添加CAN过滤器规则
+    CANAddFilter(instance, config->rx_rate_hz ? config->rx_rate_hz : CAN_DEFAULT_RX_RATE_HZ); // 添加CAN过滤器规则
     can_instance[idx++] = instance; // 将实例保存到can_instance中
 
+    // 插入接收查找表,表长大于实例总数,一定能找到空槽
+    CANInstance **table = can_rx_table[CANBusIndex(instance->can_handle)];
+    uint32_t slot = CANRxHash(instance->rx_id);
+    while (table[slot] != NULL)
+        slot = (slot + 1) & (CAN_RX_TABLE_SIZE - 1);
+    table[slot] = instance;
+
     return instance; // 返回can实例指针
 }
 
-/* @todo 目前似乎封装过度,应该添加一个指向tx_buff的指针,tx_buff不应该由CAN instance保存 */
-/* 如果让CANinstance保存txbuff,会增加一次复制的开销 */
-uint8_t CANTransmit(CANInstance *_instance, float timeout)
+/**
+ * @brief 将一帧报文填入空闲的邮箱,调用前需确认有空闲邮箱
+ *        HAL会直接从data处拷贝数据到邮箱寄存器
+ *
+ * @return uint8_t HAL_CAN_AddTxMessage()的返回值,成功为HAL_OK(0)
+ */
+static uint8_t CANAddToMailbox(CAN_HandleTypeDef *_hcan, uint32_t std_id, uint8_t dlc, uint8_t *data)
+{
+    static uint32_t tx_mailbox; // 实际填入的邮箱号,知道是哪个邮箱发的似乎也没啥用
+    CANBusStat_t *bus = &can_bus_stat[CANBusIndex(_hcan)];
+    CAN_TxHeaderTypeDef txconf = {
+        .StdId = std_id,
+        .IDE = CAN_ID_STD,   // 使用标准id,扩展id则使用CAN_ID_EXT(目前没有需求)
+        .RTR = CAN_RTR_DATA, // 发送数据帧
+        .DLC = dlc,
+    };
+    if (HAL_CAN_AddTxMessage(_hcan, &txconf, data, &tx_mailbox) != HAL_OK)
+        return HAL_ERROR;
+    bus->stat.tx_frame_cnt++;
+    bus->bit_cnt += CAN_FRAME_BITS(dlc);
+    return HAL_OK;
+}
+
+// 将CAN_Tx_Priority_e转换为发送队列的下标,0为最高优先级
+static inline uint8_t CANTxPrioIndex(uint8_t priority)
+{
+    if (priority == CAN_TX_PRIO_DEFAULT || priority > CAN_TX_PRIO_LOW)
+        priority = CAN_TX_PRIO_NORMAL;
+    return priority - CAN_TX_PRIO_HIGH;
+}
+
+// 对于给定优先级是否有可用的邮箱,最高优先级可以使用全部邮箱,其余优先级需要留出CAN_TX_RESERVED_MAILBOX个
+static inline uint8_t CANTxMailboxAvailable(CAN_HandleTypeDef *_hcan, uint8_t prio_idx)
 {
-    static uint32_t busy_count;
-    static volatile float wait_time __attribute__((unused)); // for cancel warning
-    float dwt_start = DWT_GetTimeline_ms();
-    while (HAL_CAN_GetTxMailboxesFreeLevel(_instance->can_handle) == 0) // 等待邮箱空闲
+    uint32_t free_level = HAL_CAN_GetTxMailboxesFreeLevel(_hcan);
+    return prio_idx == 0 ? free_level > 0 : free_level > CAN_TX_RESERVED_MAILBOX;
+}
+
+/**
+ * @brief 按优先级从高到低将队列中的报文依次填入空闲的邮箱,直到邮箱已满或队列为空
+ *        出队时排队时间超过截止时间的报文会被丢弃,不会迟到发送
+ * @attention 调用时必须已经关闭中断,或处于CAN中断中
+ *
+ * @param _hcan 总线句柄
+ * @param queue 该总线的发送队列
+ */
+static void CANTxQueueFlush(CAN_HandleTypeDef *_hcan, CANTxQueue_t *queue)
+{
+    CANTxRing_t *ring;
+    CANTxQueueItem_t *item;
+    uint32_t *hist = can_bus_stat[CANBusIndex(_hcan)].stat.tx_wait_hist;
+    uint32_t wait_us;
+    uint8_t bin;
+    for (uint8_t p = 0; p < CAN_TX_PRIO_CNT; p++)
     {
-        if (DWT_GetTimeline_ms() - dwt_start > timeout) // 超时
+        ring = &queue->ring[p];
+        while (ring->depth && CANTxMailboxAvailable(_hcan, p))
         {
-            LOGWARNING("[bsp_can] CAN MAILbox full! failed to add msg to mailbox. Cnt [%d]", busy_count);
-            busy_count++;
-            return 0;
+            item = &ring->item[ring->head];
+            ring->head = (ring->head + 1) % CAN_TX_QUEUE_LEN;
+            ring->depth--;
+            queue->stat.depth--;
+
+            wait_us = (DWT->CYCCNT - item->stamp) / (SystemCoreClock / 1000000);
+            if (item->deadline_us && wait_us > item->deadline_us)
+            { // 已经过期,丢弃,使用者很快会发送更新的报文
+                queue->stat.deadline_miss_cnt[p]++;
+                continue;
+            }
+            CANAddToMailbox(_hcan, item->std_id, item->dlc, item->data);
+            for (bin = 1; bin < CAN_TX_WAIT_HIST_BINS - 1 && wait_us >= can_tx_wait_bound_us[bin - 1]; bin++)
+                ;
+            hist[bin]++;
         }
+        if (ring->depth) // 该优先级还有报文在等待邮箱,更低优先级的报文不能越过它
+            break;
+    }
+}
+
+/**
+ * @brief CANTransmit()和CANTransmitFrame()的实际实现
+ *        对应优先级的队列为空且有可用邮箱时直接从调用者的数据填入邮箱(不经过任何中间缓存),否则拷贝到该优先级的队列中
+ */
+static uint8_t CANSend(CAN_HandleTypeDef *hcan, uint32_t std_id, uint8_t dlc, uint8_t *data, uint8_t priority, uint16_t deadline_us)
+{
+    CANTxQueue_t *queue = &can_tx_queue[CANBusIndex(hcan)];
+    CAN_Bus_Stat_s *bus_stat = &can_bus_stat[CANBusIndex(hcan)].stat;
+    uint8_t prio_idx = CANTxPrioIndex(priority);
+    CANTxRing_t *ring = &queue->ring[prio_idx];
+    CANTxQueueItem_t *item;
+    uint8_t ret = 1, overflow = 0, mailbox_free;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq(); // 发送完成中断同样会操作队列,关中断保护,临界区内只有几次拷贝
+    CANTxQueueFlush(hcan, queue); // 邮箱可能因发送出错而空出却没有触发发送完成回调,先尝试填充一次
+    mailbox_free = CANTxMailboxAvailable(hcan, prio_idx);
+    if (!mailbox_free)
+        bus_stat->mailbox_full_cnt++;
+    if (ring->depth == 0 && mailbox_free)
+    { // 队列为空且有可用邮箱,直接填入邮箱,保证同一优先级的报文按调用顺序发出
+        // 刚刚完成flush,若更高优先级的队列不为空,则不会有可用邮箱,因此不会越过更高优先级的报文
+        if (CANAddToMailbox(hcan, std_id, dlc, data))
+            ret = 0;
+        else
+            bus_stat->tx_wait_hist[0]++;
     }
-    wait_time = DWT_GetTimeline_ms() - dwt_start;
-    // tx_mailbox会保存实际填入了这一帧消息的邮箱,但是知道是哪个邮箱发的似乎也没啥用
-    if (HAL_CAN_AddTxMessage(_instance->can_handle, &_instance->txconf, _instance->tx_buff, &_instance->tx_mailbox))
+    else if (ring->depth >= CAN_TX_QUEUE_LEN)
+    { // 队列已满,丢弃本帧
+        queue->stat.overflow_cnt++;
+        ret = 0;
+        overflow = 1;
+    }
+    else
+    { // 邮箱已满,拷贝到队列尾部,等待发送完成中断将其填入邮箱
+        item = &ring->item[ring->tail];
+        item->std_id = std_id;
+        item->stamp = DWT->CYCCNT;
+        item->deadline_us = deadline_us;
+        item->dlc = dlc;
+        memcpy(item->data, data, dlc);
+        ring->tail = (ring->tail + 1) % CAN_TX_QUEUE_LEN;
+        ring->depth++;
+        queue->stat.enqueue_cnt++;
+        if (++queue->stat.depth > queue->stat.max_depth)
+            queue->stat.max_depth = queue->stat.depth;
+    }
+    __set_PRIMASK(primask);
+
+    if (overflow) // 日志输出较慢,放到临界区外
+        LOGWARNING("[bsp_can] CAN tx queue full! failed to add msg to queue. Cnt [%d]", queue->stat.overflow_cnt);
+    else if (!ret)
+        LOGWARNING("[bsp_can] CAN bus BUS! failed to add msg to mailbox.");
+    return ret;
+}
+
+uint8_t CANTransmit(CANInstance *_instance, uint8_t *tx_data)
+{
+    uint8_t ret = CANSend(_instance->can_handle, _instance->tx_id, _instance->tx_dlc, tx_data,
+                          _instance->tx_priority, _instance->tx_deadline_us);
+    if (ret)
+        _instance->stat.tx_cnt++;
+    return ret;
+}
+
+uint8_t CANTransmitFrame(CAN_HandleTypeDef *hcan, CAN_Tx_Frame_s const *frame)
+{
+    return CANSend(hcan, frame->std_id, frame->dlc, frame->data, frame->priority, frame->deadline_us);
+}
+
+CANTxSlotInstance *CANTxSlotRegister(CAN_Tx_Slot_Config_s *config)
+{
+    CANTxGroupInstance *group = NULL;
+    uint8_t mask;
+
+    if (config->slot_len == 0 || config->slot_offset + config->slot_len > 8)
+    {
+        while (1)
+            LOGERROR("[bsp_can] CAN tx slot out of range, offset [%d] len [%d]", config->slot_offset, config->slot_len);
+    }
+    for (uint8_t i = 0; i < tx_group_idx; i++) // 查找总线和id相同的聚合帧
+    {
+        if (can_tx_group[i].can_handle == config->can_handle && can_tx_group[i].frame.std_id == config->group_id)
+        {
+            group = &can_tx_group[i];
+            break;
+        }
+    }
+    if (group == NULL) // 第一个槽位,创建聚合帧
+    {
+        if (tx_group_idx >= CAN_TX_GROUP_CNT)
+        {
+            while (1)
+                LOGERROR("[bsp_can] CAN tx group exceeded MAX num");
+        }
+        group = &can_tx_group[tx_group_idx++];
+        group->can_handle = config->can_handle;
+        group->frame.std_id = config->group_id;
+        group->frame.dlc = 0x08; // 目前的多设备协议都使用8字节的完整帧
+        group->frame.priority = config->priority;
+        group->frame.deadline_us = config->deadline_us;
+        group->frame.data = group->buff;
+    }
+
+    mask = (uint8_t)(((1u << config->slot_len) - 1) << config->slot_offset);
+    if (group->slot_mask & mask) // 槽位重叠,说明有两个设备的id冲突
     {
-        LOGWARNING("[bsp_can] CAN bus BUS! cnt:%d", busy_count);
-        busy_count++;
-        return 0;
+        while (1)
+            LOGERROR("[bsp_can] CAN tx slot crash, group id [%d] offset [%d]", config->group_id, config->slot_offset);
     }
-    return 1; // 发送成功
+    group->slot_mask |= mask;
+
+    CANTxSlotInstance *slot = (CANTxSlotInstance *)malloc(sizeof(CANTxSlotInstance));
+    slot->group = group;
+    slot->offset = config->slot_offset;
+    slot->len = config->slot_len;
+    return slot;
+}
+
+void CANTxSlotWrite(CANTxSlotInstance *slot, uint8_t const *data)
+{
+    memcpy(slot->group->buff + slot->offset, data, slot->len);
+    slot->group->dirty = 1;
+}
+
+void CANTxSlotFlush(CANTxSlotInstance *slot)
+{
+    CANTxGroupInstance *group = slot->group;
+    if (!group->dirty)
+        return;
+    group->dirty = 0;
+    CANTransmitFrame(group->can_handle, &group->frame);
+}
+
+void CANTxGroupFlush(void)
+{
+    CANTxGroupInstance *group;
+    for (uint8_t i = 0; i < tx_group_idx; i++)
+    {
+        group = &can_tx_group[i];
+        if (!group->dirty) // 本周期没有设备写入,不发送空帧或重复帧
+            continue;
+        group->dirty = 0;
+        CANTransmitFrame(group->can_handle, &group->frame);
+    }
+}
+
+CAN_Tx_Queue_Stat_s const *CANGetTxQueueStat(CAN_HandleTypeDef *hcan)
+{
+    return &can_tx_queue[CANBusIndex(hcan)].stat;
+}
+
+CAN_Rx_Stat_s const *CANGetRxStat(void)
+{
+    return &can_rx_stat;
+}
+
+CAN_Rx_Fifo_Stat_s const *CANGetRxFifoStat(CAN_HandleTypeDef *hcan)
+{
+    return &can_fifo_stat[CANBusIndex(hcan)];
+}
+
+CAN_Bus_Stat_s const *CANGetBusStat(CAN_HandleTypeDef *hcan)
+{
+    return &can_bus_stat[CANBusIndex(hcan)].stat;
+}
+
+uint8_t CANStatUpdate(void)
+{
+    CANBusStat_t *bus;
+    CAN_Bus_Stat_s *stat;
+    uint32_t esr, btr, bitrate, now, elapsed, bit_cnt, tx_cnt, rx_cnt;
+    float elapsed_s;
+    uint8_t state, window_done = 0;
+
+    for (uint8_t i = 0; i < DEVICE_CAN_CNT; i++)
+    {
+        bus = &can_bus_stat[i];
+        stat = &bus->stat;
+
+        // 错误计数器和错误状态,bus-off通过轮询状态变化计数
+        esr = can_bus_handle[i]->Instance->ESR;
+        stat->tec = (esr & CAN_ESR_TEC) >> CAN_ESR_TEC_Pos;
+        stat->rec = (esr & CAN_ESR_REC) >> CAN_ESR_REC_Pos;
+        stat->last_error_code = (esr & CAN_ESR_LEC) >> CAN_ESR_LEC_Pos;
+        state = (esr & CAN_ESR_BOFF) ? CAN_BUS_OFF : (esr & CAN_ESR_EPVF) ? CAN_ERROR_PASSIVE
+                                                 : (esr & CAN_ESR_EWGF)   ? CAN_ERROR_WARNING
+                                                                          : CAN_ERROR_ACTIVE;
+        if (state == CAN_BUS_OFF && stat->error_state != CAN_BUS_OFF)
+            stat->bus_off_cnt++;
+        stat->error_state = state;
+
+        // 帧率和利用率,每个统计周期计算一次
+        now = DWT->CYCCNT;
+        elapsed = now - bus->window_start;
+        if (elapsed < SystemCoreClock / 1000 * CAN_STAT_WINDOW_MS)
+            continue;
+        bit_cnt = bus->bit_cnt; // 中断可能随时修改,先取出再做差
+        tx_cnt = stat->tx_frame_cnt;
+        rx_cnt = stat->rx_frame_cnt;
+        elapsed_s = (float)elapsed / SystemCoreClock;
+        btr = can_bus_handle[i]->Instance->BTR; // 波特率=PCLK1/(BRP*(1+TS1+TS2))
+        bitrate = HAL_RCC_GetPCLK1Freq() / ((((btr & CAN_BTR_BRP) >> CAN_BTR_BRP_Pos) + 1) *
+                                            (((btr & CAN_BTR_TS1) >> CAN_BTR_TS1_Pos) + ((btr & CAN_BTR_TS2) >> CAN_BTR_TS2_Pos) + 3));
+        stat->tx_fps = (uint16_t)((tx_cnt - bus->last_tx_cnt) / elapsed_s);
+        stat->rx_fps = (uint16_t)((rx_cnt - bus->last_rx_cnt) / elapsed_s);
+        stat->bus_load = (bit_cnt - bus->last_bit_cnt) / elapsed_s / bitrate;
+        bus->last_bit_cnt = bit_cnt;
+        bus->last_tx_cnt = tx_cnt;
+        bus->last_rx_cnt = rx_cnt;
+        bus->window_start = now;
+        window_done = 1;
+    }
+    return window_done;
 }
 
 void CANSetDLC(CANInstance *_instance, uint8_t length)
@@ -134,14 +596,41 @@ void CANSetDLC(CANInstance *_instance, uint8_t length)
     if (length > 8 || length == 0) // 安全检查
         while (1)
             LOGERROR("[bsp_can] CAN DLC error! check your code or wild pointer");
-    _instance->txconf.DLC = length;
+    _instance->tx_dlc = length;
 }
 
 /* -----------------------belows are callback definitions--------------------------*/
 
+/**
+ * @brief 更新实例的接收统计,在接收中断中调用
+ *        间隔的平均值和抖动使用1/8系数的滑动平均,整数运算,避免在中断中使用浮点
+ *
+ * @param stat 实例的统计信息
+ * @param rx_stamp 本帧的到达时间戳
+ */
+static inline void CANRxStatUpdate(CAN_Instance_Stat_s *stat, uint32_t rx_stamp)
+{
+    int32_t dt_us, dev_us;
+    if (stat->rx_cnt++)
+    {
+        dt_us = (int32_t)((rx_stamp - stat->rx_last_stamp) / (SystemCoreClock / 1000000));
+        if (stat->rx_cnt == 2) // 第二帧,用第一个间隔初始化平均值
+            stat->rx_period_us = dt_us;
+        dev_us = dt_us - (int32_t)stat->rx_period_us;
+        stat->rx_period_us = (int32_t)stat->rx_period_us + dev_us / 8;
+        dev_us = dev_us < 0 ? -dev_us : dev_us;
+        stat->rx_jitter_us = (int32_t)stat->rx_jitter_us + (dev_us - (int32_t)stat->rx_jitter_us) / 8;
+        if ((uint32_t)dev_us > stat->rx_jitter_max_us)
+            stat->rx_jitter_max_us = dev_us;
+    }
+    stat->rx_last_stamp = rx_stamp;
+}
+
 /**
  * @brief 此函数会被下面两个函数调用,用于处理FIFO0和FIFO1溢出中断(说明收到了新的数据)
- *        所有的实例都会被遍历,找到can_handle和rx_id相等的实例时,调用该实例的回调函数
+ *        通过总线的接收查找表直接找到rx_id对应的实例,调用该实例的回调函数
+ *        回调前会将报文到达的时间戳写入实例的rx_stamp,模块应使用它而不是在回调中读取当前时间
+ *        延迟解析的实例则只把报文放入环形缓冲区,由解析任务调用回调函数
  *
  * @param _hcan
  * @param fifox passed to HAL_CAN_GetRxMessage() to get mesg from a specific fifo
@@ -150,23 +639,67 @@ static void CANFIFOxCallback(CAN_HandleTypeDef *_hcan, uint32_t fifox)
 {
     static CAN_RxHeaderTypeDef rxconf; // 同上
     uint8_t can_rx_buff[8];
+    CANInstance *instance;
+    CANRxRingItem_t *item;
+    CAN_Rx_Isr_Stat_s *isr_stat;
+    uint32_t frame_start, cycles;
+    uint16_t depth;
+    uint8_t wake = 0; // 是否有报文进入环形缓冲区,需要唤醒解析任务
+    // 进入中断时FIFO中的报文都已经到达,在取出报文之前记录时间戳,保证其不受FIFO排空顺序和回调耗时的影响
+    uint32_t rx_stamp = DWT->CYCCNT;
+    uint32_t *fifo_frame_cnt = &can_fifo_stat[CANBusIndex(_hcan)].frame_cnt[fifox];
+    CANBusStat_t *bus = &can_bus_stat[CANBusIndex(_hcan)];
     while (HAL_CAN_GetRxFifoFillLevel(_hcan, fifox)) // FIFO不为空,有可能在其他中断时有多帧数据进入
     {
+        frame_start = DWT->CYCCNT;
+        (*fifo_frame_cnt)++;
         HAL_CAN_GetRxMessage(_hcan, fifox, &rxconf, can_rx_buff); // 从FIFO中获取数据
-        for (size_t i = 0; i < idx; ++i)
-        { // 两者相等说明这是要找的实例
-            if (_hcan == can_instance[i]->can_handle && rxconf.StdId == can_instance[i]->rx_id)
+        bus->stat.rx_frame_cnt++;
+        bus->bit_cnt += CAN_FRAME_BITS(rxconf.DLC);
+        instance = CANRxLookup(_hcan, rxconf.StdId);              // 查表获取实例,未注册的id直接丢弃
+        if (instance == NULL || instance->can_module_callback == NULL) // 回调函数为空则不处理
+            continue;
+        CANRxStatUpdate(&instance->stat, rx_stamp);
+
+        if (instance->rx_mode == CAN_RX_DEFERRED)
+        { // 延迟解析,只拷贝报文和时间戳到环形缓冲区,由解析任务调用回调
+            depth = can_rx_ring.tail - can_rx_ring.head;
+            if (depth >= CAN_RX_RING_LEN)
             {
-                if (can_instance[i]->can_module_callback != NULL) // 回调函数不为空就调用
-                {
-                    can_instance[i]->rx_len = rxconf.DLC;                      // 保存接收到的数据长度
-                    memcpy(can_instance[i]->rx_buff, can_rx_buff, rxconf.DLC); // 消息拷贝到对应实例
-                    can_instance[i]->can_module_callback(can_instance[i]);     // 触发回调进行数据解析和处理
-                }
-                return;
+                can_rx_stat.ring_overflow_cnt++; // 解析任务来不及处理,丢弃本帧
+                continue;
             }
+            item = &can_rx_ring.item[can_rx_ring.tail & (CAN_RX_RING_LEN - 1)];
+            item->instance = instance;
+            item->stamp = rx_stamp;
+            item->hw_stamp = (uint16_t)rxconf.Timestamp;
+            item->len = rxconf.DLC;
+            memcpy(item->data, can_rx_buff, rxconf.DLC);
+            __DMB();             // 数据写入完成后再发布
+            can_rx_ring.tail++;
+            if (depth + 1 > can_rx_stat.ring_max_depth)
+                can_rx_stat.ring_max_depth = depth + 1;
+            wake = 1;
         }
+        else
+        {
+            instance->rx_len = rxconf.DLC;                      // 保存接收到的数据长度
+            instance->rx_stamp = rx_stamp;                      // 保存到达时间戳
+            instance->rx_hw_stamp = (uint16_t)rxconf.Timestamp; // TTCM关闭时无意义
+            memcpy(instance->rx_buff, can_rx_buff, rxconf.DLC); // 消息拷贝到对应实例
+            instance->can_module_callback(instance);            // 触发回调进行数据解析和处理
+        }
+
+        // 统计本帧在中断中的耗时(取出报文+查表+拷贝或解析)
+        cycles = DWT->CYCCNT - frame_start;
+        isr_stat = &can_rx_stat.isr[instance->rx_mode];
+        isr_stat->frame_cnt++;
+        isr_stat->cycles_sum += cycles;
+        if (cycles > isr_stat->cycles_max)
+            isr_stat->cycles_max = cycles;
     }
+    if (wake) // 一次中断只唤醒一次,解析任务会取出缓冲区中的所有报文
+        WakeCallbackTask(can_rx_sig);
 }
 
 /**
@@ -196,4 +729,48 @@ void HAL_CAN_RxFifo1MsgPendingCallback(CAN_HandleTypeDef *hcan)
     CANFIFOxCallback(hcan, CAN_RX_FIFO1); // 调用我们自己写的函数来处理消息
 }
 
+/**
+ * @brief 发送完成回调,某个邮箱的报文发送完毕后将队列中的报文填入空出的邮箱
+ *        三个邮箱的回调函数都是HAL的弱定义,这里统一重写
+ *
+ * @param hcan 发送完成的总线
+ */
+void HAL_CAN_TxMailbox0CompleteCallback(CAN_HandleTypeDef *hcan)
+{
+    CANTxQueueFlush(hcan, &can_tx_queue[CANBusIndex(hcan)]);
+}
+
+void HAL_CAN_TxMailbox1CompleteCallback(CAN_HandleTypeDef *hcan)
+{
+    CANTxQueueFlush(hcan, &can_tx_queue[CANBusIndex(hcan)]);
+}
+
+void HAL_CAN_TxMailbox2CompleteCallback(CAN_HandleTypeDef *hcan)
+{
+    CANTxQueueFlush(hcan, &can_tx_queue[CANBusIndex(hcan)]);
+}
+
+/**
+ * @brief 错误回调,HAL的弱定义,这里统计FIFO溢出(FOVR)和发送失败
+ *        FIFO未锁定(ReceiveFifoLocked=DISABLE),溢出时FIFO中最后一帧会被新报文覆盖.若溢出次数不断增加,应调整实例声明的接收频率
+ *        或将解析较慢的实例改为延迟解析
+ *
+ * @param hcan 发生错误的总线
+ */
+void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan)
+{
+    CAN_Rx_Fifo_Stat_s *stat = &can_fifo_stat[CANBusIndex(hcan)];
+    if (hcan->ErrorCode & HAL_CAN_ERROR_RX_FOV0)
+        stat->overrun_cnt[0]++;
+    if (hcan->ErrorCode & HAL_CAN_ERROR_RX_FOV1)
+        stat->overrun_cnt[1]++;
+    if (hcan->ErrorCode & (HAL_CAN_ERROR_TX_ALST0 | HAL_CAN_ERROR_TX_TERR0 | HAL_CAN_ERROR_TX_ALST1 |
+                           HAL_CAN_ERROR_TX_TERR1 | HAL_CAN_ERROR_TX_ALST2 | HAL_CAN_ERROR_TX_TERR2))
+    {
+        can_bus_stat[CANBusIndex(hcan)].stat.tx_error_cnt++;
+        CANTxQueueFlush(hcan, &can_tx_queue[CANBusIndex(hcan)]); // 发送失败的邮箱已经空出,但不会触发发送完成回调
+    }
+    hcan->ErrorCode = HAL_CAN_ERROR_NONE; // ErrorCode是累加的,清除已经统计过的标志
+}
+
 // 人工智能会毁灭人类吗？请在补全回答
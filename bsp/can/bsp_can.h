@@ -6,28 +6,181 @@
 
 // 最多能够支持的CAN设备数
 #define CAN_MX_REGISTER_CNT 16     // 这个数量取决于CAN总线的负载
-#define MX_CAN_FILTER_CNT (2 * 14) // 最多可以使用的CAN过滤器数量,目前远不会用到这么多
+#define MX_CAN_FILTER_CNT (2 * 14) // 最多可以使用的CAN过滤器数量,每个过滤器可以容纳4个16位id
 #define DEVICE_CAN_CNT 2           // 根据板子设定,F407IG有CAN1,CAN2,因此为2;F334只有一个,则设为1
+#define CAN_RX_TABLE_SIZE 32       // 每条总线接收查找表的长度,必须为2的幂且不小于2*CAN_MX_REGISTER_CNT
+#define CAN_TX_QUEUE_LEN 16        // 每条总线每个优先级的软件发送队列长度,邮箱满时报文在此排队,由发送完成中断取出
+#define CAN_TX_PRIO_CNT 3          // 发送优先级的数量,见CAN_Tx_Priority_e
+#define CAN_TX_RESERVED_MAILBOX 1  // 为HIGH优先级预留的邮箱数,其他优先级的报文最多占用(3-此值)个邮箱
+#define CAN_RX_RING_LEN 32         // 延迟解析模式下中断与解析任务之间的环形缓冲区长度,必须为2的幂
+#define CAN_DEFAULT_RX_RATE_HZ 1000 // 注册时未声明接收频率的实例按此频率计入FIFO负载,DJI电机的反馈频率即为1kHz
+#define CAN_STAT_WINDOW_MS 1000    // 总线帧率和利用率的统计周期
+#define CAN_TX_GROUP_CNT 8         // 最多支持的聚合发送帧数量,DJI电机最多使用6个(2can*3id),LK电机使用1个
+#define CAN_TX_WAIT_HIST_BINS 6    // 发送排队时间直方图的区间数:直接进入邮箱,<100us,<250us,<500us,<1ms,>=1ms
 // 如果只有1个CAN,还需要把bsp_can.c中所有的hcan2变量改为hcan1(别担心,主要是总线和FIFO的负载均衡,不影响功能)
 
+/* 发送优先级,邮箱不足时高优先级的报文总是先于低优先级的报文填入邮箱 */
+typedef enum
+{
+    CAN_TX_PRIO_DEFAULT = 0, // 未设置时等同于CAN_TX_PRIO_NORMAL
+    CAN_TX_PRIO_HIGH,        // 控制指令,如电机的电流/力矩指令,可以使用预留的邮箱
+    CAN_TX_PRIO_NORMAL,      // 一般数据,如板间通信
+    CAN_TX_PRIO_LOW,         // 状态/低频报文,如超级电容
+} CAN_Tx_Priority_e;
+
+/* 接收报文的解析方式 */
+typedef enum
+{
+    CAN_RX_IMMEDIATE = 0, // 默认,在接收中断中直接调用模块的回调函数
+    CAN_RX_DEFERRED,      // 中断只拷贝报文和时间戳,由高优先级的解析任务批量调用回调函数,缩短中断耗时
+} CAN_Rx_Mode_e;
+
+/* 每个CAN实例的收发统计,接收间隔和抖动使用报文到达时间戳计算,单位为us */
+typedef struct
+{
+    uint32_t tx_cnt;           // 通过该实例成功发送(填入邮箱或队列)的报文数
+    uint32_t rx_cnt;           // 收到的报文数
+    uint32_t rx_period_us;     // 接收间隔的滑动平均值
+    uint32_t rx_jitter_us;     // 接收间隔与平均值之差的绝对值的滑动平均
+    uint32_t rx_jitter_max_us; // 接收间隔与平均值之差的最大值,离线重连后会变大,需要时可以手动清零
+    uint32_t rx_last_stamp;    // 上一帧的到达时间戳,用于计算间隔
+} CAN_Instance_Stat_s;
+
 /* can instance typedef, every module registered to CAN should have this variable */
+/* 发送缓存由使用者(module)持有,发送时传入数据指针即可,实例本身不再保存发送数据 */
 #pragma pack(1)
 typedef struct _
 {
     CAN_HandleTypeDef *can_handle; // can句柄
-    CAN_TxHeaderTypeDef txconf;    // CAN报文发送配置
     uint32_t tx_id;                // 发送id
-    uint32_t tx_mailbox;           // CAN消息填入的邮箱号
-    uint8_t tx_buff[8];            // 发送缓存,发送消息长度可以通过CANSetDLC()设定,最大为8
-    uint8_t rx_buff[8];            // 接收缓存,最大消息长度为8
     uint32_t rx_id;                // 接收id
+    uint8_t tx_dlc;                // 发送长度,可以通过CANSetDLC()设定,默认为8
     uint8_t rx_len;                // 接收长度,可能为0-8
+    uint8_t rx_buff[8];            // 接收缓存,最大消息长度为8
+    uint32_t rx_stamp;             // 报文到达时的DWT->CYCCNT,在FIFO接收中断入口处记录,配合DWT_GetStampDeltaT()计算反馈间隔
+    uint16_t rx_hw_stamp;          // bxCAN硬件接收时间戳(16位,以位时间计),仅在开启TTCM(时间触发模式)时有效
+    uint8_t rx_mode;               // 接收解析方式,见CAN_Rx_Mode_e
+    uint8_t tx_priority;           // 发送优先级,见CAN_Tx_Priority_e
+    uint16_t tx_deadline_us;       // 发送截止时间,报文排队超过此时间仍未填入邮箱则丢弃,0表示不限
+    CAN_Instance_Stat_s stat;      // 收发统计,可以在debug时添加到watch中查看
     // 接收的回调函数,用于解析接收到的数据
     void (*can_module_callback)(struct _ *); // callback needs an instance to tell among registered ones
     void *id;                                // 使用can外设的模块指针(即id指向的模块拥有此can实例,是父子关系)
 } CANInstance;
 #pragma pack()
 
+/**
+ * @brief CAN发送帧描述符,数据由调用者持有
+ *        bsp_can只在邮箱已满需要排队时才会拷贝数据,否则HAL直接从data指向的地址填入邮箱
+ *        适用于不需要接收,或多个设备共用一帧的报文,如DJI电机的分组控制报文
+ */
+typedef struct
+{
+    uint32_t std_id;      // 标准id
+    uint8_t dlc;          // 数据长度,最大为8
+    uint8_t priority;     // 发送优先级,见CAN_Tx_Priority_e
+    uint16_t deadline_us; // 发送截止时间,排队超过此时间则丢弃,0表示不限
+    uint8_t *data;        // 调用者持有的数据
+} CAN_Tx_Frame_s;
+
+/**
+ * @brief 聚合发送帧,多个设备共用一帧报文发送控制指令,每个设备占用其中的一段(槽位)
+ *        如DJI电机的0x1FF/0x200/0x2FF和LK电机的0x280多电机指令
+ */
+typedef struct
+{
+    CAN_HandleTypeDef *can_handle; // 聚合帧所在的总线
+    CAN_Tx_Frame_s frame;          // 帧描述符,data指向buff
+    uint8_t buff[8];               // 所有槽位共用的发送缓存
+    uint8_t slot_mask;             // 已被槽位占用的字节,每一位对应一个字节,用于检查槽位冲突
+    uint8_t dirty;                 // 自上次发送以来是否有槽位被写入
+} CANTxGroupInstance;
+
+/* 聚合发送帧中的一个槽位,由设备(module)持有 */
+typedef struct
+{
+    CANTxGroupInstance *group; // 所在的聚合帧
+    uint8_t offset;            // 在帧中的字节偏移
+    uint8_t len;               // 占用的字节数
+} CANTxSlotInstance;
+
+/* 槽位初始化结构体,将此结构体指针传入注册函数 */
+typedef struct
+{
+    CAN_HandleTypeDef *can_handle; // 聚合帧所在的总线
+    uint32_t group_id;             // 聚合帧的标准id,总线和id相同的槽位属于同一帧
+    uint8_t slot_offset;           // 本设备的数据在帧中的字节偏移
+    uint8_t slot_len;              // 本设备的数据长度,offset+len不能超过8
+    CAN_Tx_Priority_e priority;    // 聚合帧的发送优先级,以该帧第一个注册的槽位为准
+    uint16_t deadline_us;          // 聚合帧的发送截止时间,以该帧第一个注册的槽位为准
+} CAN_Tx_Slot_Config_s;
+
+/* 软件发送队列的统计信息,可以在debug时添加到watch中查看 */
+typedef struct
+{
+    uint16_t depth;                               // 当前各优先级队列中等待发送的报文总数
+    uint16_t max_depth;                           // 历史最大队列深度,用于评估总线负载和CAN_TX_QUEUE_LEN是否足够
+    uint32_t enqueue_cnt;                         // 因邮箱已满而进入队列的报文数
+    uint32_t overflow_cnt;                        // 队列已满导致丢弃的报文数
+    uint32_t deadline_miss_cnt[CAN_TX_PRIO_CNT];  // 按优先级(HIGH/NORMAL/LOW)统计,排队超过截止时间而被丢弃的报文数
+} CAN_Tx_Queue_Stat_s;
+
+/* 接收中断中每帧报文的处理耗时统计,单位为CPU周期,用于比较两种解析方式对中断延迟的影响 */
+typedef struct
+{
+    uint32_t frame_cnt;  // 处理的报文数
+    uint32_t cycles_max; // 单帧最大耗时
+    uint64_t cycles_sum; // 总耗时,除以frame_cnt即为平均耗时
+} CAN_Rx_Isr_Stat_s;
+
+/* 接收统计信息,可以在debug时添加到watch中查看 */
+typedef struct
+{
+    CAN_Rx_Isr_Stat_s isr[2];    // 以CAN_Rx_Mode_e为下标,分别统计立即解析和延迟解析的中断耗时
+    uint16_t ring_max_depth;     // 延迟解析环形缓冲区的历史最大深度
+    uint32_t ring_overflow_cnt;  // 环形缓冲区已满而丢弃的报文数
+} CAN_Rx_Stat_s;
+
+/* 每条总线两个接收FIFO的负载统计,可以在debug时添加到watch中查看,用于验证负载均衡的效果 */
+typedef struct
+{
+    uint32_t load_hz[2];     // 分配到FIFO0/FIFO1的实例声明的接收频率之和
+    uint32_t frame_cnt[2];   // FIFO0/FIFO1实际收到的报文数
+    uint32_t overrun_cnt[2]; // FIFO0/FIFO1溢出(FOVR)次数,不为零说明中断来不及取出报文,有报文被丢弃
+    uint8_t id_cnt[2];       // 分配到FIFO0/FIFO1的id数量
+    uint8_t bank_cnt;        // 已使用的过滤器数量
+} CAN_Rx_Fifo_Stat_s;
+
+/* 总线错误状态,对应ESR寄存器的EWGF/EPVF/BOFF */
+typedef enum
+{
+    CAN_ERROR_ACTIVE = 0,
+    CAN_ERROR_WARNING, // TEC或REC>=96
+    CAN_ERROR_PASSIVE, // TEC或REC>127
+    CAN_BUS_OFF,       // TEC>255,不会自动恢复(AutoBusOff=DISABLE)
+} CAN_Error_State_e;
+
+/**
+ * @brief 总线统计信息,可以通过RTT/Ozone查看,也可以通过message_center发布(见robot_task.h的"can_stat"话题)
+ *        帧率和利用率由CANStatUpdate()每CAN_STAT_WINDOW_MS计算一次,其余计数实时更新
+ */
+typedef struct
+{
+    uint32_t tx_frame_cnt;                         // 累计填入邮箱的报文数
+    uint32_t rx_frame_cnt;                         // 累计收到(通过过滤器)的报文数
+    uint16_t tx_fps;                               // 上一个统计周期的每秒发送帧数
+    uint16_t rx_fps;                               // 上一个统计周期的每秒接收帧数
+    float bus_load;                                // 估计的总线利用率(0-1),按最坏位填充计算,只包含本节点收发的报文
+    uint32_t mailbox_full_cnt;                     // 发送时三个邮箱都被占用的次数
+    uint32_t tx_wait_hist[CAN_TX_WAIT_HIST_BINS];  // 报文从调用发送到填入邮箱的等待时间直方图,区间见CAN_TX_WAIT_HIST_BINS
+    uint32_t tx_error_cnt;                         // 发送失败(仲裁丢失/传输错误)次数
+    uint16_t bus_off_cnt;                          // 进入bus-off的次数
+    uint8_t tec;                                   // 发送错误计数器
+    uint8_t rec;                                   // 接收错误计数器
+    uint8_t error_state;                           // 错误状态,见CAN_Error_State_e
+    uint8_t last_error_code;                       // ESR.LEC,最近一次错误的类型(1填充/2格式/3应答/4隐性位/5显性位/6CRC)
+} CAN_Bus_Stat_s;
+
 /* CAN实例初始化结构体,将此结构体指针传入注册函数 */
 typedef struct
 {
@@ -36,6 +189,10 @@ typedef struct
     uint32_t rx_id;                             // 接收id
     void (*can_module_callback)(CANInstance *); // 处理接收数据的回调函数
     void *id;                                   // 拥有can实例的模块地址,用于区分不同的模块(如果有需要的话),如果不需要可以不传入
+    CAN_Rx_Mode_e rx_mode;                      // 接收解析方式,不设置则默认为CAN_RX_IMMEDIATE
+    uint16_t rx_rate_hz;                        // 预期的接收频率,用于在两个FIFO之间均衡负载,不设置则为CAN_DEFAULT_RX_RATE_HZ
+    CAN_Tx_Priority_e tx_priority;              // 发送优先级,不设置则为CAN_TX_PRIO_NORMAL
+    uint16_t tx_deadline_us;                    // 发送截止时间,排队超过此时间的报文会被丢弃而不是迟到发送,不设置则不限
 } CAN_Init_Config_s;
 
 /**
@@ -56,13 +213,97 @@ void CANSetDLC(CANInstance *_instance, uint8_t length);
 
 /**
  * @brief transmit mesg through CAN device,通过can实例发送消息
- *        发送前需要向CAN实例的tx_buff写入发送数据
- * 
- * @attention 超时时间不应该超过调用此函数的任务的周期,否则会导致任务阻塞
- * 
- * @param timeout 超时时间,单位为ms;后续改为us,获得更精确的控制
+ *        使用实例的tx_id和tx_dlc,数据直接从tx_data处读取
+ *
+ * @note 此函数不会阻塞:有空闲邮箱且队列为空时直接填入邮箱,否则拷贝到所在总线对应优先级的软件发送队列,
+ *       由发送完成中断按优先级从高到低依次填入空出的邮箱.因此调用此函数的任务耗时是恒定的
+ *       排队超过实例tx_deadline_us的报文会被丢弃并计入deadline_miss_cnt
+ *       函数返回后tx_data即可被修改或释放
+ *
  * @param _instance* can instance owned by module
+ * @param tx_data 要发送的数据,长度为实例的tx_dlc
+ * @return uint8_t 成功填入邮箱或队列返回1,队列已满丢弃返回0
+ */
+uint8_t CANTransmit(CANInstance *_instance, uint8_t *tx_data);
+
+/**
+ * @brief 通过帧描述符发送一帧报文,不需要注册CAN实例
+ *        其他行为和CANTransmit()相同
+ *
+ * @param hcan  要发送报文的总线
+ * @param frame 帧描述符,data指向的数据在函数返回后即可修改
+ * @return uint8_t 成功填入邮箱或队列返回1,队列已满丢弃返回0
+ */
+uint8_t CANTransmitFrame(CAN_HandleTypeDef *hcan, CAN_Tx_Frame_s const *frame);
+
+/**
+ * @brief 在聚合发送帧中注册一个槽位,总线和group_id相同的槽位会被放入同一帧
+ *        第一个槽位注册时创建该聚合帧;槽位之间有重叠会报错
+ *
+ * @param config 槽位初始化配置
+ * @return CANTxSlotInstance* 槽位实例,由设备持有
+ */
+CANTxSlotInstance *CANTxSlotRegister(CAN_Tx_Slot_Config_s *config);
+
+/**
+ * @brief 写入槽位的数据,并标记所在的聚合帧需要发送;数据会被拷贝,实际发送在CANTxGroupFlush()中进行
+ *
+ * @param slot 槽位实例
+ * @param data 长度为槽位len的数据
+ */
+void CANTxSlotWrite(CANTxSlotInstance *slot, uint8_t const *data);
+
+/**
+ * @brief 将自上次调用以来被写入过的聚合帧各发送一次,没有被写入的帧不会发送
+ *        应在每个控制周期所有设备写入槽位之后调用一次,目前在MotorControlTask()的末尾调用
+ */
+void CANTxGroupFlush(void);
+
+/**
+ * @brief 立即发送槽位所在的聚合帧(若自上次发送以来被写入过),同一帧中的其他槽位一并发出
+ *        用于由反馈驱动、需要尽快发出控制量的场合,发送后该帧不会在CANTxGroupFlush()中重复发送
+ *
+ * @param slot 聚合帧中的任一槽位
+ */
+void CANTxSlotFlush(CANTxSlotInstance *slot);
+
+/**
+ * @brief 获取总线软件发送队列的统计信息
+ *
+ * @param hcan 总线句柄
+ * @return CAN_Tx_Queue_Stat_s const* 统计信息指针,只读
+ */
+CAN_Tx_Queue_Stat_s const *CANGetTxQueueStat(CAN_HandleTypeDef *hcan);
+
+/**
+ * @brief 获取接收统计信息,包括两种解析方式下的中断耗时和延迟解析缓冲区的使用情况
+ *
+ * @return CAN_Rx_Stat_s const* 统计信息指针,只读
+ */
+CAN_Rx_Stat_s const *CANGetRxStat(void);
+
+/**
+ * @brief 获取总线两个接收FIFO的负载和溢出统计
+ *
+ * @param hcan 总线句柄
+ * @return CAN_Rx_Fifo_Stat_s const* 统计信息指针,只读
+ */
+CAN_Rx_Fifo_Stat_s const *CANGetRxFifoStat(CAN_HandleTypeDef *hcan);
+
+/**
+ * @brief 获取总线的收发、利用率和错误统计
+ *
+ * @param hcan 总线句柄
+ * @return CAN_Bus_Stat_s const* 统计信息指针,只读
+ */
+CAN_Bus_Stat_s const *CANGetBusStat(CAN_HandleTypeDef *hcan);
+
+/**
+ * @brief 更新总线统计,读取错误计数器和错误状态,每CAN_STAT_WINDOW_MS计算一次帧率和总线利用率
+ *        需要在任务中周期调用,调用间隔应远小于CAN_STAT_WINDOW_MS(目前在daemon任务中以100Hz调用)
+ *
+ * @return uint8_t 本次调用完成了一个统计周期返回1,否则返回0,可以据此决定是否发布统计信息
  */
-uint8_t CANTransmit(CANInstance *_instance,float timeout);
+uint8_t CANStatUpdate(void);
 
 #endif
@@ -81,6 +81,33 @@ double DWT_GetDeltaT64(uint32_t *cnt_last)
     return dt;
 }
 
+float DWT_GetStampDeltaT(uint32_t cnt_stamp, uint32_t *cnt_last)
+{
+    float dt = ((uint32_t)(cnt_stamp - *cnt_last)) / ((float)(CPU_FREQ_Hz));
+    *cnt_last = cnt_stamp;
+    return dt;
+}
+
+void DWT_CycleLatch(DWT_Cycle_t *cycle)
+{
+    volatile uint32_t cnt_now = DWT->CYCCNT;
+    cycle->dt = ((uint32_t)(cnt_now - cycle->stamp)) / ((float)(CPU_FREQ_Hz));
+    cycle->stamp = cnt_now;
+
+    DWT_CNT_Update(); // 每个周期更新一次时间轴
+}
+
+float DWT_CycleDeltaT(DWT_Cycle_t const *cycle, uint32_t *cnt_last)
+{
+    return DWT_GetStampDeltaT(cycle->stamp, cnt_last);
+}
+
+float DWT_GetStampAge(uint32_t cnt_stamp)
+{
+    volatile uint32_t cnt_now = DWT->CYCCNT;
+    return ((uint32_t)(cnt_now - cnt_stamp)) / ((float)(CPU_FREQ_Hz));
+}
+
 void DWT_SysTimeUpdate(void)
 {
     volatile uint32_t cnt_now = DWT->CYCCNT;
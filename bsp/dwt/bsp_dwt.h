@@ -25,6 +25,13 @@ typedef struct
     uint16_t us;
 } DWT_Time_t;
 
+/* 控制周期时钟,任务在每个周期开始时锁存一次DWT->CYCCNT,本周期内的所有计算都使用这个时间戳 */
+typedef struct
+{
+    uint32_t stamp; // 本周期开始时的DWT->CYCCNT
+    float dt;       // 和上一个周期之间的时间间隔,单位为秒/s
+} DWT_Cycle_t;
+
 /**
  * @brief 该宏用于计算代码段执行时间,单位为秒/s,返回值为float类型
  *        首先需要创建一个float类型的变量,用于存储时间间隔
@@ -62,6 +69,45 @@ float DWT_GetDeltaT(uint32_t *cnt_last);
  */
 double DWT_GetDeltaT64(uint32_t *cnt_last);
 
+/**
+ * @brief 获取给定时间戳与上一次时间戳之间的时间间隔,单位为秒/s
+ *        与DWT_GetDeltaT()不同,"现在"由调用者传入(一般是中断中记录的CYCCNT),
+ *        因此计算结果不受调用时刻的影响,适用于在事件发生时打时间戳,稍后再处理的场合(如CAN报文接收)
+ *        只做减法和除法,不读取CYCCNT也不更新时间轴,可以在中断中频繁调用
+ *
+ * @param cnt_stamp 本次事件的时间戳,即当时的DWT->CYCCNT
+ * @param cnt_last 上一次事件的时间戳,调用后会被更新为cnt_stamp
+ * @return float 时间间隔,单位为秒/s
+ */
+float DWT_GetStampDeltaT(uint32_t cnt_stamp, uint32_t *cnt_last);
+
+/**
+ * @brief 在控制周期开始时锁存时间戳,并计算和上一个周期之间的时间间隔
+ *        每个周期只读取一次CYCCNT,周期内的计算通过DWT_CycleDeltaT()获取各自的dt,
+ *        同一周期内的dt不再受计算先后顺序的影响,记录时间戳后可以离线复现PID的输出
+ *
+ * @param cycle 任务的周期时钟
+ */
+void DWT_CycleLatch(DWT_Cycle_t *cycle);
+
+/**
+ * @brief 本周期的时间戳与上一次计算时的时间戳之间的时间间隔,单位为秒/s,等价于DWT_GetStampDeltaT(cycle->stamp, cnt_last)
+ *        用于每隔若干个周期计算一次的对象(如设置了控制分频的电机)
+ *
+ * @param cycle 已经锁存的周期时钟
+ * @param cnt_last 上一次计算时的时间戳,调用后会被更新为cycle->stamp
+ * @return float 时间间隔,单位为秒/s
+ */
+float DWT_CycleDeltaT(DWT_Cycle_t const *cycle, uint32_t *cnt_last);
+
+/**
+ * @brief 获取时间戳距今的时间,单位为秒/s,可以用来判断一个采样值有多"旧"
+ *
+ * @param cnt_stamp 事件发生时的DWT->CYCCNT
+ * @return float 时间戳距今的时间,单位为秒/s
+ */
+float DWT_GetStampAge(uint32_t cnt_stamp);
+
 /**
  * @brief 获取当前时间,单位为秒/s,即初始化后的时间
  *
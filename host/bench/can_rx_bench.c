@@ -0,0 +1,196 @@
+/**
+ * @file can_rx_bench.c
+ * @brief 比较CAN接收中断中遍历所有实例(旧实现)和按总线查表(现实现)找到rx_id对应实例的耗时
+ *
+ * @note 两条总线共注册14个实例(和一台全向轮步兵的电机数相当),轮流注入每个rx_id的报文,
+ *       报文经过虚拟bxCAN的过滤器和FIFO后进入接收回调,统计每秒能处理的帧数.
+ *       此文件直接包含bsp_can.c以替换HAL的两个接收回调:
+ *       "linear"  旧实现的接收回调,遍历can_instance[]
+ *       "table"   和linear相同,只把遍历换成CANRxLookup()查表,两者的差异即查找方式的差异
+ *       "bsp_can" bsp_can.c中的CANFIFOxCallback(),在table的基础上增加了时间戳和统计.
+ *                 主机上每次读取DWT->CYCCNT都是一次clock_gettime(),这部分开销远大于开发板
+ *       主机上注入一帧(过滤器/FIFO/HAL)的开销和查找相当,因此另外单独统计两种查找方式每次查找的耗时.
+ *       所有帧都应被分发到对应实例的回调,否则返回1
+ *
+ *       用法: make -C host bench && host/build/can_rx_bench [每种实现注入的帧数]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "host_can.h"
+
+#define HAL_CAN_RxFifo0MsgPendingCallback BspCANRxFifo0Callback
+#define HAL_CAN_RxFifo1MsgPendingCallback BspCANRxFifo1Callback
+#include "bsp_can.c"
+#undef HAL_CAN_RxFifo0MsgPendingCallback
+#undef HAL_CAN_RxFifo1MsgPendingCallback
+
+#define BENCH_CAN1_NUM 8 // CAN1: 0x201~0x208,8个C620/C610
+#define BENCH_CAN2_NUM 6 // CAN2: 0x205~0x20a,6个GM6020
+#define BENCH_ID_NUM (BENCH_CAN1_NUM + BENCH_CAN2_NUM)
+
+typedef struct
+{
+    uint8_t bus;
+    uint16_t rx_id;
+} Bench_ID_s;
+
+typedef enum
+{
+    BENCH_LINEAR = 0,
+    BENCH_TABLE,
+    BENCH_BSP_CAN,
+    BENCH_MODE_NUM,
+} Bench_Mode_e;
+
+static Bench_ID_s bench_id[BENCH_ID_NUM];
+static const char *bench_mode_name[BENCH_MODE_NUM] = {"linear", "table", "bsp_can"};
+static Bench_Mode_e bench_mode;
+static uint64_t dispatch_cnt;
+
+/* 旧实现的接收回调,只把找到实例后的return改为break,每次中断仍然取完FIFO */
+static void LinearFIFOxCallback(CAN_HandleTypeDef *_hcan, uint32_t fifox)
+{
+    static CAN_RxHeaderTypeDef rxconf;
+    uint8_t can_rx_buff[8];
+    while (HAL_CAN_GetRxFifoFillLevel(_hcan, fifox))
+    {
+        HAL_CAN_GetRxMessage(_hcan, fifox, &rxconf, can_rx_buff);
+        for (size_t i = 0; i < idx; ++i)
+        {
+            if (_hcan == can_instance[i]->can_handle && rxconf.StdId == can_instance[i]->rx_id)
+            {
+                if (can_instance[i]->can_module_callback != NULL)
+                {
+                    can_instance[i]->rx_len = rxconf.DLC;
+                    memcpy(can_instance[i]->rx_buff, can_rx_buff, rxconf.DLC);
+                    can_instance[i]->can_module_callback(can_instance[i]);
+                }
+                break;
+            }
+        }
+    }
+}
+
+/* 旧实现的接收回调,只把遍历换成查表 */
+static void TableFIFOxCallback(CAN_HandleTypeDef *_hcan, uint32_t fifox)
+{
+    static CAN_RxHeaderTypeDef rxconf;
+    uint8_t can_rx_buff[8];
+    CANInstance *instance;
+    while (HAL_CAN_GetRxFifoFillLevel(_hcan, fifox))
+    {
+        HAL_CAN_GetRxMessage(_hcan, fifox, &rxconf, can_rx_buff);
+        instance = CANRxLookup(_hcan, rxconf.StdId);
+        if (instance != NULL && instance->can_module_callback != NULL)
+        {
+            instance->rx_len = rxconf.DLC;
+            memcpy(instance->rx_buff, can_rx_buff, rxconf.DLC);
+            instance->can_module_callback(instance);
+        }
+    }
+}
+
+void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan)
+{
+    if (bench_mode == BENCH_LINEAR)
+        LinearFIFOxCallback(hcan, CAN_RX_FIFO0);
+    else if (bench_mode == BENCH_TABLE)
+        TableFIFOxCallback(hcan, CAN_RX_FIFO0);
+    else
+        BspCANRxFifo0Callback(hcan);
+}
+
+void HAL_CAN_RxFifo1MsgPendingCallback(CAN_HandleTypeDef *hcan)
+{
+    if (bench_mode == BENCH_LINEAR)
+        LinearFIFOxCallback(hcan, CAN_RX_FIFO1);
+    else if (bench_mode == BENCH_TABLE)
+        TableFIFOxCallback(hcan, CAN_RX_FIFO1);
+    else
+        BspCANRxFifo1Callback(hcan);
+}
+
+// 模块回调,检查分发到的实例是否正确
+static void BenchRxCallback(CANInstance *instance)
+{
+    if (instance->rx_buff[0] == (uint8_t)instance->rx_id)
+        dispatch_cnt++;
+}
+
+// 旧实现的查找方式,和LinearFIFOxCallback()中的循环相同
+static CANInstance *LinearLookup(CAN_HandleTypeDef *_hcan, uint32_t rx_id)
+{
+    for (size_t i = 0; i < idx; ++i)
+        if (_hcan == can_instance[i]->can_handle && rx_id == can_instance[i]->rx_id)
+            return can_instance[i];
+    return NULL;
+}
+
+// 只统计查找的耗时,返回每次查找的纳秒数
+static double BenchLookup(CANInstance *(*lookup)(CAN_HandleTypeDef *, uint32_t), uint32_t frames)
+{
+    struct timespec start, end;
+    Bench_ID_s *id;
+    CANInstance *volatile found;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        id = &bench_id[i % BENCH_ID_NUM];
+        found = lookup(id->bus ? &hcan2 : &hcan1, id->rx_id);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    (void)found;
+    return ((double)(end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / frames;
+}
+
+static double BenchRun(Bench_Mode_e mode, uint32_t frames)
+{
+    struct timespec start, end;
+    uint8_t data[8] = {0};
+    Bench_ID_s *id;
+
+    bench_mode = mode;
+    dispatch_cnt = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        id = &bench_id[i % BENCH_ID_NUM];
+        data[0] = (uint8_t)id->rx_id;
+        HostCANInject(id->bus, id->rx_id, 8, data);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return frames / ((double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t frames = argc > 1 ? (uint32_t)atol(argv[1]) : 2000000;
+    CAN_Init_Config_s config = {.can_module_callback = BenchRxCallback};
+    double fps[BENCH_MODE_NUM];
+    uint8_t error = 0;
+
+    for (uint8_t i = 0; i < BENCH_ID_NUM; i++)
+    {
+        bench_id[i].bus = i < BENCH_CAN1_NUM ? 0 : 1;
+        bench_id[i].rx_id = i < BENCH_CAN1_NUM ? 0x201 + i : 0x205 + i - BENCH_CAN1_NUM;
+        config.can_handle = bench_id[i].bus ? &hcan2 : &hcan1;
+        config.tx_id = bench_id[i].rx_id < 0x205 ? 0x200 : 0x1ff;
+        config.rx_id = bench_id[i].rx_id;
+        CANRegister(&config);
+    }
+
+    printf("%d instances on 2 buses, %u frames each\n", BENCH_ID_NUM, frames);
+    printf("%-8s %12s %10s %10s\n", "callback", "frames/s", "ns/frame", "missed");
+    for (uint8_t mode = 0; mode < BENCH_MODE_NUM; mode++)
+    {
+        fps[mode] = BenchRun(mode, frames);
+        error |= dispatch_cnt != frames;
+        printf("%-8s %12.0f %10.1f %10llu\n", bench_mode_name[mode], fps[mode], 1e9 / fps[mode],
+               (unsigned long long)(frames - dispatch_cnt));
+    }
+    printf("table/linear: %.2fx\n", fps[BENCH_TABLE] / fps[BENCH_LINEAR]);
+    printf("lookup only: linear %.1fns, table %.1fns\n", BenchLookup(LinearLookup, frames), BenchLookup(CANRxLookup, frames));
+    return error;
+}
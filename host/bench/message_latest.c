@@ -0,0 +1,148 @@
+/**
+ * @file message_latest.c
+ * @brief message_center latest模式的压力测试:发布者在读取的过程中随时插入,
+ *        检查订阅者是否读到过不完整的消息(撕裂),并统计队列模式和latest模式下复制消息的字节数
+ *
+ * @note 开发板是单核的,撕裂只会发生在读取者被更高优先级的发布者抢占时.这里用高频的定时器信号模拟抢占:
+ *       信号处理函数作为发布者,每次连续发布1~3条消息(覆盖读取期间被发布一次和多次的情况),主循环作为订阅者不停地读取
+ *       消息的每个字都等于发布的序号,读到的消息中各个字不相等即为撕裂.
+ *       "naive"是不加保护地复制一块共享内存,作为对照,用于确认测试确实制造出了读写交错;
+ *       latest模式下撕裂数必须为0,否则返回1
+ *
+ *       用法: make -C host bench && host/build/message_latest [运行的秒数]
+ */
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include "message_center.h"
+
+#define MSG_WORDS 32           // 128字节
+#define LATEST_SUB_NUM 2       // latest模式通过SubGetMessage()读取的订阅者,另有一个通过SubReadBegin()直接读取
+#define QUEUE_SUB_NUM 3        // 队列模式的订阅者,和latest模式的订阅者总数相同
+#define PUBLISH_INTERVAL_US 20 // 定时器的周期,实际周期受主机的定时器精度限制
+
+typedef struct
+{
+    uint32_t word[MSG_WORDS];
+} Stress_Msg_s;
+
+/* 只用到gimbal的两个话题:gimbal_cmd为队列模式,gimbal_feed为latest模式 */
+typedef Stress_Msg_s Gimbal_Ctrl_Cmd_s;
+typedef Stress_Msg_s Gimbal_Upload_Data_s;
+typedef uint8_t Shoot_Ctrl_Cmd_s, Shoot_Upload_Data_s, Chassis_Ctrl_Cmd_s, Chassis_Upload_Data_s;
+MESSAGE_TOPIC_TABLE(MESSAGE_TOPIC_TYPEDEF)
+
+typedef struct
+{
+    const char *name;
+    uint64_t read, torn, retry;
+} Reader_Stat_s;
+
+static Publisher_t *queue_pub, *latest_pub;
+static Stress_Msg_s naive_buf;
+static volatile uint64_t pub_cnt;
+
+static void Publisher(int sig)
+{
+    static Stress_Msg_s msg;
+    (void)sig;
+    for (uint8_t n = 0; n < 1 + pub_cnt % 3; n++)
+    {
+        pub_cnt++;
+        for (uint8_t i = 0; i < MSG_WORDS; i++)
+            msg.word[i] = (uint32_t)pub_cnt;
+        PubPushTopic(queue_pub, TOPIC_GIMBAL_CMD, &msg);
+        PubPushTopic(latest_pub, TOPIC_GIMBAL_FEED, &msg);
+        memcpy(&naive_buf, &msg, sizeof(msg));
+    }
+}
+
+// 逐字比较,volatile使比较在读取的同时进行,扩大和发布者交错的窗口
+static uint8_t Torn(const volatile uint32_t *word)
+{
+    uint32_t first = word[0];
+    for (uint8_t i = 1; i < MSG_WORDS; i++)
+        if (word[i] != first)
+            return 1;
+    return 0;
+}
+
+static void Record(Reader_Stat_s *stat, uint8_t torn)
+{
+    stat->read++;
+    stat->torn += torn;
+}
+
+static void PrintStat(Reader_Stat_s *stat)
+{
+    printf("%-22s %10llu %8llu %8llu\n", stat->name, (unsigned long long)stat->read,
+           (unsigned long long)stat->torn, (unsigned long long)stat->retry);
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+    Subscriber_t *queue_sub[QUEUE_SUB_NUM], *latest_sub[LATEST_SUB_NUM], *peek_sub;
+    Reader_Stat_s naive = {"naive memcpy"}, queue = {"queue SubGetMessage"},
+                  latest = {"latest SubGetMessage"}, peek = {"latest SubReadBegin"};
+    struct itimerval timer = {{0, PUBLISH_INTERVAL_US}, {0, PUBLISH_INTERVAL_US}};
+    struct timespec start, now;
+    Stress_Msg_s msg;
+    const Stress_Msg_s *p;
+    uint32_t seq, last_peek = 0;
+    uint8_t torn;
+    uint64_t queue_bytes, latest_bytes;
+
+    queue_pub = PubRegisterTopic(TOPIC_GIMBAL_CMD);
+    latest_pub = PubRegisterTopic(TOPIC_GIMBAL_FEED);
+    for (uint8_t i = 0; i < QUEUE_SUB_NUM; i++)
+        queue_sub[i] = SubRegisterTopic(TOPIC_GIMBAL_CMD);
+    for (uint8_t i = 0; i < LATEST_SUB_NUM; i++)
+        latest_sub[i] = SubRegisterTopic(TOPIC_GIMBAL_FEED);
+    peek_sub = SubRegisterTopic(TOPIC_GIMBAL_FEED);
+
+    signal(SIGALRM, Publisher);
+    setitimer(ITIMER_REAL, &timer, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do
+    {
+        msg = *(volatile Stress_Msg_s *)&naive_buf;
+        Record(&naive, Torn(msg.word));
+        for (uint8_t i = 0; i < QUEUE_SUB_NUM; i++)
+            if (SubGetTopic(queue_sub[i], TOPIC_GIMBAL_CMD, &msg))
+                Record(&queue, Torn(msg.word));
+        for (uint8_t i = 0; i < LATEST_SUB_NUM; i++)
+            if (SubGetTopic(latest_sub[i], TOPIC_GIMBAL_FEED, &msg))
+                Record(&latest, Torn(msg.word));
+        do // 不复制,直接在发布者的缓冲区中检查,被覆盖则重读
+        {
+            p = SubReadBegin(peek_sub, &seq);
+            torn = Torn(p->word);
+        } while (SubReadRetry(peek_sub, seq) && ++peek.retry);
+        if (seq != last_peek)
+        {
+            last_peek = seq;
+            Record(&peek, torn);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while ((double)(now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) * 1e-9 < seconds);
+    timer.it_value.tv_usec = timer.it_interval.tv_usec = 0;
+    setitimer(ITIMER_REAL, &timer, NULL);
+
+    printf("%llu messages of %d bytes published in %.1fs\n", (unsigned long long)pub_cnt, (int)sizeof(Stress_Msg_s), seconds);
+    printf("%-22s %10s %8s %8s\n", "reader", "read", "torn", "retry");
+    PrintStat(&naive);
+    PrintStat(&queue);
+    PrintStat(&latest);
+    PrintStat(&peek);
+
+    // 队列模式发布时复制到每个订阅者的队列,读取时再复制一次;latest模式发布时只复制一次,SubReadBegin()读取时不复制
+    queue_bytes = (pub_cnt * QUEUE_SUB_NUM + queue.read) * sizeof(Stress_Msg_s);
+    latest_bytes = (pub_cnt + latest.read) * sizeof(Stress_Msg_s);
+    printf("copied bytes: queue %llu, latest %llu (%.1f%% saved)\n", (unsigned long long)queue_bytes,
+           (unsigned long long)latest_bytes, 100.0 * (1 - (double)latest_bytes / queue_bytes));
+    return latest.torn + peek.torn != 0;
+}
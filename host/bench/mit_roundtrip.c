@@ -0,0 +1,189 @@
+/**
+ * @file mit_roundtrip.c
+ * @brief motor_mit的往返测试:浮点和定点的映射,超出范围时的限幅,以及HT04/达妙两组映射范围下控制报文和反馈报文的打包解析
+ *
+ * @note 检查项:
+ *       1. 范围内的值映射到整数再映射回来,误差不超过一个量化步长(span/(2^bits-1))
+ *       2. 低于下限的值映射为0,高于上限的值映射为2^bits-1,不回绕
+ *       3. MITPackCommand()打包的报文按电机端的格式解析后和指令一致;按电机端格式打包的反馈报文经MITUnpackFeedback()解析后和原值一致,
+ *          误差均不超过一个量化步长.电机端的打包解析按motor_mit.h中的报文格式独立实现
+ *       4. 全零指令的报文和电机说明书中的一致
+ *       任何一项不通过时打印出错的项并返回1
+ *
+ *       用法: make -C host bench && host/build/mit_roundtrip
+ */
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "motor_mit.h"
+#include "HT04.h"
+#include "dmmotor.h"
+
+#define SWEEP_POINTS 100000
+#define FRAME_ROUND 100000
+
+typedef struct
+{
+    const char *name;
+    MIT_Range_s range;
+} Range_Case_s;
+
+static const Range_Case_s range_case[] = {
+    {"ht04", {P_MIN, P_MAX, V_MIN, V_MAX, KP_MIN, KP_MAX, KD_MIN, KD_MAX, T_MIN, T_MAX}},
+    {"dm", {DM_P_MIN, DM_P_MAX, DM_V_MIN, DM_V_MAX, DM_KP_MIN, DM_KP_MAX, DM_KD_MIN, DM_KD_MAX, DM_T_MIN, DM_T_MAX}},
+};
+
+static uint32_t fail_cnt;
+static uint32_t rand_state = 1;
+
+// 固定种子的LCG,每次运行的测试数据相同
+static float RandRange(float min, float max)
+{
+    rand_state = rand_state * 1664525u + 1013904223u;
+    return min + (max - min) * (float)(rand_state >> 8) / (float)(1u << 24);
+}
+
+static float Step(float min, float max, uint8_t bits)
+{
+    return (max - min) / (float)((1 << bits) - 1);
+}
+
+// 误差不超过一个步长,留出浮点运算本身的舍入误差
+static uint8_t WithinStep(float a, float b, float min, float max, uint8_t bits)
+{
+    return fabsf(a - b) <= Step(min, max, bits) * 1.001f;
+}
+
+static void Fail(const char *what, const char *name, float expect, float actual)
+{
+    fail_cnt++;
+    if (fail_cnt <= 20) // 只打印前20项,避免刷屏
+        printf("FAIL %-10s %-6s expect %.6f got %.6f\n", what, name, expect, actual);
+}
+
+static void CheckMapping(const char *name, float min, float max, uint8_t bits)
+{
+    uint16_t top = (uint16_t)((1 << bits) - 1), code;
+    float x, back;
+
+    for (uint32_t i = 0; i <= SWEEP_POINTS; i++)
+    {
+        x = min + (max - min) * (float)i / SWEEP_POINTS;
+        code = MITFloatToUint(x, min, max, bits);
+        back = MITUintToFloat(code, min, max, bits);
+        if (code > top || !WithinStep(x, back, min, max, bits))
+            Fail("roundtrip", name, x, back);
+    }
+
+    // 两端限幅,包括略微超出和远超出范围的值
+    const float below[] = {min - Step(min, max, bits) * 0.5f, min - (max - min), -1e6f};
+    const float above[] = {max + Step(min, max, bits) * 0.5f, max + (max - min), 1e6f};
+    for (uint8_t i = 0; i < sizeof(below) / sizeof(below[0]); i++)
+    {
+        if ((code = MITFloatToUint(below[i], min, max, bits)) != 0)
+            Fail("clamp_low", name, 0, code);
+        if ((code = MITFloatToUint(above[i], min, max, bits)) != top)
+            Fail("clamp_high", name, top, code);
+    }
+    if (MITUintToFloat(0, min, max, bits) != min)
+        Fail("min", name, min, MITUintToFloat(0, min, max, bits));
+    if (!WithinStep(MITUintToFloat(top, min, max, bits), max, min, max, bits))
+        Fail("max", name, max, MITUintToFloat(top, min, max, bits));
+}
+
+/* 电机端:解析控制报文,格式见motor_mit.h */
+static void MotorDecodeCommand(uint8_t const *buf, MIT_Range_s const *r, MIT_Command_s *cmd)
+{
+    cmd->position = MITUintToFloat((uint16_t)((buf[0] << 8) | buf[1]), r->p_min, r->p_max, 16);
+    cmd->velocity = MITUintToFloat((uint16_t)((buf[2] << 4) | (buf[3] >> 4)), r->v_min, r->v_max, 12);
+    cmd->kp = MITUintToFloat((uint16_t)(((buf[3] & 0x0f) << 8) | buf[4]), r->kp_min, r->kp_max, 12);
+    cmd->kd = MITUintToFloat((uint16_t)((buf[5] << 4) | (buf[6] >> 4)), r->kd_min, r->kd_max, 12);
+    cmd->torque = MITUintToFloat((uint16_t)(((buf[6] & 0x0f) << 8) | buf[7]), r->t_min, r->t_max, 12);
+}
+
+/* 电机端:打包反馈报文,第0字节为id,第6,7字节由各电机自定义 */
+static void MotorEncodeFeedback(uint8_t *buf, uint8_t id, MIT_Feedback_s const *fb, MIT_Range_s const *r)
+{
+    uint16_t p = MITFloatToUint(fb->position, r->p_min, r->p_max, 16);
+    uint16_t v = MITFloatToUint(fb->velocity, r->v_min, r->v_max, 12);
+    uint16_t t = MITFloatToUint(fb->torque, r->t_min, r->t_max, 12);
+    buf[0] = id;
+    buf[1] = (uint8_t)(p >> 8);
+    buf[2] = (uint8_t)(p & 0xff);
+    buf[3] = (uint8_t)(v >> 4);
+    buf[4] = (uint8_t)(((v & 0xf) << 4) | (t >> 8));
+    buf[5] = (uint8_t)(t & 0xff);
+    buf[6] = 0x5a;
+    buf[7] = 0xa5;
+}
+
+static void CheckFrames(const Range_Case_s *c)
+{
+    const MIT_Range_s *r = &c->range;
+    static const uint8_t zero_frame[8] = {0x7f, 0xff, 0x7f, 0xf0, 0x00, 0x00, 0x07, 0xff};
+    MIT_Command_s cmd, decoded, zero = {0};
+    MIT_Feedback_s fb, unpacked;
+    uint8_t buf[8];
+
+    for (uint32_t i = 0; i < FRAME_ROUND; i++)
+    {
+        cmd.position = RandRange(r->p_min, r->p_max);
+        cmd.velocity = RandRange(r->v_min, r->v_max);
+        cmd.kp = RandRange(r->kp_min, r->kp_max);
+        cmd.kd = RandRange(r->kd_min, r->kd_max);
+        cmd.torque = RandRange(r->t_min, r->t_max);
+        MITPackCommand(buf, &cmd, r);
+        MotorDecodeCommand(buf, r, &decoded);
+        if (!WithinStep(cmd.position, decoded.position, r->p_min, r->p_max, 16))
+            Fail("cmd_p", c->name, cmd.position, decoded.position);
+        if (!WithinStep(cmd.velocity, decoded.velocity, r->v_min, r->v_max, 12))
+            Fail("cmd_v", c->name, cmd.velocity, decoded.velocity);
+        if (!WithinStep(cmd.kp, decoded.kp, r->kp_min, r->kp_max, 12))
+            Fail("cmd_kp", c->name, cmd.kp, decoded.kp);
+        if (!WithinStep(cmd.kd, decoded.kd, r->kd_min, r->kd_max, 12))
+            Fail("cmd_kd", c->name, cmd.kd, decoded.kd);
+        if (!WithinStep(cmd.torque, decoded.torque, r->t_min, r->t_max, 12))
+            Fail("cmd_t", c->name, cmd.torque, decoded.torque);
+
+        fb.position = RandRange(r->p_min, r->p_max);
+        fb.velocity = RandRange(r->v_min, r->v_max);
+        fb.torque = RandRange(r->t_min, r->t_max);
+        MotorEncodeFeedback(buf, (uint8_t)i, &fb, r);
+        MITUnpackFeedback(buf, r, &unpacked);
+        if (!WithinStep(fb.position, unpacked.position, r->p_min, r->p_max, 16))
+            Fail("fb_p", c->name, fb.position, unpacked.position);
+        if (!WithinStep(fb.velocity, unpacked.velocity, r->v_min, r->v_max, 12))
+            Fail("fb_v", c->name, fb.velocity, unpacked.velocity);
+        if (!WithinStep(fb.torque, unpacked.torque, r->t_min, r->t_max, 12))
+            Fail("fb_t", c->name, fb.torque, unpacked.torque);
+    }
+
+    // 位置/速度/力矩范围对称,kp/kd从0开始,全零指令的报文是固定的
+    MITPackCommand(buf, &zero, r);
+    for (uint8_t i = 0; i < 8; i++)
+        if (buf[i] != zero_frame[i])
+            Fail("zero_frame", c->name, zero_frame[i], buf[i]);
+}
+
+int main(void)
+{
+    char name[32];
+    for (uint8_t i = 0; i < sizeof(range_case) / sizeof(range_case[0]); i++)
+    {
+        const Range_Case_s *c = &range_case[i];
+        const MIT_Range_s *r = &c->range;
+        snprintf(name, sizeof(name), "%s_p", c->name);
+        CheckMapping(name, r->p_min, r->p_max, 16);
+        snprintf(name, sizeof(name), "%s_v", c->name);
+        CheckMapping(name, r->v_min, r->v_max, 12);
+        snprintf(name, sizeof(name), "%s_kp", c->name);
+        CheckMapping(name, r->kp_min, r->kp_max, 12);
+        snprintf(name, sizeof(name), "%s_kd", c->name);
+        CheckMapping(name, r->kd_min, r->kd_max, 12);
+        snprintf(name, sizeof(name), "%s_t", c->name);
+        CheckMapping(name, r->t_min, r->t_max, 12);
+        CheckFrames(c);
+    }
+    printf("mit_roundtrip: %u failures\n", fail_cnt);
+    return fail_cnt != 0;
+}
@@ -0,0 +1,286 @@
+/**
+ * @file pid_bench.c
+ * @brief 比较PID特化计算函数和通用计算函数的耗时,并检查两者的输出是否一致;
+ *        以及12个速度环逐个计算和通过PIDBatchCalculate()批量计算的耗时,批量计算写回PIDInstance的状态和
+ *        运行时修改参数后通过PIDBatchSync()同步的结果是否和逐个计算一致.
+ *        controller.c以PID_BATCH_USE_DSP为1直接编译进此文件,不启用优化环节的批量控制器走arm_pid_f32()(主机上为等价的C实现),
+ *        dt固定时其输出和写回的Iout也应和PIDCalculateDt()一致.
+ *        motor_task.c以MOTOR_SPEED_PID_BATCH为1编译进此文件,检查电机级的串级控制:速度环批量计算的电机
+ *        (MotorControlTask()中延迟计算,或MotorCalculate()立即计算)和配置相同但逐个计算的电机输出一致
+ *
+ * @note 耗时通过DWT->CYCCNT测量,主机上CYCCNT是按168MHz换算的真实时间,只有相对比较的意义;
+ *       controller.c不依赖主机,此文件的BenchOne()也可以原样放到开发板上运行
+ *
+ *       用法: make -C host bench && host/build/pid_bench
+ */
+#include <stdio.h>
+
+#define PID_BATCH_USE_DSP 1
+#include "controller.c"
+#define MOTOR_SPEED_PID_BATCH 1
+#include "motor_task.c"
+#include "host_time.h"
+
+#define BENCH_ROUND 200000
+#define BENCH_DT 0.001f
+
+typedef struct
+{
+    const char *name;
+    PID_Init_Config_s config;
+} Bench_Case_s;
+
+static const Bench_Case_s bench_case[] = {
+    {"none", {.Kp = 10, .Ki = 0, .Kd = 0, .MaxOut = 16384, .Improve = PID_IMPROVE_NONE}},
+    {"integral_limit", {.Kp = 10, .Ki = 200, .Kd = 0, .MaxOut = 16384, .IntegralLimit = 3000, .Improve = PID_Integral_Limit}},
+    {"trapezoid|limit|dom", {.Kp = 10, .Ki = 200, .Kd = 0.05f, .MaxOut = 16384, .IntegralLimit = 3000, .Improve = PID_Trapezoid_Intergral | PID_Integral_Limit | PID_Derivative_On_Measurement}},
+    {"filters(generic only)", {.Kp = 10, .Ki = 200, .Kd = 0.05f, .MaxOut = 16384, .IntegralLimit = 3000, .Derivative_LPF_RC = 0.002f, .Output_LPF_RC = 0.001f, .Improve = PID_Integral_Limit | PID_DerivativeFilter | PID_OutputFilter}},
+};
+
+// 一阶惯性对象,使两个PID的输入随输出变化,覆盖积分限幅等分支
+static float Plant(float x, float u)
+{
+    return x + (u * 0.01f - x) * 0.05f;
+}
+
+static uint32_t BenchOne(PID_Init_Config_s *config, float (*calc)(PIDInstance *, float, float, float), float *checksum)
+{
+    PIDInstance pid;
+    float x = 0, u, ref, sum = 0;
+    uint32_t start;
+
+    PIDInit(&pid, config);
+    start = DWT->CYCCNT;
+    for (uint32_t i = 0; i < BENCH_ROUND; i++)
+    {
+        ref = (i / 1000) % 2 ? 100.0f : -100.0f; // 1s周期的方波
+        u = calc(&pid, x, ref, BENCH_DT);
+        x = Plant(x, u);
+        sum += u;
+    }
+    *checksum = sum;
+    return DWT->CYCCNT - start;
+}
+
+#define BENCH_LANE 12 // 12个DJI电机的速度环
+
+static PIDBatchInstance batch;
+
+// 返回批量计算的输出,写回的状态和逐个计算的最大差异
+static float BenchBatch(const char *name, PID_Init_Config_s *config)
+{
+    static PIDInstance pid[BENCH_LANE], batch_pid[BENCH_LANE]; // 后者由batch计算,状态写回其中
+    float x[BENCH_LANE] = {0}, ref, diff, max_diff = 0;
+    uint32_t start, t_single = 0, t_batch = 0;
+
+    memset(&batch, 0, sizeof(batch));
+    for (uint8_t j = 0; j < BENCH_LANE; j++)
+    {
+        PIDInit(&pid[j], config);
+        PIDInit(&batch_pid[j], config);
+        PIDBatchAdd(&batch, &batch_pid[j]);
+    }
+    for (uint32_t i = 0; i < BENCH_ROUND / BENCH_LANE; i++)
+    {
+        ref = (i / 1000) % 2 ? 100.0f : -100.0f;
+        if (i == BENCH_ROUND / BENCH_LANE / 2) // 运行中途修改增益,batch需要同步后才会使用新的参数
+        {
+            for (uint8_t j = 0; j < BENCH_LANE; j++)
+            {
+                pid[j].Kp = batch_pid[j].Kp = config->Kp * 2;
+                pid[j].Ki = batch_pid[j].Ki = config->Ki * 0.5f;
+                PIDBatchSync(&batch, j);
+            }
+        }
+        start = DWT->CYCCNT;
+        for (uint8_t j = 0; j < BENCH_LANE; j++)
+            PIDCalculateDt(&pid[j], x[j], ref, BENCH_DT);
+        t_single += DWT->CYCCNT - start;
+
+        start = DWT->CYCCNT;
+        for (uint8_t j = 0; j < BENCH_LANE; j++)
+            PIDBatchSet(&batch, j, x[j], ref, BENCH_DT);
+        PIDBatchCalculate(&batch);
+        t_batch += DWT->CYCCNT - start;
+
+        for (uint8_t j = 0; j < BENCH_LANE; j++)
+        {
+            diff = fabsf(pid[j].Output - batch.Output[j]);
+            diff = fmaxf(diff, fabsf(pid[j].Output - batch_pid[j].Output));
+            diff = fmaxf(diff, fabsf(pid[j].Iout - batch_pid[j].Iout));
+            diff = fmaxf(diff, fabsf(pid[j].Err - batch_pid[j].Err));
+            max_diff = diff > max_diff ? diff : max_diff;
+            x[j] = Plant(x[j], pid[j].Output * (1 + j * 0.1f));
+        }
+    }
+    printf("%d x %-20s %12.2f %12.2f %7.2fx  max diff %g\n", BENCH_LANE, name,
+           (double)t_batch / (BENCH_ROUND / BENCH_LANE), (double)t_single / (BENCH_ROUND / BENCH_LANE),
+           (double)t_single / t_batch, max_diff);
+    return max_diff;
+}
+
+#define MOTOR_PAIR_NUM 6
+#define MOTOR_TICK 20000
+
+typedef struct
+{
+    const char *name;
+    Motor_Init_Config_s config;
+    float ref; // 方波的幅值
+} Motor_Case_s;
+
+#define BENCH_SPEED_PID {.Kp = 10, .Ki = 200, .Kd = 0.05f, .MaxOut = 16384, .IntegralLimit = 3000, .Improve = PID_Trapezoid_Intergral | PID_Integral_Limit | PID_Derivative_On_Measurement}
+#define BENCH_ANGLE_PID {.Kp = 20, .Ki = 0, .Kd = 0, .MaxOut = 2000}
+#define BENCH_CURRENT_PID {.Kp = 0.5f, .Ki = 50, .Kd = 0, .MaxOut = 16384, .IntegralLimit = 5000, .Improve = PID_Integral_Limit}
+
+// 最后一组作为self_driven的电机由MotorCalculate()驱动;"filter"的速度环使用了批量计算不支持的优化环节,两个电机都逐个计算
+static Motor_Case_s motor_case[MOTOR_PAIR_NUM] = {
+    {"speed", {.controller_param_init_config = {.speed_PID = BENCH_SPEED_PID},
+               .controller_setting_init_config = {.outer_loop_type = SPEED_LOOP, .close_loop_type = SPEED_LOOP}},
+     100},
+    {"angle|speed /2", {.controller_param_init_config = {.angle_PID = BENCH_ANGLE_PID, .speed_PID = BENCH_SPEED_PID},
+                        .controller_setting_init_config = {.outer_loop_type = ANGLE_LOOP, .close_loop_type = ANGLE_AND_SPEED_LOOP},
+                        .control_divider = 2},
+     30},
+    {"all three", {.controller_param_init_config = {.angle_PID = BENCH_ANGLE_PID, .speed_PID = BENCH_SPEED_PID, .current_PID = BENCH_CURRENT_PID},
+                   .controller_setting_init_config = {.outer_loop_type = ANGLE_LOOP, .close_loop_type = ALL_THREE_LOOP}},
+     30},
+    {"speed|current rev /5", {.controller_param_init_config = {.speed_PID = BENCH_SPEED_PID, .current_PID = BENCH_CURRENT_PID},
+                              .controller_setting_init_config = {.outer_loop_type = SPEED_LOOP, .close_loop_type = SPEED_AND_CURRENT_LOOP, .motor_reverse_flag = MOTOR_DIRECTION_REVERSE, .feedback_reverse_flag = FEEDBACK_DIRECTION_REVERSE},
+                              .control_divider = 5},
+     100},
+    {"filter", {.controller_param_init_config = {.speed_PID = {.Kp = 10, .Ki = 200, .MaxOut = 16384, .Output_LPF_RC = 0.001f, .Improve = PID_OutputFilter}},
+                .controller_setting_init_config = {.outer_loop_type = SPEED_LOOP, .close_loop_type = SPEED_LOOP}},
+     100},
+    {"self driven", {.controller_param_init_config = {.speed_PID = BENCH_SPEED_PID},
+                     .controller_setting_init_config = {.outer_loop_type = SPEED_LOOP, .close_loop_type = SPEED_LOOP}},
+     100},
+};
+
+static void BenchMotorPack(MotorInstance *motor, float output)
+{
+    (void)motor;
+    (void)output;
+}
+
+static const Motor_Ops_s bench_motor_ops = {
+    .pack = BenchMotorPack,
+    .output_min = -16384,
+    .output_max = 16384,
+    .shared_frame = 1,
+};
+
+// 电机模型,输出为电流指令
+static void MotorPlant(MotorInstance *motor)
+{
+    float out = motor->output;
+    if (motor->motor_settings.feedback_reverse_flag == FEEDBACK_DIRECTION_REVERSE)
+        out = -out;
+    motor->feedback.current += (out - motor->feedback.current) * 0.5f;
+    motor->feedback.speed += (motor->feedback.current * 0.01f - motor->feedback.speed) * 0.05f;
+    motor->feedback.angle += motor->feedback.speed * BENCH_DT;
+}
+
+// 返回两组电机的输出和速度环状态的最大差异
+static float BenchMotor(void)
+{
+    static MotorInstance batched[MOTOR_PAIR_NUM], single[MOTOR_PAIR_NUM];
+    float diff, max_diff = 0, ref;
+    uint8_t lanes = 0;
+
+    HostTimeUseVirtual(); // 两组电机的dt完全相同,和主机负载无关
+    for (uint8_t j = 0; j < MOTOR_PAIR_NUM; j++)
+    {
+        MotorInstanceInit(&batched[j], &motor_case[j].config, &bench_motor_ops);
+        MotorRegister(&batched[j]);
+        MotorInstanceInit(&single[j], &motor_case[j].config, &bench_motor_ops);
+        MotorRegister(&single[j]);
+        single[j].speed_lane = -1; // 已加入speed_batch的编号不再提交,改为逐个计算
+        single[j].rate.tick = batched[j].rate.tick; // 两者在同一周期计算
+        single[j].calc_stamp = batched[j].calc_stamp;
+        lanes += batched[j].speed_lane >= 0;
+    }
+    batched[MOTOR_PAIR_NUM - 1].self_driven = single[MOTOR_PAIR_NUM - 1].self_driven = 1;
+
+    for (uint32_t i = 0; i < MOTOR_TICK; i++)
+    {
+        if (i == MOTOR_TICK / 2) // 运行中途修改速度环增益,批量计算的电机需要同步
+        {
+            for (uint8_t j = 0; j < MOTOR_PAIR_NUM; j++)
+            {
+                batched[j].motor_controller.speed_PID.Kp *= 1.5f;
+                single[j].motor_controller.speed_PID.Kp *= 1.5f;
+                MotorSpeedPIDSync(&batched[j]);
+                MotorSpeedPIDSync(&single[j]);
+            }
+        }
+        for (uint8_t j = 0; j < MOTOR_PAIR_NUM; j++)
+        {
+            ref = (i / 1000) % 2 ? motor_case[j].ref : -motor_case[j].ref;
+            batched[j].motor_controller.pid_ref = single[j].motor_controller.pid_ref = ref;
+        }
+        MotorControlTask();
+        MotorCalculate(&batched[MOTOR_PAIR_NUM - 1]); // 和DJIMotorSyncControl()一样在MotorControlTask()之外立即计算
+        MotorCalculate(&single[MOTOR_PAIR_NUM - 1]);
+        for (uint8_t j = 0; j < MOTOR_PAIR_NUM; j++)
+        {
+            PIDInstance *a = &batched[j].motor_controller.speed_PID, *b = &single[j].motor_controller.speed_PID;
+            diff = fabsf(batched[j].output - single[j].output);
+            diff = fmaxf(diff, fabsf(a->Output - b->Output));
+            diff = fmaxf(diff, fabsf(a->Iout - b->Iout));
+            diff = fmaxf(diff, fabsf(a->Err - b->Err));
+            max_diff = diff > max_diff ? diff : max_diff;
+            MotorPlant(&batched[j]);
+            MotorPlant(&single[j]);
+        }
+        HostTimeAdvance(1000000);
+    }
+    printf("%d motor pairs (%d batched speed loops), %d ticks: max diff %g\n", MOTOR_PAIR_NUM, lanes, MOTOR_TICK, max_diff);
+    return max_diff;
+}
+
+int main(void)
+{
+    PID_Init_Config_s config;
+    uint32_t t_special, t_generic;
+    float sum_special, sum_generic;
+    int mismatch = 0;
+
+    DWT_Init(168);
+    printf("%-24s %12s %12s %8s\n", "improve", "special/cyc", "generic/cyc", "speedup");
+    for (uint32_t i = 0; i < sizeof(bench_case) / sizeof(bench_case[0]); i++)
+    {
+        config = bench_case[i].config;
+        t_generic = BenchOne(&config, PIDCalculateGenericDt, &sum_generic);
+        t_special = BenchOne(&config, PIDCalculateDt, &sum_special);
+        printf("%-24s %12.2f %12.2f %7.2fx%s\n", bench_case[i].name,
+               (double)t_special / BENCH_ROUND, (double)t_generic / BENCH_ROUND,
+               (double)t_generic / t_special, sum_special == sum_generic ? "" : "  OUTPUT MISMATCH");
+        mismatch |= sum_special != sum_generic;
+    }
+
+    printf("\n%-24s %12s %12s %8s\n", "lanes", "batch/cyc", "single/cyc", "speedup");
+    config = bench_case[2].config; // 和上面的trapezoid|limit|dom相同的参数
+    // 批量计算的运算顺序不同,增量式还会累积舍入误差,只允许相对MaxOut很小的差异
+    if (BenchBatch("trapezoid|limit|dom", &config) > 1e-4f * config.MaxOut)
+    {
+        printf("BATCH MISMATCH\n");
+        mismatch = 1;
+    }
+    config = bench_case[0].config;
+    config.Ki = 200; // 和trapezoid|limit|dom相同的增益,不启用优化环节,使用arm_pid_f32()
+    config.Kd = 0.05f;
+    if (BenchBatch("none(arm_pid_f32)", &config) > 1e-4f * config.MaxOut)
+    {
+        printf("BATCH MISMATCH\n");
+        mismatch = 1;
+    }
+
+    printf("\nmotor cascade, batched speed loop vs per-motor\n");
+    if (BenchMotor() > 1e-4f * bench_motor_ops.output_max)
+    {
+        printf("MOTOR BATCH MISMATCH\n");
+        mismatch = 1;
+    }
+    return mismatch;
+}
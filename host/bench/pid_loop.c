@@ -0,0 +1,384 @@
+/**
+ * @file pid_loop.c
+ * @brief PID闭环仿真:controller.c + motor_plant的电机模型,批量运行阶跃/负载扰动场景,
+ *        输出上升时间,超调,调节时间,稳态误差,扰动下的最大偏差和恢复时间,以及每次PID计算的耗时
+ *        可以保存一次结果作为基准,之后修改controller.c时和基准比较,控制效果变差时返回非0
+ *
+ * @note 每个控制周期的流程和dji_motor/motor_task相同:
+ *       按DecodeDJIMotor()的方式解析反馈(速度/电流滤波,多圈角度) -> 位置环 -> 速度环 -> 电流环 -> 截断为int16
+ *       控制量在下一个控制周期生效(CAN发送和电调处理的延迟).指标以电机模型的真实状态计算,不含反馈滤波和量化
+ *
+ *       用法: make -C host bench
+ *             host/build/pid_loop [-v] [-n 重复次数] [--save 基准文件] [--check 基准文件]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "controller.h"
+#include "general_def.h"
+#include "dji_motor.h"
+#include "motor_plant.h"
+#include "host_time.h"
+
+#define LOOP_DT 0.001f       // 控制周期,和电机任务一致
+#define SETTLE_BAND 0.02f    // 调节时间和扰动恢复的误差带,相对阶跃幅值
+#define DIVERGE_RATIO 10.0f  // 响应超过阶跃幅值的这个倍数时认为发散
+#define SCENARIO_MAX 64
+#define STEP_MAX 4000        // 单个场景的最大控制周期数
+#define REPLAY_ROUND 5       // 测量耗时时重放的次数
+
+typedef struct
+{
+    const char *name;
+    Motor_Plant_Type_e plant;
+    float load_inertia; // 输出轴上的负载惯量,kg·m^2
+    uint8_t angle_loop; // 位置环为外环,否则速度环为外环
+    uint8_t current_loop;
+    PID_Init_Config_s angle_PID, speed_PID, current_PID;
+    float step;        // 阶跃幅值,转子的度(位置环)或度/秒(速度环),和电机反馈的单位相同
+    float disturbance; // 后半段施加在输出轴上的负载力矩,N·m
+    float duration;    // 仿真时长,s
+} Loop_Case_s;
+
+typedef struct
+{
+    char name[48];
+    float rise;      // 10%~90%上升时间,s
+    float overshoot; // 超调,%
+    float settle;    // 进入并保持在误差带内的时间,s
+    float sse;       // 前半段最后10%的平均绝对误差,和阶跃同单位
+    float dist_dev;  // 扰动后的最大偏差
+    float dist_rec;  // 扰动后回到误差带的时间,s
+    float cycles;    // 每次PID计算的平均耗时,DWT周期
+    uint8_t diverged;
+} Loop_Result_s;
+
+// 几个典型的闭环,参数来自application中的配置(为0的参数使用注释中的调试值)
+static const Loop_Case_s base_case[] = {
+    {"chassis_m3508_speed", PLANT_M3508, 0.03f, 0, 1,
+     .speed_PID = {.Kp = 10, .IntegralLimit = 3000, .MaxOut = 12000, .Improve = PID_Trapezoid_Intergral | PID_Integral_Limit | PID_Derivative_On_Measurement},
+     .current_PID = {.Kp = 0.5f, .IntegralLimit = 3000, .MaxOut = 15000, .Improve = PID_Trapezoid_Intergral | PID_Integral_Limit | PID_Derivative_On_Measurement},
+     .step = 20000, .disturbance = 1.0f, .duration = 1.0f},
+    {"friction_m3508_speed", PLANT_M3508, 1e-4f, 0, 1,
+     .speed_PID = {.Kp = 20, .Ki = 1, .IntegralLimit = 10000, .MaxOut = 15000, .Improve = PID_Integral_Limit},
+     .current_PID = {.Kp = 0.7f, .Ki = 0.1f, .IntegralLimit = 10000, .MaxOut = 15000, .Improve = PID_Integral_Limit},
+     .step = 40000, .disturbance = 0.3f, .duration = 1.0f},
+    {"loader_m2006_angle", PLANT_M2006, 1e-3f, 1, 1,
+     .angle_PID = {.Kp = 20, .MaxOut = 30000},
+     .speed_PID = {.Kp = 10, .Ki = 1, .IntegralLimit = 5000, .MaxOut = 5000, .Improve = PID_Integral_Limit},
+     .current_PID = {.Kp = 0.7f, .Ki = 0.1f, .IntegralLimit = 5000, .MaxOut = 5000, .Improve = PID_Integral_Limit},
+     .step = 36 * 45, .disturbance = 0.2f, .duration = 1.0f},
+    {"yaw_gm6020_angle", PLANT_GM6020, 0.02f, 1, 0,
+     .angle_PID = {.Kp = 8, .DeadBand = 0.1f, .IntegralLimit = 100, .MaxOut = 500, .Improve = PID_Trapezoid_Intergral | PID_Integral_Limit | PID_Derivative_On_Measurement},
+     .speed_PID = {.Kp = 50, .Ki = 200, .IntegralLimit = 3000, .MaxOut = 20000, .Improve = PID_Trapezoid_Intergral | PID_Integral_Limit | PID_Derivative_On_Measurement},
+     .step = 90, .disturbance = 0.3f, .duration = 2.0f},
+    {"pitch_gm6020_angle", PLANT_GM6020, 0.01f, 1, 0,
+     .angle_PID = {.Kp = 10, .IntegralLimit = 100, .MaxOut = 500, .Improve = PID_Trapezoid_Intergral | PID_Integral_Limit | PID_Derivative_On_Measurement},
+     .speed_PID = {.Kp = 50, .Ki = 350, .IntegralLimit = 2500, .MaxOut = 20000, .Improve = PID_Trapezoid_Intergral | PID_Integral_Limit | PID_Derivative_On_Measurement},
+     .step = 20, .disturbance = 0.5f, .duration = 2.0f},
+};
+
+// 每个基础场景按增益倍数和阶跃幅值展开
+static const float gain_scale[] = {0.5f, 0.75f, 1.0f, 1.5f, 2.0f};
+static const float step_scale[] = {0.2f, 1.0f};
+
+// 闭环运行时记录每个环每个周期的输入,之后重放这些输入测量PID的耗时
+// 主机上DWT->CYCCNT由系统时钟换算,精度不足以逐次测量一次PID计算
+static float rec_measure[3][STEP_MAX], rec_ref[3][STEP_MAX];
+
+static void ScaleGain(PID_Init_Config_s *config, float k)
+{
+    config->Kp *= k;
+    config->Ki *= k;
+    config->Kd *= k;
+}
+
+// 记录输入的PID计算,loop为0/1/2分别对应位置/速度/电流环
+static float LoopPID(PIDInstance *pid, uint8_t loop, uint32_t k, float measure, float ref)
+{
+    rec_measure[loop][k] = measure;
+    rec_ref[loop][k] = ref;
+    return PIDCalculateDt(pid, measure, ref, LOOP_DT);
+}
+
+// 用记录的输入重放steps个周期的PID计算,返回每次计算的平均DWT周期数
+static float ReplayCycles(Loop_Case_s const *c, uint32_t steps)
+{
+    PIDInstance pid[3];
+    PID_Init_Config_s config[3] = {c->angle_PID, c->speed_PID, c->current_PID};
+    uint8_t used[3] = {c->angle_loop, 1, c->current_loop};
+    uint32_t start, cycles = 0, calls = 0;
+
+    for (uint32_t r = 0; r < REPLAY_ROUND; r++)
+    {
+        for (uint8_t l = 0; l < 3; l++)
+            PIDInit(&pid[l], &config[l]);
+        start = DWT->CYCCNT;
+        for (uint32_t k = 0; k < steps; k++)
+            for (uint8_t l = 0; l < 3; l++)
+                if (used[l])
+                    PIDCalculateDt(&pid[l], rec_measure[l][k], rec_ref[l][k], LOOP_DT);
+        cycles += DWT->CYCCNT - start;
+    }
+    for (uint8_t l = 0; l < 3; l++)
+        calls += used[l] * steps * REPLAY_ROUND;
+    return calls ? (float)cycles / calls : 0;
+}
+
+static void RunCase(Loop_Case_s const *c, Loop_Result_s *res)
+{
+    Motor_Plant_s plant;
+    PIDInstance angle_pid, speed_pid, current_pid;
+    PID_Init_Config_s config;
+    uint32_t n = (uint32_t)(c->duration / LOOP_DT), half = n / 2, k;
+    float y, ref, err, band = SETTLE_BAND * fabsf(c->step), peak = 0, sse = 0;
+    float t10 = -1, t90 = -1, settle = 0, dist_dev = 0, dist_rec = 0;
+    uint16_t ecd, last_ecd;
+    int32_t total_round = 0;
+    float speed_aps = 0, total_angle;
+    int16_t real_current = 0, cmd = 0;
+
+    memset(res, 0, sizeof(Loop_Result_s));
+    MotorPlantInit(&plant, c->plant, c->load_inertia);
+    config = c->angle_PID;
+    PIDInit(&angle_pid, &config);
+    config = c->speed_PID;
+    PIDInit(&speed_pid, &config);
+    config = c->current_PID;
+    PIDInit(&current_pid, &config);
+    last_ecd = MotorPlantEcd(&plant);
+
+    if (n > STEP_MAX)
+        n = STEP_MAX;
+    for (k = 0; k < n; k++)
+    {
+        // 反馈解析,和DecodeDJIMotor()相同
+        ecd = MotorPlantEcd(&plant);
+        speed_aps = (1.0f - SPEED_SMOOTH_COEF) * speed_aps + RPM_2_ANGLE_PER_SEC * SPEED_SMOOTH_COEF * (float)MotorPlantSpeedRPM(&plant);
+        real_current = (1.0f - CURRENT_SMOOTH_COEF) * real_current + CURRENT_SMOOTH_COEF * (float)MotorPlantCurrentRaw(&plant);
+        if (ecd - last_ecd > 4096)
+            total_round--;
+        else if (ecd - last_ecd < -4096)
+            total_round++;
+        last_ecd = ecd;
+        total_angle = total_round * 360 + ECD_ANGLE_COEF_DJI * ecd;
+
+        // 串级控制,和MotorCalculate()相同
+        ref = c->step;
+        if (c->angle_loop)
+            ref = LoopPID(&angle_pid, 0, k, total_angle, ref);
+        ref = LoopPID(&speed_pid, 1, k, speed_aps, ref);
+        if (c->current_loop)
+            ref = LoopPID(&current_pid, 2, k, real_current, ref);
+        LIMIT_MIN_MAX(ref, -32767, 32767);
+
+        // 上一周期的控制量在本周期内生效
+        MotorPlantCommand(&plant, cmd);
+        cmd = (int16_t)ref;
+        if (k == half)
+            plant.load_torque = c->disturbance;
+        MotorPlantStep(&plant, LOOP_DT);
+
+        // 统计指标,使用电机模型的真实状态
+        y = c->angle_loop ? plant.theta * RAD_2_DEGREE : plant.omega * RAD_2_DEGREE;
+        err = fabsf(y - c->step);
+        if (!isfinite(y) || fabsf(y) > DIVERGE_RATIO * fabsf(c->step))
+        {
+            res->diverged = 1;
+            break;
+        }
+        if (k < half)
+        {
+            if (t10 < 0 && fabsf(y) >= 0.1f * fabsf(c->step))
+                t10 = k * LOOP_DT;
+            if (t90 < 0 && fabsf(y) >= 0.9f * fabsf(c->step))
+                t90 = k * LOOP_DT;
+            if ((y - c->step) * (c->step > 0 ? 1 : -1) > peak)
+                peak = (y - c->step) * (c->step > 0 ? 1 : -1);
+            if (err > band)
+                settle = (k + 1) * LOOP_DT;
+            if (k >= half - half / 10)
+                sse += err / (half / 10);
+        }
+        else
+        {
+            if (err > dist_dev)
+                dist_dev = err;
+            if (err > band)
+                dist_rec = (k + 1 - half) * LOOP_DT;
+        }
+    }
+
+    res->rise = (t10 >= 0 && t90 >= 0) ? t90 - t10 : c->duration / 2;
+    res->overshoot = peak / fabsf(c->step) * 100;
+    res->settle = settle;
+    res->sse = sse;
+    res->dist_dev = dist_dev;
+    res->dist_rec = dist_rec;
+    res->cycles = ReplayCycles(c, k);
+}
+
+// 展开基础场景,返回场景数
+static uint32_t BuildCases(Loop_Case_s *cases, char names[][48])
+{
+    uint32_t cnt = 0;
+    for (uint32_t b = 0; b < sizeof(base_case) / sizeof(base_case[0]); b++)
+        for (uint32_t g = 0; g < sizeof(gain_scale) / sizeof(gain_scale[0]); g++)
+            for (uint32_t s = 0; s < sizeof(step_scale) / sizeof(step_scale[0]); s++)
+            {
+                cases[cnt] = base_case[b];
+                ScaleGain(&cases[cnt].angle_PID, gain_scale[g]);
+                ScaleGain(&cases[cnt].speed_PID, gain_scale[g]);
+                cases[cnt].step *= step_scale[s];
+                snprintf(names[cnt], 48, "%s/k%.2f/s%.1f", base_case[b].name, gain_scale[g], step_scale[s]);
+                cases[cnt].name = names[cnt];
+                cnt++;
+            }
+    return cnt;
+}
+
+static void PrintResult(Loop_Result_s const *r)
+{
+    if (r->diverged)
+        printf("%-36s diverged\n", r->name);
+    else
+        printf("%-36s %8.1f %8.1f %8.1f %10.3g %10.3g %8.1f %7.1f\n", r->name, r->rise * 1000, r->overshoot,
+               r->settle * 1000, r->sse, r->dist_dev, r->dist_rec * 1000, r->cycles);
+}
+
+static int SaveResult(const char *path, Loop_Result_s const *res, uint32_t cnt)
+{
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return -1;
+    for (uint32_t i = 0; i < cnt; i++)
+        fprintf(f, "%s %d %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n", res[i].name, res[i].diverged, res[i].rise, res[i].overshoot,
+                res[i].settle, res[i].sse, res[i].dist_dev, res[i].dist_rec, res[i].cycles);
+    fclose(f);
+    return 0;
+}
+
+// 指标变差超过容差时返回1;时间类指标允许1个控制周期或5%的差异
+static uint8_t Worse(float now, float base, float abs_tol)
+{
+    return now > base * 1.05f + abs_tol;
+}
+
+// 和基准比较,返回控制效果变差的场景数;耗时在主机上有波动,平均耗时增加25%以上时只给出提示
+static int CheckResult(const char *path, Loop_Result_s const *res, uint32_t cnt)
+{
+    FILE *f = fopen(path, "r");
+    Loop_Result_s b;
+    int diverged, regress = 0;
+    uint32_t i = 0;
+    float base_cycles = 0, now_cycles = 0;
+    if (!f)
+        return -1;
+    while (i < cnt && fscanf(f, "%47s %d %f %f %f %f %f %f %f", b.name, &diverged, &b.rise, &b.overshoot, &b.settle,
+                             &b.sse, &b.dist_dev, &b.dist_rec, &b.cycles) == 9)
+    {
+        Loop_Result_s const *r = &res[i++];
+        if (strcmp(b.name, r->name) != 0)
+        {
+            printf("baseline mismatch: %s vs %s, regenerate it with --save\n", b.name, r->name);
+            fclose(f);
+            return -1;
+        }
+        if ((r->diverged && !diverged) ||
+            (!r->diverged && (Worse(r->rise, b.rise, LOOP_DT) || Worse(r->overshoot, b.overshoot, 0.5f) ||
+                              Worse(r->settle, b.settle, LOOP_DT) || Worse(r->sse, b.sse, 1e-3f) ||
+                              Worse(r->dist_dev, b.dist_dev, 1e-3f) || Worse(r->dist_rec, b.dist_rec, LOOP_DT))))
+        {
+            printf("REGRESSION ");
+            PrintResult(r);
+            printf("  baseline ");
+            PrintResult(&b);
+            regress++;
+        }
+        base_cycles += b.cycles;
+        now_cycles += r->cycles;
+    }
+    fclose(f);
+    if (i != cnt)
+    {
+        printf("baseline has %u cases, expected %u, regenerate it with --save\n", i, cnt);
+        return -1;
+    }
+    if (now_cycles > base_cycles * 1.25f)
+        printf("PID calls are slower than baseline: %.1f -> %.1f cycles/call\n", base_cycles / cnt, now_cycles / cnt);
+    return regress;
+}
+
+int main(int argc, char **argv)
+{
+    static Loop_Case_s cases[SCENARIO_MAX];
+    static Loop_Result_s res[SCENARIO_MAX];
+    static char names[SCENARIO_MAX][48];
+    const char *save = NULL, *check = NULL;
+    uint32_t cnt, repeat = 20, verbose = 0;
+    uint64_t start_ns;
+    double elapsed, cycles = 0;
+    int ret = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-v"))
+            verbose = 1;
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            repeat = (uint32_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--save") && i + 1 < argc)
+            save = argv[++i];
+        else if (!strcmp(argv[i], "--check") && i + 1 < argc)
+            check = argv[++i];
+        else
+        {
+            printf("usage: %s [-v] [-n repeat] [--save baseline] [--check baseline]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (repeat == 0)
+        repeat = 1;
+
+    DWT_Init(168);
+    cnt = BuildCases(cases, names);
+
+    // 结果是确定的,重复运行只用于测量吞吐量
+    start_ns = HostTimeNow();
+    for (uint32_t r = 0; r < repeat; r++)
+        for (uint32_t i = 0; i < cnt; i++)
+        {
+            RunCase(&cases[i], &res[i]);
+            strcpy(res[i].name, cases[i].name);
+        }
+    elapsed = (HostTimeNow() - start_ns) / 1e9;
+
+    printf("%-36s %8s %8s %8s %10s %10s %8s %7s\n", "case", "rise/ms", "over/%", "settle", "sse", "dist_dev", "rec/ms", "cyc");
+    for (uint32_t i = 0; i < cnt; i++)
+    {
+        cycles += res[i].cycles / cnt;
+        if (verbose || strstr(res[i].name, "/k1.00/"))
+            PrintResult(&res[i]);
+    }
+    printf("%u cases x %u runs in %.2fs, %.0f cases/s, %.1f cycles per PID call\n", cnt, repeat, elapsed,
+           cnt * repeat / elapsed, cycles);
+
+    if (save && SaveResult(save, res, cnt) < 0)
+    {
+        printf("cannot write %s\n", save);
+        ret = 2;
+    }
+    if (check)
+    {
+        int regress = CheckResult(check, res, cnt);
+        if (regress < 0)
+            ret = 2;
+        else if (regress > 0)
+        {
+            printf("%d cases regressed\n", regress);
+            ret = 1;
+        }
+        else
+            printf("no regression against %s\n", check);
+    }
+    return ret;
+}
@@ -0,0 +1,49 @@
+/**
+ * @file arm_math.h
+ * @brief 主机构建使用的替身头文件,代替CMSIS-DSP的arm_math.h,只提供module中用到的类型和常量,矩阵运算函数没有实现
+ */
+#ifndef HOST_ARM_MATH_H
+#define HOST_ARM_MATH_H
+
+#include <stdint.h>
+#include <math.h>
+
+typedef float float32_t;
+typedef double float64_t;
+
+#ifndef PI
+#define PI 3.14159265358979f
+#endif
+
+typedef struct
+{
+    uint16_t numRows;
+    uint16_t numCols;
+    float32_t *pData;
+} arm_matrix_instance_f32;
+
+typedef struct
+{
+    float32_t A0;
+    float32_t A1;
+    float32_t A2;
+    float32_t state[3];
+    float32_t Kp;
+    float32_t Ki;
+    float32_t Kd;
+} arm_pid_instance_f32;
+
+// 和CMSIS-DSP中的实现相同
+static inline float32_t arm_pid_f32(arm_pid_instance_f32 *S, float32_t in)
+{
+    float32_t out = (S->A0 * in) + (S->A1 * S->state[0]) + (S->A2 * S->state[1]) + (S->state[2]);
+    S->state[1] = S->state[0];
+    S->state[0] = in;
+    S->state[2] = out;
+    return out;
+}
+
+#define arm_sin_f32(x) sinf(x)
+#define arm_cos_f32(x) cosf(x)
+
+#endif // !HOST_ARM_MATH_H
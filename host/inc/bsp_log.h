@@ -0,0 +1,29 @@
+/**
+ * @file bsp_log.h
+ * @brief 主机构建使用的替身头文件,代替bsp/log/bsp_log.h,日志输出到stderr而不是RTT
+ */
+#ifndef _BSP_LOG_H
+#define _BSP_LOG_H
+
+#include <stdio.h>
+
+#define LOG_PROTO(type, format, ...) fprintf(stderr, "  %s" format "\n", type, ##__VA_ARGS__)
+
+#define LOG_CLEAR()
+#define LOG(format, ...) LOG_PROTO("", format, ##__VA_ARGS__)
+
+#if DISABLE_LOG_SYSTEM
+#define LOGINFO(format, ...)
+#define LOGWARNING(format, ...)
+#define LOGERROR(format, ...)
+#else
+#define LOGINFO(format, ...) LOG_PROTO("I:", format, ##__VA_ARGS__)
+#define LOGWARNING(format, ...) LOG_PROTO("W:", format, ##__VA_ARGS__)
+#define LOGERROR(format, ...) LOG_PROTO("E:", format, ##__VA_ARGS__)
+#endif // DISABLE_LOG_SYSTEM
+
+#define BSPLogInit()
+#define PrintLog(fmt, ...) fprintf(stderr, fmt, ##__VA_ARGS__)
+#define Float2Str(str, va) sprintf(str, "%f", va)
+
+#endif
@@ -0,0 +1,114 @@
+/**
+ * @file can.h
+ * @brief 主机构建使用的替身头文件,代替Cube生成的can.h和stm32f4xx_hal_can.h
+ *        只声明bsp_can.c用到的HAL类型和接口,由host/src/hal_can_host.c实现一个虚拟的bxCAN
+ */
+#ifndef HOST_CAN_H_SHIM
+#define HOST_CAN_H_SHIM
+
+#include "main.h"
+
+typedef struct
+{
+    uint32_t Prescaler;
+    FunctionalState TimeTriggeredMode;
+    FunctionalState AutoBusOff;
+    FunctionalState AutoRetransmission;
+    FunctionalState ReceiveFifoLocked;
+    FunctionalState TransmitFifoPriority;
+} CAN_InitTypeDef;
+
+typedef struct
+{
+    uint32_t FilterIdHigh;
+    uint32_t FilterIdLow;
+    uint32_t FilterMaskIdHigh;
+    uint32_t FilterMaskIdLow;
+    uint32_t FilterFIFOAssignment;
+    uint32_t FilterBank;
+    uint32_t FilterMode;
+    uint32_t FilterScale;
+    uint32_t FilterActivation;
+    uint32_t SlaveStartFilterBank;
+} CAN_FilterTypeDef;
+
+typedef struct
+{
+    uint32_t StdId;
+    uint32_t ExtId;
+    uint32_t IDE;
+    uint32_t RTR;
+    uint32_t DLC;
+    FunctionalState TransmitGlobalTime;
+} CAN_TxHeaderTypeDef;
+
+typedef struct
+{
+    uint32_t StdId;
+    uint32_t ExtId;
+    uint32_t IDE;
+    uint32_t RTR;
+    uint32_t DLC;
+    uint32_t Timestamp;
+    uint32_t FilterMatchIndex;
+} CAN_RxHeaderTypeDef;
+
+typedef struct
+{
+    CAN_TypeDef *Instance;
+    CAN_InitTypeDef Init;
+    volatile uint32_t ErrorCode;
+} CAN_HandleTypeDef;
+
+extern CAN_HandleTypeDef hcan1;
+extern CAN_HandleTypeDef hcan2;
+
+#define CAN_ID_STD (0x00000000U)
+#define CAN_ID_EXT (0x00000004U)
+#define CAN_RTR_DATA (0x00000000U)
+#define CAN_RTR_REMOTE (0x00000002U)
+
+#define CAN_RX_FIFO0 (0x00000000U)
+#define CAN_RX_FIFO1 (0x00000001U)
+
+#define CAN_FILTERMODE_IDMASK (0x00000000U)
+#define CAN_FILTERMODE_IDLIST (0x00000001U)
+#define CAN_FILTERSCALE_16BIT (0x00000000U)
+#define CAN_FILTERSCALE_32BIT (0x00000001U)
+#define CAN_FILTER_DISABLE (0x00000000U)
+#define CAN_FILTER_ENABLE (0x00000001U)
+
+#define CAN_IT_TX_MAILBOX_EMPTY (0x00000001U)
+#define CAN_IT_RX_FIFO0_MSG_PENDING (0x00000002U)
+#define CAN_IT_RX_FIFO0_FULL (0x00000004U)
+#define CAN_IT_RX_FIFO0_OVERRUN (0x00000008U)
+#define CAN_IT_RX_FIFO1_MSG_PENDING (0x00000010U)
+#define CAN_IT_RX_FIFO1_FULL (0x00000020U)
+#define CAN_IT_RX_FIFO1_OVERRUN (0x00000040U)
+
+#define HAL_CAN_ERROR_NONE (0x00000000U)
+#define HAL_CAN_ERROR_RX_FOV0 (0x00000200U)
+#define HAL_CAN_ERROR_RX_FOV1 (0x00000400U)
+#define HAL_CAN_ERROR_TX_ALST0 (0x00000800U)
+#define HAL_CAN_ERROR_TX_TERR0 (0x00001000U)
+#define HAL_CAN_ERROR_TX_ALST1 (0x00002000U)
+#define HAL_CAN_ERROR_TX_TERR1 (0x00004000U)
+#define HAL_CAN_ERROR_TX_ALST2 (0x00008000U)
+#define HAL_CAN_ERROR_TX_TERR2 (0x00010000U)
+
+HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef *hcan, CAN_FilterTypeDef *sFilterConfig);
+HAL_StatusTypeDef HAL_CAN_Start(CAN_HandleTypeDef *hcan);
+HAL_StatusTypeDef HAL_CAN_ActivateNotification(CAN_HandleTypeDef *hcan, uint32_t ActiveITs);
+HAL_StatusTypeDef HAL_CAN_AddTxMessage(CAN_HandleTypeDef *hcan, CAN_TxHeaderTypeDef *pHeader, uint8_t aData[], uint32_t *pTxMailbox);
+uint32_t HAL_CAN_GetTxMailboxesFreeLevel(CAN_HandleTypeDef *hcan);
+HAL_StatusTypeDef HAL_CAN_GetRxMessage(CAN_HandleTypeDef *hcan, uint32_t RxFifo, CAN_RxHeaderTypeDef *pHeader, uint8_t aData[]);
+uint32_t HAL_CAN_GetRxFifoFillLevel(CAN_HandleTypeDef *hcan, uint32_t RxFifo);
+
+void HAL_CAN_TxMailbox0CompleteCallback(CAN_HandleTypeDef *hcan);
+void HAL_CAN_TxMailbox1CompleteCallback(CAN_HandleTypeDef *hcan);
+void HAL_CAN_TxMailbox2CompleteCallback(CAN_HandleTypeDef *hcan);
+void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan);
+void HAL_CAN_RxFifo1MsgPendingCallback(CAN_HandleTypeDef *hcan);
+void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan);
+
+#endif // !HOST_CAN_H_SHIM
@@ -0,0 +1,66 @@
+/**
+ * @file cmsis_os.h
+ * @brief 主机构建使用的替身头文件,代替FreeRTOS的cmsis_os v1接口
+ *        主机上不运行RTOS,osThreadCreate()只记录任务而不会执行,由调用者在自己的循环中驱动需要的函数;
+ *        osDelay()推进主机时间,见host_time.h
+ */
+#ifndef HOST_CMSIS_OS_H
+#define HOST_CMSIS_OS_H
+
+#include <stdint.h>
+
+typedef enum
+{
+    osPriorityIdle = -3,
+    osPriorityLow = -2,
+    osPriorityBelowNormal = -1,
+    osPriorityNormal = 0,
+    osPriorityAboveNormal = +1,
+    osPriorityHigh = +2,
+    osPriorityRealtime = +3,
+    osPriorityError = 0x84
+} osPriority;
+
+typedef enum
+{
+    osOK = 0,
+    osEventSignal = 0x08,
+    osEventTimeout = 0x40,
+    osErrorOS = 0xFF,
+} osStatus;
+
+typedef void (*os_pthread)(void const *argument);
+typedef void *osThreadId;
+
+typedef struct os_thread_def
+{
+    char *name;
+    os_pthread pthread;
+    osPriority tpriority;
+    uint32_t instances;
+    uint32_t stacksize;
+} osThreadDef_t;
+
+typedef struct
+{
+    osStatus status;
+    union
+    {
+        uint32_t v;
+        int32_t signals;
+    } value;
+} osEvent;
+
+#define osWaitForever 0xFFFFFFFF
+
+#define osThreadDef(name, thread, priority, instances, stacksz) \
+    const osThreadDef_t os_thread_def_##name = {#name, (thread), (priority), (instances), (stacksz)}
+#define osThread(name) &os_thread_def_##name
+
+osThreadId osThreadCreate(const osThreadDef_t *thread_def, void *argument);
+osThreadId osThreadGetId(void);
+osStatus osDelay(uint32_t millisec);
+int32_t osSignalSet(osThreadId thread_id, int32_t signals);
+osEvent osSignalWait(int32_t signals, uint32_t millisec);
+
+#endif // !HOST_CMSIS_OS_H
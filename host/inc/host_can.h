@@ -0,0 +1,60 @@
+/**
+ * @file host_can.h
+ * @brief 主机构建的虚拟bxCAN,供仿真程序驱动总线和接入模拟设备
+ *
+ * @note hal_can_host.c在HAL层模拟了bxCAN(3个发送邮箱/2个深度为3的接收FIFO/28个过滤器),
+ *       因此bsp_can.c以及其上的所有module都可以不加修改地在主机上编译运行
+ *       总线后端有两种:
+ *       1. 默认为进程内的模拟总线,发送的报文交给HostCANAddTxHook()注册的钩子(模拟电机/另一块板子等),
+ *          钩子或仿真程序通过HostCANInject()向总线注入报文
+ *       2. HostCANOpenSocketCAN()后,该总线的收发都通过SocketCAN接口(如vcan0)进行,可以和其他进程互联
+ *
+ *       主机上没有中断,HostCANStep()和HostCANInject()在调用者的线程中同步执行HAL回调
+ */
+#ifndef HOST_CAN_H
+#define HOST_CAN_H
+
+#include <stdint.h>
+#include "can.h"
+
+#define HOST_CAN_TX_HOOK_CNT 8 // 每条总线最多的发送钩子数
+
+/**
+ * @brief 发送钩子,邮箱中的报文被"发送"到总线上时调用
+ *
+ * @param bus 总线号,0为CAN1,1为CAN2
+ */
+typedef void (*host_can_tx_hook)(uint8_t bus, uint16_t std_id, uint8_t dlc, uint8_t const *data);
+
+/**
+ * @brief 推进一次总线:将发送邮箱中的报文按进入顺序发出,然后轮询SocketCAN接收
+ *        邮箱发出后会调用TxMailboxComplete回调,和硬件一样由此触发bsp_can发送队列的续传
+ *
+ * @note  仿真程序应在每个控制周期结束后调用,或者在等待时循环调用
+ */
+void HostCANStep(void);
+
+/**
+ * @brief 向总线注入一帧报文,经过过滤器后进入对应FIFO,并立即执行接收回调
+ *        FIFO满时和硬件一样覆盖最后一帧,并通过HAL_CAN_ErrorCallback()报告溢出
+ *
+ * @param bus 总线号,0为CAN1,1为CAN2
+ * @return uint8_t 报文是否通过了过滤器
+ */
+uint8_t HostCANInject(uint8_t bus, uint16_t std_id, uint8_t dlc, uint8_t const *data);
+
+/**
+ * @brief 注册发送钩子,在模拟总线上接入一个模拟设备
+ */
+void HostCANAddTxHook(uint8_t bus, host_can_tx_hook hook);
+
+/**
+ * @brief 将总线切换到SocketCAN后端
+ *
+ * @param bus 总线号,0为CAN1,1为CAN2
+ * @param ifname 接口名,如"vcan0"
+ * @return int 成功返回0,失败返回-1
+ */
+int HostCANOpenSocketCAN(uint8_t bus, char const *ifname);
+
+#endif // !HOST_CAN_H
@@ -0,0 +1,35 @@
+/**
+ * @file host_time.h
+ * @brief 主机构建的时间源,为DWT->CYCCNT和osDelay()提供时间
+ *
+ * @note 默认使用CLOCK_MONOTONIC的真实时间;调用HostTimeUseVirtual()后切换为虚拟时间,
+ *       时间只在HostTimeAdvance()或osDelay()时前进,仿真结果与主机负载无关,可以复现
+ */
+#ifndef HOST_TIME_H
+#define HOST_TIME_H
+
+#include <stdint.h>
+
+/**
+ * @brief 获取当前时间,单位为纳秒
+ */
+uint64_t HostTimeNow(void);
+
+/**
+ * @brief 切换为虚拟时间,时间从0开始,只在HostTimeAdvance()/osDelay()时前进
+ */
+void HostTimeUseVirtual(void);
+
+/**
+ * @brief 推进虚拟时间;使用真实时间时会睡眠相应的时长
+ *
+ * @param ns 推进的时间,单位为纳秒
+ */
+void HostTimeAdvance(uint64_t ns);
+
+/**
+ * @brief 刷新并返回模拟的DWT寄存器,CYCCNT=当前时间*SystemCoreClock,供DWT宏使用
+ */
+void *HostDWT(void);
+
+#endif // !HOST_TIME_H
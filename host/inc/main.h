@@ -0,0 +1,12 @@
+/**
+ * @file main.h
+ * @brief 主机构建使用的替身头文件,代替Cube生成的main.h
+ */
+#ifndef HOST_MAIN_H
+#define HOST_MAIN_H
+
+#include <stdint.h>
+#include <stddef.h> // 目标板的main.h经由HAL间接包含了stddef.h,部分module依赖此行为
+#include "stm32f407xx.h"
+
+#endif // !HOST_MAIN_H
@@ -0,0 +1,85 @@
+/**
+ * @file motor_plant.h
+ * @brief 主机构建的DJI电机模型(M3508+C620/M2006+C610/GM6020),用于在没有开发板的机器上闭环测试控制器
+ *
+ * @note 模型包括转子和负载的惯量,粘滞和库仑摩擦,反电动势,电调的电流(电压)限幅以及报文的量化:
+ *       - M3508/M2006:控制量为电流,电调的电流环简化为一阶惯性,可用电流受母线电压减去反电动势的限制
+ *       - GM6020:控制量为电压,电流由 L*di/dt = V - R*i - Ke*w 给出,并受驱动器电流限幅
+ *       控制量按电调的定义换算并截断为int16,反馈和电调报文一样量化为编码器值/rpm/int16电流
+ *       所有量都以转子为准(和电调的反馈一致),负载的惯量和力矩在输出轴上给出,按减速比折算
+ */
+#ifndef MOTOR_PLANT_H
+#define MOTOR_PLANT_H
+
+#include <stdint.h>
+
+typedef enum
+{
+    PLANT_M3508 = 0,
+    PLANT_M2006,
+    PLANT_GM6020,
+} Motor_Plant_Type_e;
+
+typedef struct
+{
+    // 参数,由MotorPlantInit()按电机型号设置,可以在之后修改
+    float gear;          // 减速比
+    float kt;            // 转矩常数,转子侧,N·m/A
+    float ke;            // 反电动势常数,V/(rad/s)
+    float r;             // 相电阻,Ω
+    float l;             // 电感,H,仅电压控制时使用
+    float j;             // 转子侧的总惯量,kg·m^2
+    float b;             // 粘滞摩擦,N·m/(rad/s)
+    float coulomb;       // 库仑摩擦,N·m
+    float v_bus;         // 母线电压,V
+    float i_max;         // 电流限幅,A
+    float tau_i;         // 电调电流环的时间常数,s,仅电流控制时使用
+    float cmd_scale;     // 控制量每个LSB对应的电流(A)或电压(V)
+    int16_t cmd_max;     // 控制量的范围
+    float current_scale; // 反馈电流每个LSB对应的电流,A
+    uint8_t voltage_cmd; // 控制量为电压
+
+    // 状态
+    float omega;       // 转子角速度,rad/s
+    float theta;       // 转子累计角度,rad
+    float current;     // 电流,A
+    float load_torque; // 输出轴上的负载力矩,N·m,可随时修改以施加扰动
+    int16_t cmd;       // 当前生效的控制量
+} Motor_Plant_s;
+
+/**
+ * @brief 按型号初始化电机模型,状态清零
+ *
+ * @param plant        电机模型
+ * @param type         电机型号
+ * @param load_inertia 输出轴上的负载惯量,kg·m^2
+ */
+void MotorPlantInit(Motor_Plant_s *plant, Motor_Plant_Type_e type, float load_inertia);
+
+/**
+ * @brief 写入控制量,和电调一样先限幅,在下一次MotorPlantStep()中生效
+ *
+ * @param cmd 控制报文中的控制量,已经截断为int16
+ */
+void MotorPlantCommand(Motor_Plant_s *plant, int16_t cmd);
+
+/**
+ * @brief 推进电机模型,内部按不超过0.1ms的步长积分
+ *
+ * @param dt 推进的时间,s
+ */
+void MotorPlantStep(Motor_Plant_s *plant, float dt);
+
+/* 反馈,和电调报文中的量化相同 */
+uint16_t MotorPlantEcd(Motor_Plant_s const *plant);      // 转子编码器值,0~8191
+int16_t MotorPlantSpeedRPM(Motor_Plant_s const *plant);  // 转子转速,rpm
+int16_t MotorPlantCurrentRaw(Motor_Plant_s const *plant); // 转矩电流,单位为电调定义的LSB
+
+/**
+ * @brief 生成DJI电调的反馈报文,可以直接通过HostCANInject()注入总线,由dji_motor解析
+ *
+ * @param data 8字节的报文缓存
+ */
+void MotorPlantFeedbackFrame(Motor_Plant_s const *plant, uint8_t *data);
+
+#endif // !MOTOR_PLANT_H
@@ -0,0 +1,91 @@
+/**
+ * @file stm32f407xx.h
+ * @brief 主机(x86 Linux)构建使用的替身头文件,只提供bsp和module中用到的内核寄存器与外设寄存器定义
+ *        DWT->CYCCNT由主机时钟换算得到,见host_time.h
+ *
+ * @note 此目录下的头文件会遮蔽Inc/和Drivers/中的同名文件,只能用于host/Makefile
+ */
+#ifndef HOST_STM32F407XX_H
+#define HOST_STM32F407XX_H
+
+#include <stdint.h>
+#include "host_time.h"
+
+/* ---------------------------- 内核 ---------------------------- */
+
+extern uint32_t SystemCoreClock;
+
+typedef struct
+{
+    uint32_t CTRL;
+    uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct
+{
+    uint32_t DEMCR;
+} CoreDebug_Type;
+
+#define DWT ((DWT_Type *)HostDWT()) // 每次访问都会根据主机时钟刷新CYCCNT,写入CYCCNT没有效果
+#define CoreDebug (&host_core_debug)
+extern CoreDebug_Type host_core_debug;
+
+#define DWT_CTRL_CYCCNTENA_Msk (1UL)
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+
+// 主机上没有中断,接收"中断"在host_can的调用者线程中同步执行,因此临界区不需要做任何事
+static inline uint32_t __get_PRIMASK(void) { return 0; }
+static inline void __set_PRIMASK(uint32_t primask) { (void)primask; }
+static inline void __disable_irq(void) {}
+static inline void __enable_irq(void) {}
+#define __DMB() __sync_synchronize()
+#define __CLZ(x) ((uint8_t)__builtin_clz(x))
+
+/* ---------------------------- bxCAN ---------------------------- */
+
+typedef struct
+{
+    volatile uint32_t ESR; // 错误状态寄存器,由host_can在发送失败时维护
+    volatile uint32_t BTR; // 位时序寄存器,和Src/can.c的配置一致(1Mbps)
+} CAN_TypeDef;
+
+extern CAN_TypeDef host_can1_regs, host_can2_regs;
+#define CAN1 (&host_can1_regs)
+#define CAN2 (&host_can2_regs)
+
+#define CAN_ESR_EWGF (0x1UL << 0)
+#define CAN_ESR_EPVF (0x1UL << 1)
+#define CAN_ESR_BOFF (0x1UL << 2)
+#define CAN_ESR_LEC_Pos (4U)
+#define CAN_ESR_LEC (0x7UL << CAN_ESR_LEC_Pos)
+#define CAN_ESR_TEC_Pos (16U)
+#define CAN_ESR_TEC (0xFFUL << CAN_ESR_TEC_Pos)
+#define CAN_ESR_REC_Pos (24U)
+#define CAN_ESR_REC (0xFFUL << CAN_ESR_REC_Pos)
+
+#define CAN_BTR_BRP_Pos (0U)
+#define CAN_BTR_BRP (0x3FFUL << CAN_BTR_BRP_Pos)
+#define CAN_BTR_TS1_Pos (16U)
+#define CAN_BTR_TS1 (0xFUL << CAN_BTR_TS1_Pos)
+#define CAN_BTR_TS2_Pos (20U)
+#define CAN_BTR_TS2 (0x7UL << CAN_BTR_TS2_Pos)
+
+/* ---------------------------- HAL ---------------------------- */
+
+typedef enum
+{
+    HAL_OK = 0x00U,
+    HAL_ERROR = 0x01U,
+    HAL_BUSY = 0x02U,
+    HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+typedef enum
+{
+    DISABLE = 0U,
+    ENABLE = !DISABLE
+} FunctionalState;
+
+uint32_t HAL_RCC_GetPCLK1Freq(void);
+
+#endif // !HOST_STM32F407XX_H
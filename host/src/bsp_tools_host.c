@@ -0,0 +1,49 @@
+/**
+ * @file bsp_tools_host.c
+ * @brief 主机构建中代替bsp/bsp_tools.c
+ *        主机上没有RTOS任务,WakeCallbackTask()直接在调用者的线程中执行回调,相当于任务被立即调度
+ *        主机上没有CCM,CCMMalloc()从普通的堆中分配
+ */
+#include <stdlib.h>
+#include "main.h"
+#include "bsp_log.h"
+#include "bsp_tools.h"
+
+#define MX_SIG_LIST_SIZE 32
+
+typedef struct
+{
+    void (*callback)(void const *);
+    void *ins;
+} CallbackTask_t;
+
+static uint8_t sig_idx = 0;
+static CallbackTask_t cbkinfo_list[MX_SIG_LIST_SIZE];
+
+uint32_t CreateCallbackTask(char *name, void *cbk, void *ins, osPriority priority)
+{
+    (void)name;
+    (void)priority;
+    if (sig_idx >= MX_SIG_LIST_SIZE)
+        while (1)
+            LOGERROR("[rtos:cbk_register] CreateCallbackTask: sig_idx >= MX_SIG_LIST_SIZE");
+
+    cbkinfo_list[sig_idx].callback = (void (*)(void const *))cbk;
+    cbkinfo_list[sig_idx].ins = ins;
+    return 1U << sig_idx++;
+}
+
+void WakeCallbackTask(uint32_t sig)
+{
+    CallbackTask_t *task = &cbkinfo_list[31 - __CLZ(sig)];
+    task->callback(task->ins);
+}
+
+void *CCMMalloc(size_t size)
+{
+    void *ptr = calloc(1, size);
+    if (ptr == NULL)
+        while (1)
+            LOGERROR("[rtos:ccm] CCMMalloc: out of memory, request [%zu] bytes", size);
+    return ptr;
+}
@@ -0,0 +1,40 @@
+/**
+ * @file cmsis_os_host.c
+ * @brief 主机构建中代替FreeRTOS的cmsis_os接口,见host/inc/cmsis_os.h
+ */
+#include "cmsis_os.h"
+#include "host_time.h"
+#include "host_can.h"
+
+osThreadId osThreadCreate(const osThreadDef_t *thread_def, void *argument)
+{
+    (void)thread_def;
+    (void)argument;
+    return NULL; // 不执行任务,由仿真程序在自己的循环中调用需要的函数
+}
+
+osThreadId osThreadGetId(void)
+{
+    return NULL;
+}
+
+osStatus osDelay(uint32_t millisec)
+{
+    HostTimeAdvance((uint64_t)millisec * 1000000ULL);
+    HostCANStep(); // 等待期间总线上的报文会发送完成
+    return osOK;
+}
+
+int32_t osSignalSet(osThreadId thread_id, int32_t signals)
+{
+    (void)thread_id;
+    return signals;
+}
+
+osEvent osSignalWait(int32_t signals, uint32_t millisec)
+{
+    osEvent event = {.status = osEventTimeout};
+    (void)signals;
+    (void)millisec;
+    return event;
+}
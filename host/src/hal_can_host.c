@@ -0,0 +1,384 @@
+/**
+ * @file hal_can_host.c
+ * @brief 主机构建的虚拟bxCAN,在HAL层实现bsp_can.c用到的接口
+ *
+ * @note 只模拟了标准数据帧;发送邮箱按进入顺序发送(TransmitFifoPriority=ENABLE),
+ *       每帧按BTR换算的位时间占用总线,因此总线负载和邮箱等待和硬件上大致相当
+ *       错误计数器(ESR)始终为0,仿真中不会出现发送错误和离线
+ */
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "host_can.h"
+#include "host_time.h"
+#include "bsp_log.h"
+
+#define HOST_CAN_MAILBOX_CNT 3
+#define HOST_CAN_FIFO_DEPTH 3
+#define HOST_CAN_FILTER_CNT 28
+#define HOST_CAN_FRAME_BITS(dlc) (47 + 8 * (dlc) + (34 + 8 * (dlc) - 1) / 4) // 和bsp_can.c一致,含最坏情况的填充位
+
+typedef struct
+{
+    uint8_t used;
+    uint32_t seq;   // 进入邮箱的顺序,用于按时间顺序发送
+    uint64_t ready; // 最早可以开始发送的时间
+    uint16_t std_id;
+    uint8_t dlc;
+    uint8_t data[8];
+} HostCANMailbox_t;
+
+typedef struct
+{
+    uint16_t std_id;
+    uint8_t dlc;
+    uint8_t data[8];
+} HostCANFrame_t;
+
+typedef struct
+{
+    HostCANFrame_t frame[HOST_CAN_FIFO_DEPTH];
+    uint8_t head;
+    uint8_t cnt;
+} HostCANFifo_t;
+
+typedef struct
+{
+    CAN_HandleTypeDef *hcan;
+    HostCANMailbox_t mailbox[HOST_CAN_MAILBOX_CNT];
+    HostCANFifo_t fifo[2];
+    uint32_t tx_seq;
+    uint32_t it_enable; // 已开启的中断,CAN_IT_xxx
+    uint64_t busy_until; // 总线上一帧发送结束的时间
+    uint8_t in_step;     // 正在HostCANStep()中发送,续传的报文紧接上一帧发送
+    host_can_tx_hook hook[HOST_CAN_TX_HOOK_CNT];
+    uint8_t hook_cnt;
+    int sock; // SocketCAN套接字,-1表示使用进程内的模拟总线
+} HostCANBus_t;
+
+typedef struct
+{
+    uint8_t active;
+    uint8_t mode;
+    uint8_t scale;
+    uint8_t fifo;
+    uint32_t fr1, fr2; // 和硬件的FxR1/FxR2相同的排布
+} HostCANFilter_t;
+
+CAN_TypeDef host_can1_regs, host_can2_regs;
+// 位时序和Src/can.c一致:BRP=3,BS1=10TQ,BS2=3TQ,PCLK1=42MHz时为1Mbps;寄存器中保存的是配置值减1
+#define HOST_CAN_BTR ((2U << CAN_BTR_BRP_Pos) | (9U << CAN_BTR_TS1_Pos) | (2U << CAN_BTR_TS2_Pos))
+CAN_HandleTypeDef hcan1 = {.Instance = &host_can1_regs, .Init = {.Prescaler = 3, .TransmitFifoPriority = ENABLE}};
+CAN_HandleTypeDef hcan2 = {.Instance = &host_can2_regs, .Init = {.Prescaler = 3, .TransmitFifoPriority = ENABLE}};
+
+static HostCANBus_t host_can_bus[2] = {{.hcan = &hcan1, .sock = -1}, {.hcan = &hcan2, .sock = -1}};
+static HostCANFilter_t host_can_filter[HOST_CAN_FILTER_CNT];
+static uint8_t host_can_slave_start = 14; // CAN2使用的第一个过滤器
+
+uint32_t HAL_RCC_GetPCLK1Freq(void)
+{
+    return 42000000;
+}
+
+static HostCANBus_t *HostCANGetBus(CAN_HandleTypeDef *hcan)
+{
+    return hcan == &hcan1 ? &host_can_bus[0] : &host_can_bus[1];
+}
+
+// 每个bit的时长,单位为ns
+static uint64_t HostCANBitTime(HostCANBus_t *bus)
+{
+    uint32_t btr = bus->hcan->Instance->BTR;
+    uint32_t brp = ((btr & CAN_BTR_BRP) >> CAN_BTR_BRP_Pos) + 1;
+    uint32_t tq = 3 + ((btr & CAN_BTR_TS1) >> CAN_BTR_TS1_Pos) + ((btr & CAN_BTR_TS2) >> CAN_BTR_TS2_Pos);
+    return (uint64_t)brp * tq * 1000000000ULL / HAL_RCC_GetPCLK1Freq();
+}
+
+/* ---------------------------- HAL接口 ---------------------------- */
+
+HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef *hcan, CAN_FilterTypeDef *sFilterConfig)
+{
+    HostCANFilter_t *filter;
+    (void)hcan;
+    if (sFilterConfig->FilterBank >= HOST_CAN_FILTER_CNT)
+        return HAL_ERROR;
+    host_can_slave_start = sFilterConfig->SlaveStartFilterBank; // 和硬件一样,过滤器由两个CAN共享
+    filter = &host_can_filter[sFilterConfig->FilterBank];
+    filter->mode = sFilterConfig->FilterMode;
+    filter->scale = sFilterConfig->FilterScale;
+    filter->fifo = sFilterConfig->FilterFIFOAssignment;
+    filter->active = sFilterConfig->FilterActivation == CAN_FILTER_ENABLE;
+    if (filter->scale == CAN_FILTERSCALE_16BIT)
+    {
+        filter->fr1 = ((sFilterConfig->FilterMaskIdLow & 0xFFFF) << 16) | (sFilterConfig->FilterIdLow & 0xFFFF);
+        filter->fr2 = ((sFilterConfig->FilterMaskIdHigh & 0xFFFF) << 16) | (sFilterConfig->FilterIdHigh & 0xFFFF);
+    }
+    else
+    {
+        filter->fr1 = ((sFilterConfig->FilterIdHigh & 0xFFFF) << 16) | (sFilterConfig->FilterIdLow & 0xFFFF);
+        filter->fr2 = ((sFilterConfig->FilterMaskIdHigh & 0xFFFF) << 16) | (sFilterConfig->FilterMaskIdLow & 0xFFFF);
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_Start(CAN_HandleTypeDef *hcan)
+{
+    hcan->Instance->BTR = HOST_CAN_BTR;
+    hcan->Instance->ESR = 0;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_ActivateNotification(CAN_HandleTypeDef *hcan, uint32_t ActiveITs)
+{
+    HostCANGetBus(hcan)->it_enable |= ActiveITs;
+    return HAL_OK;
+}
+
+uint32_t HAL_CAN_GetTxMailboxesFreeLevel(CAN_HandleTypeDef *hcan)
+{
+    HostCANBus_t *bus = HostCANGetBus(hcan);
+    uint32_t free_level = 0;
+    for (uint8_t i = 0; i < HOST_CAN_MAILBOX_CNT; i++)
+        free_level += !bus->mailbox[i].used;
+    return free_level;
+}
+
+HAL_StatusTypeDef HAL_CAN_AddTxMessage(CAN_HandleTypeDef *hcan, CAN_TxHeaderTypeDef *pHeader, uint8_t aData[], uint32_t *pTxMailbox)
+{
+    HostCANBus_t *bus = HostCANGetBus(hcan);
+    HostCANMailbox_t *mailbox;
+    uint64_t now = HostTimeNow();
+    for (uint8_t i = 0; i < HOST_CAN_MAILBOX_CNT; i++)
+    {
+        mailbox = &bus->mailbox[i];
+        if (mailbox->used)
+            continue;
+        mailbox->used = 1;
+        mailbox->seq = bus->tx_seq++;
+        // 在发送完成回调中续传的报文,在硬件上会紧接着上一帧发出
+        mailbox->ready = bus->in_step && bus->busy_until > now ? bus->busy_until : now;
+        mailbox->std_id = pHeader->StdId & 0x7FF;
+        mailbox->dlc = pHeader->DLC > 8 ? 8 : pHeader->DLC;
+        memcpy(mailbox->data, aData, mailbox->dlc);
+        *pTxMailbox = 1U << i; // 和HAL一样返回CAN_TX_MAILBOXx
+        return HAL_OK;
+    }
+    hcan->ErrorCode |= 0x00100000U; // HAL_CAN_ERROR_PARAM,和HAL一样邮箱全满时报错
+    return HAL_ERROR;
+}
+
+uint32_t HAL_CAN_GetRxFifoFillLevel(CAN_HandleTypeDef *hcan, uint32_t RxFifo)
+{
+    return HostCANGetBus(hcan)->fifo[RxFifo].cnt;
+}
+
+HAL_StatusTypeDef HAL_CAN_GetRxMessage(CAN_HandleTypeDef *hcan, uint32_t RxFifo, CAN_RxHeaderTypeDef *pHeader, uint8_t aData[])
+{
+    HostCANFifo_t *fifo = &HostCANGetBus(hcan)->fifo[RxFifo];
+    HostCANFrame_t *frame;
+    if (fifo->cnt == 0)
+        return HAL_ERROR;
+    frame = &fifo->frame[fifo->head];
+    memset(pHeader, 0, sizeof(CAN_RxHeaderTypeDef));
+    pHeader->StdId = frame->std_id;
+    pHeader->IDE = CAN_ID_STD;
+    pHeader->RTR = CAN_RTR_DATA;
+    pHeader->DLC = frame->dlc;
+    memcpy(aData, frame->data, frame->dlc);
+    fifo->head = (fifo->head + 1) % HOST_CAN_FIFO_DEPTH;
+    fifo->cnt--;
+    return HAL_OK;
+}
+
+/* ---------------------------- 总线 ---------------------------- */
+
+// 报文是否通过过滤器,通过时返回FIFO号,否则返回-1
+static int HostCANFilterMatch(uint8_t bus, uint16_t std_id)
+{
+    uint8_t start = bus ? host_can_slave_start : 0;
+    uint8_t end = bus ? HOST_CAN_FILTER_CNT : host_can_slave_start;
+    uint32_t id16 = (uint32_t)std_id << 5, id32 = (uint32_t)std_id << 21; // 标准数据帧,IDE=RTR=0
+    HostCANFilter_t *f;
+    for (uint8_t i = start; i < end; i++)
+    {
+        f = &host_can_filter[i];
+        if (!f->active)
+            continue;
+        if (f->scale == CAN_FILTERSCALE_16BIT)
+        {
+            if (f->mode == CAN_FILTERMODE_IDLIST)
+            {
+                if ((f->fr1 & 0xFFFF) == id16 || (f->fr1 >> 16) == id16 ||
+                    (f->fr2 & 0xFFFF) == id16 || (f->fr2 >> 16) == id16)
+                    return f->fifo;
+            }
+            else if (((id16 ^ f->fr1) & (f->fr1 >> 16) & 0xFFFF) == 0 ||
+                     ((id16 ^ f->fr2) & (f->fr2 >> 16) & 0xFFFF) == 0)
+                return f->fifo;
+        }
+        else
+        {
+            if (f->mode == CAN_FILTERMODE_IDLIST)
+            {
+                if (f->fr1 == id32 || f->fr2 == id32)
+                    return f->fifo;
+            }
+            else if (((id32 ^ f->fr1) & f->fr2) == 0)
+                return f->fifo;
+        }
+    }
+    return -1;
+}
+
+uint8_t HostCANInject(uint8_t bus, uint16_t std_id, uint8_t dlc, uint8_t const *data)
+{
+    HostCANBus_t *b = &host_can_bus[bus];
+    HostCANFifo_t *fifo;
+    HostCANFrame_t *frame;
+    int fifox = HostCANFilterMatch(bus, std_id);
+    if (fifox < 0)
+        return 0;
+
+    fifo = &b->fifo[fifox];
+    if (fifo->cnt == HOST_CAN_FIFO_DEPTH)
+    { // ReceiveFifoLocked=DISABLE,新报文覆盖FIFO中最后一帧
+        frame = &fifo->frame[(fifo->head + HOST_CAN_FIFO_DEPTH - 1) % HOST_CAN_FIFO_DEPTH];
+        b->hcan->ErrorCode |= fifox ? HAL_CAN_ERROR_RX_FOV1 : HAL_CAN_ERROR_RX_FOV0;
+    }
+    else
+        frame = &fifo->frame[(fifo->head + fifo->cnt++) % HOST_CAN_FIFO_DEPTH];
+    frame->std_id = std_id;
+    frame->dlc = dlc > 8 ? 8 : dlc;
+    memcpy(frame->data, data, frame->dlc);
+
+    if (b->hcan->ErrorCode && (b->it_enable & (fifox ? CAN_IT_RX_FIFO1_OVERRUN : CAN_IT_RX_FIFO0_OVERRUN)))
+        HAL_CAN_ErrorCallback(b->hcan);
+    if (b->it_enable & (fifox ? CAN_IT_RX_FIFO1_MSG_PENDING : CAN_IT_RX_FIFO0_MSG_PENDING))
+        fifox ? HAL_CAN_RxFifo1MsgPendingCallback(b->hcan) : HAL_CAN_RxFifo0MsgPendingCallback(b->hcan);
+    return 1;
+}
+
+void HostCANAddTxHook(uint8_t bus, host_can_tx_hook hook)
+{
+    HostCANBus_t *b = &host_can_bus[bus];
+    if (b->hook_cnt >= HOST_CAN_TX_HOOK_CNT)
+    {
+        while (1)
+            LOGERROR("[host_can] too many tx hooks on can%d", bus + 1);
+    }
+    b->hook[b->hook_cnt++] = hook;
+}
+
+int HostCANOpenSocketCAN(uint8_t bus, char const *ifname)
+{
+    struct sockaddr_can addr = {0};
+    struct ifreq ifr = {0};
+    int sock = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (sock < 0)
+        return -1;
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    if (ioctl(sock, SIOCGIFINDEX, &ifr) < 0)
+    {
+        close(sock);
+        return -1;
+    }
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(sock);
+        return -1;
+    }
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+    host_can_bus[bus].sock = sock;
+    LOGINFO("[host_can] can%d attached to %s", bus + 1, ifname);
+    return 0;
+}
+
+// 把报文送上总线,SocketCAN发送缓冲区满时返回0,报文留在邮箱中下次再发
+static uint8_t HostCANPut(uint8_t bus, HostCANMailbox_t *mailbox)
+{
+    HostCANBus_t *b = &host_can_bus[bus];
+    struct can_frame frame = {0};
+    if (b->sock >= 0)
+    {
+        frame.can_id = mailbox->std_id;
+        frame.can_dlc = mailbox->dlc;
+        memcpy(frame.data, mailbox->data, mailbox->dlc);
+        if (write(b->sock, &frame, sizeof(frame)) != sizeof(frame))
+            return errno != EAGAIN && errno != ENOBUFS; // 其他错误直接丢弃,避免邮箱被永久占用
+        return 1;
+    }
+    for (uint8_t i = 0; i < b->hook_cnt; i++)
+        b->hook[i](bus, mailbox->std_id, mailbox->dlc, mailbox->data);
+    return 1;
+}
+
+static void HostCANStepBus(uint8_t bus)
+{
+    HostCANBus_t *b = &host_can_bus[bus];
+    HostCANMailbox_t *mailbox;
+    struct can_frame frame;
+    uint64_t now = HostTimeNow(), bit_time = HostCANBitTime(b), start;
+    uint8_t idx;
+
+    b->in_step = 1;
+    while (1)
+    { // 按进入邮箱的顺序发送,每帧占用总线HOST_CAN_FRAME_BITS个位时间
+        mailbox = NULL;
+        for (uint8_t i = 0; i < HOST_CAN_MAILBOX_CNT; i++)
+            if (b->mailbox[i].used && (mailbox == NULL || (int32_t)(b->mailbox[i].seq - mailbox->seq) < 0))
+                mailbox = &b->mailbox[i], idx = i;
+        if (mailbox == NULL)
+            break;
+        start = mailbox->ready > b->busy_until ? mailbox->ready : b->busy_until;
+        if (start + HOST_CAN_FRAME_BITS(mailbox->dlc) * bit_time > now) // 还没发送完
+            break;
+        if (!HostCANPut(bus, mailbox))
+            break;
+        b->busy_until = start + HOST_CAN_FRAME_BITS(mailbox->dlc) * bit_time;
+        mailbox->used = 0;
+        if (b->it_enable & CAN_IT_TX_MAILBOX_EMPTY)
+        {
+            if (idx == 0)
+                HAL_CAN_TxMailbox0CompleteCallback(b->hcan);
+            else if (idx == 1)
+                HAL_CAN_TxMailbox1CompleteCallback(b->hcan);
+            else
+                HAL_CAN_TxMailbox2CompleteCallback(b->hcan);
+        }
+    }
+    b->in_step = 0;
+
+    if (b->sock < 0)
+        return;
+    while (read(b->sock, &frame, sizeof(frame)) == sizeof(frame))
+    {
+        if (frame.can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_ERR_FLAG)) // 只支持标准数据帧
+            continue;
+        HostCANInject(bus, frame.can_id & CAN_SFF_MASK, frame.can_dlc, frame.data);
+    }
+}
+
+void HostCANStep(void)
+{
+    HostCANStepBus(0);
+    HostCANStepBus(1);
+}
+
+/* ---------------------------- 弱定义 ---------------------------- */
+// 和HAL一样提供弱定义,没有链接bsp_can.c时也能使用虚拟总线
+
+__attribute__((weak)) void HAL_CAN_TxMailbox0CompleteCallback(CAN_HandleTypeDef *hcan) { (void)hcan; }
+__attribute__((weak)) void HAL_CAN_TxMailbox1CompleteCallback(CAN_HandleTypeDef *hcan) { (void)hcan; }
+__attribute__((weak)) void HAL_CAN_TxMailbox2CompleteCallback(CAN_HandleTypeDef *hcan) { (void)hcan; }
+__attribute__((weak)) void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan) { (void)hcan; }
+__attribute__((weak)) void HAL_CAN_RxFifo1MsgPendingCallback(CAN_HandleTypeDef *hcan) { (void)hcan; }
+__attribute__((weak)) void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan) { (void)hcan; }
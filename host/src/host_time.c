@@ -0,0 +1,55 @@
+/**
+ * @file host_time.c
+ * @brief 主机构建的时间源,见host_time.h
+ */
+#include <time.h>
+
+#include "main.h"
+#include "host_time.h"
+
+uint32_t SystemCoreClock = 168000000; // 和目标板一致,bsp_dwt按此换算
+CoreDebug_Type host_core_debug;
+
+static DWT_Type host_dwt;
+static uint8_t use_virtual;
+static uint64_t virtual_ns, real_start_ns;
+
+static uint64_t HostTimeReal(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t HostTimeNow(void)
+{
+    if (use_virtual)
+        return virtual_ns;
+    if (real_start_ns == 0)
+        real_start_ns = HostTimeReal();
+    return HostTimeReal() - real_start_ns;
+}
+
+void HostTimeUseVirtual(void)
+{
+    use_virtual = 1;
+    virtual_ns = 0;
+}
+
+void HostTimeAdvance(uint64_t ns)
+{
+    struct timespec ts = {.tv_sec = ns / 1000000000ULL, .tv_nsec = ns % 1000000000ULL};
+    if (use_virtual)
+        virtual_ns += ns;
+    else
+        nanosleep(&ts, NULL);
+}
+
+void *HostDWT(void)
+{
+    // 虚拟时间下每次读取CYCCNT视为经过了1个周期,否则DWT_Delay()之类的忙等待永远不会结束
+    if (use_virtual)
+        virtual_ns += 1000000000ULL / SystemCoreClock + 1;
+    host_dwt.CYCCNT = (uint32_t)(HostTimeNow() * (SystemCoreClock / 1000000) / 1000);
+    return &host_dwt;
+}
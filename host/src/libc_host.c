@@ -0,0 +1,23 @@
+/**
+ * @file libc_host.c
+ * @brief 主机构建中补充newlib特有而glibc没有的函数
+ */
+#include <stdlib.h>
+
+char *__itoa(int value, char *str, int base)
+{
+    char tmp[33];
+    unsigned int v = value < 0 && base == 10 ? -(unsigned int)value : (unsigned int)value;
+    int i = 0, j = 0;
+    do
+    {
+        tmp[i++] = "0123456789abcdefghijklmnopqrstuvwxyz"[v % base];
+        v /= base;
+    } while (v);
+    if (value < 0 && base == 10)
+        str[j++] = '-';
+    while (i)
+        str[j++] = tmp[--i];
+    str[j] = '\0';
+    return str;
+}
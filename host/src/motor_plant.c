@@ -0,0 +1,143 @@
+/**
+ * @file motor_plant.c
+ * @brief 主机构建的DJI电机模型,见motor_plant.h
+ *        参数来自电机手册(减速比/转矩常数/空载转速/电调协议),惯量和摩擦为估计值,只保证量级正确
+ */
+#include <math.h>
+#include <string.h>
+#include "motor_plant.h"
+
+#define PLANT_MAX_STEP 1e-4f // 积分步长上限,远小于GM6020的电气时间常数和电调电流环的时间常数
+#define PLANT_2PI 6.28318531f
+
+typedef struct
+{
+    float gear, kt_out, no_load_rpm, r, l, rotor_j, b, coulomb, v_bus, i_max, tau_i;
+    int16_t cmd_max;
+    float cmd_full;     // cmd_max对应的电流(A)或电压(V)
+    float current_full; // 反馈电流16384对应的电流
+    uint8_t voltage_cmd;
+} Plant_Param_t;
+
+static const Plant_Param_t plant_param[] = {
+    // M3508+C620: 19.2:1, 0.3N·m/A(输出轴), 空载482rpm, ±16384对应±20A
+    [PLANT_M3508] = {3591.0f / 187.0f, 0.3f, 482, 0.194f, 0, 1.2e-5f, 1e-5f, 2e-3f, 24, 20, 5e-4f, 16384, 20, 20, 0},
+    // M2006+C610: 36:1, 0.18N·m/A, 空载500rpm, ±10000对应±10A
+    [PLANT_M2006] = {36, 0.18f, 500, 0.45f, 0, 3e-6f, 5e-6f, 1e-3f, 24, 10, 5e-4f, 10000, 10, 16.384f, 0},
+    // GM6020: 直驱, 0.741N·m/A, 空载320rpm, 控制量为电压±30000, 转矩电流±16384对应±3A
+    [PLANT_GM6020] = {1, 0.741f, 320, 1.8f, 3e-3f, 2.5e-4f, 1e-4f, 1e-2f, 24, 3, 0, 30000, 24, 3, 1},
+};
+
+void MotorPlantInit(Motor_Plant_s *plant, Motor_Plant_Type_e type, float load_inertia)
+{
+    Plant_Param_t const *p = &plant_param[type];
+
+    memset(plant, 0, sizeof(Motor_Plant_s));
+    plant->gear = p->gear;
+    plant->kt = p->kt_out / p->gear;
+    plant->ke = p->v_bus / (p->no_load_rpm * p->gear * PLANT_2PI / 60);
+    plant->r = p->r;
+    plant->l = p->l;
+    plant->j = p->rotor_j + load_inertia / (p->gear * p->gear);
+    plant->b = p->b;
+    plant->coulomb = p->coulomb;
+    plant->v_bus = p->v_bus;
+    plant->i_max = p->i_max;
+    plant->tau_i = p->tau_i;
+    plant->cmd_max = p->cmd_max;
+    plant->cmd_scale = p->cmd_full / p->cmd_max;
+    plant->current_scale = p->current_full / 16384;
+    plant->voltage_cmd = p->voltage_cmd;
+}
+
+void MotorPlantCommand(Motor_Plant_s *plant, int16_t cmd)
+{
+    if (cmd > plant->cmd_max)
+        cmd = plant->cmd_max;
+    if (cmd < -plant->cmd_max)
+        cmd = -plant->cmd_max;
+    plant->cmd = cmd;
+}
+
+static float Clamp(float x, float lo, float hi)
+{
+    return x < lo ? lo : (x > hi ? hi : x);
+}
+
+// 电调的电流(电压)环,更新plant->current;lag为电流环一阶惯性在步长h内的响应比例
+static void PlantElectrical(Motor_Plant_s *plant, float h, float lag)
+{
+    float v, i_ref, i_hi, i_lo;
+    if (plant->voltage_cmd)
+    {
+        v = Clamp(plant->cmd * plant->cmd_scale, -plant->v_bus, plant->v_bus);
+        plant->current += (v - plant->r * plant->current - plant->ke * plant->omega) / plant->l * h;
+        plant->current = Clamp(plant->current, -plant->i_max, plant->i_max);
+    }
+    else
+    {
+        // 电调能输出的电流受母线电压减去反电动势的限制
+        i_hi = (plant->v_bus - plant->ke * plant->omega) / plant->r;
+        i_lo = (-plant->v_bus - plant->ke * plant->omega) / plant->r;
+        i_ref = Clamp(plant->cmd * plant->cmd_scale, -plant->i_max, plant->i_max);
+        i_ref = Clamp(i_ref, i_lo, i_hi);
+        plant->current += (i_ref - plant->current) * lag;
+    }
+}
+
+// 转子的运动,库仑摩擦在静止时表现为静摩擦
+static void PlantMechanical(Motor_Plant_s *plant, float h)
+{
+    float drive = plant->kt * plant->current - plant->load_torque / plant->gear;
+    float omega = plant->omega, friction;
+
+    if (omega == 0 && fabsf(drive) <= plant->coulomb)
+        return;
+    friction = plant->coulomb * (omega != 0 ? copysignf(1, omega) : copysignf(1, drive)) + plant->b * omega;
+    plant->omega += (drive - friction) / plant->j * h;
+    if (omega != 0 && plant->omega * omega < 0 && fabsf(drive) <= plant->coulomb)
+        plant->omega = 0; // 摩擦不会使转子反转
+    plant->theta += (omega + plant->omega) / 2 * h;
+}
+
+void MotorPlantStep(Motor_Plant_s *plant, float dt)
+{
+    uint32_t n = (uint32_t)ceilf(dt / PLANT_MAX_STEP);
+    float h = dt / n, lag = plant->voltage_cmd ? 0 : 1 - expf(-h / plant->tau_i);
+    for (uint32_t k = 0; k < n; k++)
+    {
+        PlantElectrical(plant, h, lag);
+        PlantMechanical(plant, h);
+    }
+}
+
+uint16_t MotorPlantEcd(Motor_Plant_s const *plant)
+{
+    float turn = plant->theta / PLANT_2PI;
+    turn -= floorf(turn);
+    return (uint16_t)(turn * 8192) & 0x1fff;
+}
+
+int16_t MotorPlantSpeedRPM(Motor_Plant_s const *plant)
+{
+    return (int16_t)Clamp(roundf(plant->omega * 60 / PLANT_2PI), INT16_MIN, INT16_MAX);
+}
+
+int16_t MotorPlantCurrentRaw(Motor_Plant_s const *plant)
+{
+    return (int16_t)Clamp(roundf(plant->current / plant->current_scale), INT16_MIN, INT16_MAX);
+}
+
+void MotorPlantFeedbackFrame(Motor_Plant_s const *plant, uint8_t *data)
+{
+    uint16_t ecd = MotorPlantEcd(plant);
+    int16_t rpm = MotorPlantSpeedRPM(plant), current = MotorPlantCurrentRaw(plant);
+    data[0] = (uint8_t)(ecd >> 8);
+    data[1] = (uint8_t)ecd;
+    data[2] = (uint8_t)((uint16_t)rpm >> 8);
+    data[3] = (uint8_t)rpm;
+    data[4] = (uint8_t)((uint16_t)current >> 8);
+    data[5] = (uint8_t)current;
+    data[6] = 30; // 温度
+    data[7] = 0;
+}
@@ -15,8 +15,9 @@
  ******************************************************************************
  */
 #include "QuaternionEKF.h"
+#include "bsp_tools.h"
 
-QEKF_INS_t QEKF_INS;
+QEKF_INS_t QEKF_INS CCMRAM;
 
 const float IMU_QuaternionEKF_F[36] = {1, 0, 0, 0, 0, 0,
                                        0, 1, 0, 0, 0, 0,
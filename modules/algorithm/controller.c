@@ -12,35 +12,37 @@
 #include "memory.h"
 
 /* ----------------------------下面是pid优化环节的实现---------------------------- */
+// 以下函数都会被内联进PIDKernelBody(),Improve为常量时不启用的环节在编译时被去掉
 
 // 梯形积分
-static void f_Trapezoid_Intergral(PIDInstance *pid)
+static inline void f_Trapezoid_Intergral(PIDInstance *pid)
 {
     // 计算梯形的面积,(上底+下底)*高/2
     pid->ITerm = pid->Ki * ((pid->Err + pid->Last_Err) / 2) * pid->dt;
 }
 
 // 变速积分(误差小时积分作用更强)
-static void f_Changing_Integration_Rate(PIDInstance *pid)
+static inline void f_Changing_Integration_Rate(PIDInstance *pid)
 {
+    float abs_err = fabsf(pid->Err);
     if (pid->Err * pid->Iout > 0)
     {
         // 积分呈累积趋势
-        if (abs(pid->Err) <= pid->CoefB)
+        if (abs_err <= pid->CoefB)
             return; // Full integral
-        if (abs(pid->Err) <= (pid->CoefA + pid->CoefB))
-            pid->ITerm *= (pid->CoefA - abs(pid->Err) + pid->CoefB) / pid->CoefA;
+        if (abs_err <= (pid->CoefA + pid->CoefB))
+            pid->ITerm *= (pid->CoefA - abs_err + pid->CoefB) / pid->CoefA;
         else // 最大阈值,不使用积分
             pid->ITerm = 0;
     }
 }
 
-static void f_Integral_Limit(PIDInstance *pid)
+static inline void f_Integral_Limit(PIDInstance *pid)
 {
-    static float temp_Output, temp_Iout;
+    float temp_Output, temp_Iout;
     temp_Iout = pid->Iout + pid->ITerm;
     temp_Output = pid->Pout + pid->Iout + pid->Dout;
-    if (abs(temp_Output) > pid->MaxOut)
+    if (fabsf(temp_Output) > pid->MaxOut)
     {
         if (pid->Err * pid->Iout > 0) // 积分却还在累积
         {
@@ -60,28 +62,31 @@ static void f_Integral_Limit(PIDInstance *pid)
     }
 }
 
-// 微分先行(仅使用反馈值而不计参考输入的微分)
-static void f_Derivative_On_Measurement(PIDInstance *pid)
+// 更新滤波系数,dt和上次相同时(如固定周期调用PIDCalculateDt())不需要重新计算
+static inline void f_Filter_Coef_Update(PIDInstance *pid)
 {
-    pid->Dout = pid->Kd * (pid->Last_Measure - pid->Measure) / pid->dt;
+    if (pid->dt == pid->Coef_dt)
+        return;
+    pid->Coef_dt = pid->dt;
+    pid->Output_LPF_K = pid->dt / (pid->Output_LPF_RC + pid->dt);
+    pid->Derivative_LPF_K = pid->dt / (pid->Derivative_LPF_RC + pid->dt);
 }
 
 // 微分滤波(采集微分时,滤除高频噪声)
-static void f_Derivative_Filter(PIDInstance *pid)
+static inline void f_Derivative_Filter(PIDInstance *pid)
 {
-    pid->Dout = pid->Dout * pid->dt / (pid->Derivative_LPF_RC + pid->dt) +
-                pid->Last_Dout * pid->Derivative_LPF_RC / (pid->Derivative_LPF_RC + pid->dt);
+    // Dout*dt/(RC+dt) + Last_Dout*RC/(RC+dt)
+    pid->Dout = pid->Last_Dout + pid->Derivative_LPF_K * (pid->Dout - pid->Last_Dout);
 }
 
 // 输出滤波
-static void f_Output_Filter(PIDInstance *pid)
+static inline void f_Output_Filter(PIDInstance *pid)
 {
-    pid->Output = pid->Output * pid->dt / (pid->Output_LPF_RC + pid->dt) +
-                  pid->Last_Output * pid->Output_LPF_RC / (pid->Output_LPF_RC + pid->dt);
+    pid->Output = pid->Last_Output + pid->Output_LPF_K * (pid->Output - pid->Last_Output);
 }
 
 // 输出限幅
-static void f_Output_Limit(PIDInstance *pid)
+static inline void f_Output_Limit(PIDInstance *pid)
 {
     if (pid->Output > pid->MaxOut)
     {
@@ -94,7 +99,7 @@ static void f_Output_Limit(PIDInstance *pid)
 }
 
 // 电机堵转检测
-static void f_PID_ErrorHandle(PIDInstance *pid)
+static inline void f_PID_ErrorHandle(PIDInstance *pid)
 {
     /*Motor Blocked Handle*/
     if (fabsf(pid->Output) < pid->MaxOut * 0.001f || fabsf(pid->Ref) < 0.0001f)
@@ -117,40 +122,22 @@ static void f_PID_ErrorHandle(PIDInstance *pid)
     }
 }
 
-/* ---------------------------下面是PID的外部算法接口--------------------------- */
+/* ---------------------------下面是PID的计算函数--------------------------- */
 
 /**
- * @brief 初始化PID,设置参数和启用的优化环节,将其他数据置零
- *
- * @param pid    PID实例
- * @param config PID初始化设置
+ * @brief PID计算的完整流程,improve为编译期常量时生成只包含这些优化环节的特化版本
+ *        直接传入pid->Improve则为逐项判断的通用版本
  */
-void PIDInit(PIDInstance *pid, PID_Init_Config_s *config)
+__attribute__((always_inline)) static inline float PIDKernelBody(PIDInstance *pid, float measure, float ref, float dt,
+                                                                 const uint8_t improve)
 {
-    // config的数据和pid的部分数据是连续且相同的的,所以可以直接用memcpy
-    // @todo: 不建议这样做,可扩展性差,不知道的开发者可能会误以为pid和config是同一个结构体
-    // 后续修改为逐个赋值
-    memset(pid, 0, sizeof(PIDInstance));
-    // utilize the quality of struct that its memeory is continuous
-    memcpy(pid, config, sizeof(PID_Init_Config_s));
-    // set rest of memory to 0
-    DWT_GetDeltaT(&pid->DWT_CNT);
-}
+    float inv_dt;
 
-/**
- * @brief          PID计算
- * @param[in]      PID结构体
- * @param[in]      测量值
- * @param[in]      期望值
- * @retval         返回空
- */
-float PIDCalculate(PIDInstance *pid, float measure, float ref)
-{
     // 堵转检测
-    if (pid->Improve & PID_ErrorHandle)
+    if (improve & PID_ErrorHandle)
         f_PID_ErrorHandle(pid);
 
-    pid->dt = DWT_GetDeltaT(&pid->DWT_CNT); // 获取两次pid计算的时间间隔,用于积分和微分
+    pid->dt = dt;
 
     // 保存上次的测量值和误差,计算当前error
     pid->Measure = measure;
@@ -158,34 +145,40 @@ float PIDCalculate(PIDInstance *pid, float measure, float ref)
     pid->Err = pid->Ref - pid->Measure;
 
     // 如果在死区外,则计算PID
-    if (abs(pid->Err) > pid->DeadBand)
+    if (fabsf(pid->Err) > pid->DeadBand)
     {
+        inv_dt = 1.0f / pid->dt;
+        if (improve & (PID_DerivativeFilter | PID_OutputFilter))
+            f_Filter_Coef_Update(pid);
+
         // 基本的pid计算,使用位置式
         pid->Pout = pid->Kp * pid->Err;
-        pid->ITerm = pid->Ki * pid->Err * pid->dt;
-        pid->Dout = pid->Kd * (pid->Err - pid->Last_Err) / pid->dt;
-
         // 梯形积分
-        if (pid->Improve & PID_Trapezoid_Intergral)
+        if (improve & PID_Trapezoid_Intergral)
             f_Trapezoid_Intergral(pid);
+        else
+            pid->ITerm = pid->Ki * pid->Err * pid->dt;
+        // 微分先行(仅使用反馈值而不计参考输入的微分)
+        if (improve & PID_Derivative_On_Measurement)
+            pid->Dout = pid->Kd * (pid->Last_Measure - pid->Measure) * inv_dt;
+        else
+            pid->Dout = pid->Kd * (pid->Err - pid->Last_Err) * inv_dt;
+
         // 变速积分
-        if (pid->Improve & PID_ChangingIntegrationRate)
+        if (improve & PID_ChangingIntegrationRate)
             f_Changing_Integration_Rate(pid);
-        // 微分先行
-        if (pid->Improve & PID_Derivative_On_Measurement)
-            f_Derivative_On_Measurement(pid);
         // 微分滤波器
-        if (pid->Improve & PID_DerivativeFilter)
+        if (improve & PID_DerivativeFilter)
             f_Derivative_Filter(pid);
         // 积分限幅
-        if (pid->Improve & PID_Integral_Limit)
+        if (improve & PID_Integral_Limit)
             f_Integral_Limit(pid);
 
         pid->Iout += pid->ITerm;                         // 累加积分
         pid->Output = pid->Pout + pid->Iout + pid->Dout; // 计算输出
 
         // 输出滤波
-        if (pid->Improve & PID_OutputFilter)
+        if (improve & PID_OutputFilter)
             f_Output_Filter(pid);
 
         // 输出限幅
@@ -205,4 +198,247 @@ float PIDCalculate(PIDInstance *pid, float measure, float ref)
     pid->Last_ITerm = pid->ITerm;
 
     return pid->Output;
-}
\ No newline at end of file
+}
+
+static float PIDKernelGeneric(PIDInstance *pid, float measure, float ref, float dt)
+{
+    return PIDKernelBody(pid, measure, ref, dt, pid->Improve);
+}
+
+/**
+ * @brief 需要特化的Improve组合,每一项生成一个计算函数并加入pid_kernel_table,PIDInit()按Improve精确匹配
+ *        应用中新增了常用的组合时在此添加一行即可
+ */
+#define PID_KERNEL_LIST(X)                                       \
+    X(PIDKernelNone, PID_IMPROVE_NONE)                           \
+    X(PIDKernelIntegralLimit, PID_Integral_Limit)                \
+    X(PIDKernelTrapezoidLimitDOM,                                \
+      PID_Trapezoid_Intergral | PID_Integral_Limit | PID_Derivative_On_Measurement)
+
+#define PID_KERNEL_DEFINE(name, improve)                                \
+    static float name(PIDInstance *pid, float measure, float ref, float dt) \
+    {                                                                   \
+        return PIDKernelBody(pid, measure, ref, dt, (improve));         \
+    }
+PID_KERNEL_LIST(PID_KERNEL_DEFINE)
+
+#define PID_KERNEL_ENTRY(name, improve) {(improve), name},
+static const struct
+{
+    uint8_t improve;
+    float (*kernel)(PIDInstance *pid, float measure, float ref, float dt);
+} pid_kernel_table[] = {PID_KERNEL_LIST(PID_KERNEL_ENTRY)};
+
+/* ---------------------------下面是PID的外部算法接口--------------------------- */
+
+/**
+ * @brief 初始化PID,设置参数和启用的优化环节,将其他数据置零
+ *
+ * @param pid    PID实例
+ * @param config PID初始化设置
+ */
+void PIDInit(PIDInstance *pid, PID_Init_Config_s *config)
+{
+    // config的数据和pid的部分数据是连续且相同的的,所以可以直接用memcpy
+    // @todo: 不建议这样做,可扩展性差,不知道的开发者可能会误以为pid和config是同一个结构体
+    // 后续修改为逐个赋值
+    memset(pid, 0, sizeof(PIDInstance));
+    // utilize the quality of struct that its memeory is continuous
+    memcpy(pid, config, sizeof(PID_Init_Config_s));
+    // set rest of memory to 0
+    DWT_GetDeltaT(&pid->DWT_CNT);
+
+    pid->Kernel = PIDKernelGeneric; // 没有对应特化函数的组合逐项判断
+    for (uint8_t i = 0; i < sizeof(pid_kernel_table) / sizeof(pid_kernel_table[0]); i++)
+    {
+        if (pid_kernel_table[i].improve == pid->Improve)
+        {
+            pid->Kernel = pid_kernel_table[i].kernel;
+            break;
+        }
+    }
+}
+
+/**
+ * @brief          PID计算
+ * @param[in]      PID结构体
+ * @param[in]      测量值
+ * @param[in]      期望值
+ * @retval         返回空
+ */
+float PIDCalculate(PIDInstance *pid, float measure, float ref)
+{
+    // 获取两次pid计算的时间间隔,用于积分和微分
+    return PIDCalculateDt(pid, measure, ref, DWT_GetDeltaT(&pid->DWT_CNT));
+}
+
+float PIDCalculateDt(PIDInstance *pid, float measure, float ref, float dt)
+{
+    return pid->Kernel(pid, measure, ref, dt);
+}
+
+float PIDCalculateGenericDt(PIDInstance *pid, float measure, float ref, float dt)
+{
+    return PIDKernelGeneric(pid, measure, ref, dt);
+}
+
+/* ---------------------------下面是PID的批量计算--------------------------- */
+
+#define PID_BATCH_IMPROVE (PID_Integral_Limit | PID_Derivative_On_Measurement | PID_Trapezoid_Intergral) // 批量计算支持的优化环节
+
+// 从pid复制参数,梯形积分和微分先行换算为系数,计算时不需要判断
+static void PIDBatchLoadParam(PIDBatchInstance *batch, uint8_t lane, PIDInstance *pid)
+{
+    batch->Kp[lane] = pid->Kp;
+    batch->Ki_Err[lane] = (pid->Improve & PID_Trapezoid_Intergral) ? pid->Ki / 2 : pid->Ki;
+    batch->Ki_Last_Err[lane] = (pid->Improve & PID_Trapezoid_Intergral) ? pid->Ki / 2 : 0;
+    batch->Kd_Err[lane] = (pid->Improve & PID_Derivative_On_Measurement) ? 0 : pid->Kd;
+    batch->Kd_Measure[lane] = (pid->Improve & PID_Derivative_On_Measurement) ? pid->Kd : 0;
+    batch->MaxOut[lane] = pid->MaxOut;
+    batch->DeadBand[lane] = pid->DeadBand;
+    batch->IntegralLimit[lane] = pid->IntegralLimit;
+    batch->Limit_Integral[lane] = (pid->Improve & PID_Integral_Limit) != 0;
+#if PID_BATCH_USE_DSP
+    batch->DSP_dt[lane] = 0; // 下一次计算时按新的参数重新计算arm_pid_f32()的增益
+#endif
+}
+
+int8_t PIDBatchAdd(PIDBatchInstance *batch, PIDInstance *pid)
+{
+    uint8_t lane = batch->count;
+    if ((pid->Improve & ~PID_BATCH_IMPROVE) || lane >= PID_BATCH_MAX)
+        return -1;
+    batch->count++;
+
+    batch->Source[lane] = pid;
+    PIDBatchLoadParam(batch, lane, pid);
+    batch->Iout[lane] = 0;
+    batch->Last_Err[lane] = 0;
+    batch->Last_Measure[lane] = 0;
+    batch->Output[lane] = 0;
+
+#if PID_BATCH_USE_DSP
+    batch->Use_DSP[lane] = pid->Improve == PID_IMPROVE_NONE && pid->DeadBand == 0;
+    memset(&batch->DSP[lane], 0, sizeof(arm_pid_instance_f32));
+#endif
+    return (int8_t)lane;
+}
+
+void PIDBatchSync(PIDBatchInstance *batch, uint8_t lane)
+{
+    PIDBatchLoadParam(batch, lane, batch->Source[lane]);
+}
+
+void PIDBatchSet(PIDBatchInstance *batch, uint8_t lane, float measure, float ref, float dt)
+{
+    batch->Measure[lane] = measure;
+    batch->Ref[lane] = ref;
+    batch->dt[lane] = dt;
+    batch->pending[batch->pending_cnt++] = lane;
+}
+
+#if PID_BATCH_USE_DSP
+// 增量式: y[n] = y[n-1] + A0*e[n] + A1*e[n-1] + A2*e[n-2],和无优化环节的位置式PID等价
+static inline float PIDBatchDSP(PIDBatchInstance *batch, uint8_t i)
+{
+    arm_pid_instance_f32 *dsp = &batch->DSP[i];
+    float dt = batch->dt[i], err = batch->Ref[i] - batch->Measure[i], kd_dt, out;
+
+    if (dt != batch->DSP_dt[i]) // dt或参数变化,重新计算增益
+    {
+        batch->DSP_dt[i] = dt;
+        kd_dt = batch->Kd_Err[i] / dt;
+        dsp->A0 = batch->Kp[i] + batch->Ki_Err[i] * dt + kd_dt;
+        dsp->A1 = -batch->Kp[i] - 2 * kd_dt;
+        dsp->A2 = kd_dt;
+        // 按新的增益重建上一次的输出(state[0],state[1]为上一次和上上次的误差),之后的增量才和位置式一致
+        dsp->state[2] = batch->Kp[i] * dsp->state[0] + batch->Iout[i] + kd_dt * (dsp->state[0] - dsp->state[1]);
+    }
+    out = arm_pid_f32(dsp, err); // state[2]保存未限幅的输出,和PIDCalculate()一样,积分不受输出限幅的影响
+    batch->Iout[i] += batch->Ki_Err[i] * err * dt;
+    if (out > batch->MaxOut[i])
+        out = batch->MaxOut[i];
+    if (out < -batch->MaxOut[i])
+        out = -batch->MaxOut[i];
+    batch->Last_Err[i] = err;
+    batch->Last_Measure[i] = batch->Measure[i];
+    return out;
+}
+#endif
+
+// 将本次计算的输入,误差,积分和输出写回PIDInstance,和PIDCalculate()计算后的状态一致
+static inline void PIDBatchWriteBack(PIDBatchInstance *batch, uint8_t i)
+{
+    PIDInstance *pid = batch->Source[i];
+    pid->Measure = pid->Last_Measure = batch->Measure[i];
+    pid->Ref = batch->Ref[i];
+    pid->dt = batch->dt[i];
+    pid->Err = pid->Last_Err = batch->Ref[i] - batch->Measure[i];
+    pid->Iout = batch->Iout[i];
+    pid->Output = pid->Last_Output = batch->Output[i];
+}
+
+void PIDBatchCalculate(PIDBatchInstance *batch)
+{
+    uint8_t i;
+    float err, inv_dt, pout, iterm, dout, iout, temp_iout, output;
+
+    for (uint8_t k = 0; k < batch->pending_cnt; k++)
+    {
+        i = batch->pending[k];
+#if PID_BATCH_USE_DSP
+        if (batch->Use_DSP[i])
+        {
+            batch->Output[i] = PIDBatchDSP(batch, i);
+            PIDBatchWriteBack(batch, i);
+            continue;
+        }
+#endif
+        // 和PIDKernelBody()的计算过程相同
+        err = batch->Ref[i] - batch->Measure[i];
+        if (fabsf(err) > batch->DeadBand[i])
+        {
+            inv_dt = 1.0f / batch->dt[i];
+            iout = batch->Iout[i];
+            pout = batch->Kp[i] * err;
+            iterm = (batch->Ki_Err[i] * err + batch->Ki_Last_Err[i] * batch->Last_Err[i]) * batch->dt[i];
+            dout = (batch->Kd_Err[i] * (err - batch->Last_Err[i]) +
+                    batch->Kd_Measure[i] * (batch->Last_Measure[i] - batch->Measure[i])) *
+                   inv_dt;
+
+            if (batch->Limit_Integral[i])
+            {
+                temp_iout = iout + iterm;
+                if (fabsf(pout + iout + dout) > batch->MaxOut[i] && err * iout > 0) // 积分却还在累积
+                    iterm = 0;
+                if (temp_iout > batch->IntegralLimit[i])
+                {
+                    iterm = 0;
+                    iout = batch->IntegralLimit[i];
+                }
+                if (temp_iout < -batch->IntegralLimit[i])
+                {
+                    iterm = 0;
+                    iout = -batch->IntegralLimit[i];
+                }
+            }
+
+            iout += iterm;
+            output = pout + iout + dout;
+            if (output > batch->MaxOut[i])
+                output = batch->MaxOut[i];
+            if (output < -batch->MaxOut[i])
+                output = -batch->MaxOut[i];
+            batch->Iout[i] = iout;
+            batch->Output[i] = output;
+        }
+        else // 进入死区, 则清空输出
+        {
+            batch->Output[i] = 0;
+        }
+        batch->Last_Err[i] = err;
+        batch->Last_Measure[i] = batch->Measure[i];
+        PIDBatchWriteBack(batch, i);
+    }
+    batch->pending_cnt = 0;
+}
@@ -25,6 +25,18 @@
 #define abs(x) ((x > 0) ? x : -x)
 #endif
 
+#define PID_BATCH_MAX 24 // 一个PIDBatchInstance中控制器数目的上限,和电机注册表的大小一致
+
+/**
+ * @brief 为1时,PIDBatchInstance中不启用任何优化环节且没有死区的控制器使用CMSIS-DSP的arm_pid_f32()计算(增量式)
+ *        arm_pid_f32()的增益和dt有关,dt或参数变化时重新计算增益,并按位置式重建其状态,因此输出和Iout都和PIDCalculate()一致
+ *        dt每个周期都在变化时每次都要重新计算增益,没有收益,只适合dt固定的控制器;
+ *        另外误差恰好为0时不会像PIDCalculate()那样按死区处理而输出0
+ */
+#ifndef PID_BATCH_USE_DSP
+#define PID_BATCH_USE_DSP 0
+#endif
+
 // PID 优化环节使能标志位,通过位与可以判断启用的优化环节;也可以改成位域的形式
 typedef enum
 {
@@ -53,7 +65,7 @@ typedef struct
 } PID_ErrorHandler_t;
 
 /* PID结构体 */
-typedef struct
+typedef struct pid_ins_temp
 {
     //---------------------------------- init config block
     // config parameter
@@ -94,6 +106,12 @@ typedef struct
     float dt;
 
     PID_ErrorHandler_t ERRORHandler;
+
+    // 以下由PIDInit()设置,不在init config block中
+    float (*Kernel)(struct pid_ins_temp *pid, float measure, float ref, float dt); // 按Improve选择的计算函数
+    float Coef_dt;          // 计算滤波系数时的dt,dt不变时直接使用缓存的系数
+    float Output_LPF_K;     // 输出滤波系数 dt/(RC+dt)
+    float Derivative_LPF_K; // 微分滤波系数 dt/(RC+dt)
 } PIDInstance;
 
 /* 用于PID初始化的结构体*/
@@ -117,6 +135,8 @@ typedef struct // config parameter
 
 /**
  * @brief 初始化PID实例
+ *        常用的Improve组合有各自的特化计算函数,其中不需要的优化环节在编译时就被去掉,由PIDInit()按Improve选择;
+ *        其他组合使用逐项判断Improve的通用计算函数. 特化的组合见controller.c中的PID_KERNEL_LIST
  * @todo 待修改为统一的PIDRegister风格
  * @param pid    PID实例指针
  * @param config PID初始化配置
@@ -133,4 +153,107 @@ void PIDInit(PIDInstance *pid, PID_Init_Config_s *config);
  */
 float PIDCalculate(PIDInstance *pid, float measure, float ref);
 
+/**
+ * @brief 使用调用者给出的时间间隔计算PID输出,不读取DWT
+ *        控制任务在周期开始时通过DWT_CycleLatch()锁存时间戳,同一周期内的所有PID共用一个时间基准
+ *        同一个PID实例不要混用PIDCalculate()和此函数
+ *
+ * @param pid     PID实例指针
+ * @param measure 反馈值
+ * @param ref     设定值
+ * @param dt      距离上一次计算的时间间隔,单位为秒/s,必须大于0
+ * @return float  PID计算输出
+ */
+float PIDCalculateDt(PIDInstance *pid, float measure, float ref, float dt);
+
+/**
+ * @brief 和PIDCalculateDt()相同,但总是使用逐项判断Improve的通用计算函数
+ *        计算结果和特化的计算函数一致,用于验证特化函数和测量其收益(见host/bench/pid_bench.c),控制代码中不需要使用
+ */
+float PIDCalculateGenericDt(PIDInstance *pid, float measure, float ref, float dt);
+
+/**
+ * @brief 批量计算的PID,所有控制器的参数和状态按成员分别存放在数组中(structure of arrays)
+ *        一次PIDBatchCalculate()计算本周期提交的所有控制器,省去逐个调用的开销,访问的数据也更加集中
+ *        只支持积分限幅,微分先行和梯形积分三种优化环节,其余组合仍使用PIDInstance
+ *
+ * @note 控制器的编号(lane)由PIDBatchAdd()返回,每个周期通过PIDBatchSet()提交输入,
+ *       PIDBatchCalculate()之后从Output[lane]读取输出. 只有被提交的控制器会计算和更新状态
+ *       参数只在PIDBatchAdd()时复制一次,运行时修改了PIDInstance的Kp/Ki/Kd等参数后需要调用PIDBatchSync();
+ *       状态则相反,每次计算后都会写回添加时传入的PIDInstance,因此其Output/Iout/Err等仍可用于调试和观察
+ */
+typedef struct
+{
+    // 参数,由PIDBatchAdd()根据PIDInstance换算
+    float Kp[PID_BATCH_MAX];
+    float Ki_Err[PID_BATCH_MAX];       // 积分项中本次误差的系数,梯形积分时为Ki/2
+    float Ki_Last_Err[PID_BATCH_MAX];  // 积分项中上次误差的系数,梯形积分时为Ki/2,否则为0
+    float Kd_Err[PID_BATCH_MAX];       // 对误差微分的系数,微分先行时为0
+    float Kd_Measure[PID_BATCH_MAX];   // 对反馈微分的系数,微分先行时为Kd,否则为0
+    float MaxOut[PID_BATCH_MAX];
+    float DeadBand[PID_BATCH_MAX];
+    float IntegralLimit[PID_BATCH_MAX];
+    uint8_t Limit_Integral[PID_BATCH_MAX]; // 启用了积分限幅
+
+    // 状态
+    float Iout[PID_BATCH_MAX];
+    float Last_Err[PID_BATCH_MAX];
+    float Last_Measure[PID_BATCH_MAX];
+
+    // 本周期的输入和输出
+    float Measure[PID_BATCH_MAX];
+    float Ref[PID_BATCH_MAX];
+    float dt[PID_BATCH_MAX];
+    float Output[PID_BATCH_MAX];
+
+    PIDInstance *Source[PID_BATCH_MAX]; // PIDBatchAdd()时传入的PID,参数从中复制,计算后状态写回其中
+
+    uint8_t pending[PID_BATCH_MAX]; // 本周期提交的控制器
+    uint8_t pending_cnt;
+    uint8_t count; // 已添加的控制器数目
+
+#if PID_BATCH_USE_DSP
+    uint8_t Use_DSP[PID_BATCH_MAX];
+    float DSP_dt[PID_BATCH_MAX]; // 计算arm_pid_f32()增益时的dt
+    arm_pid_instance_f32 DSP[PID_BATCH_MAX];
+#endif
+} PIDBatchInstance;
+
+/**
+ * @brief 将一个已经初始化的PID加入批量计算,之后由PIDBatchInstance计算,每次计算后将状态写回pid
+ *
+ * @param batch 批量计算实例
+ * @param pid   已经通过PIDInit()初始化的PID,复制其参数;必须一直有效,不能是局部变量
+ * @return int8_t 控制器的编号;pid使用了批量计算不支持的优化环节或batch已满时返回-1,此时应继续使用PIDCalculate()
+ */
+int8_t PIDBatchAdd(PIDBatchInstance *batch, PIDInstance *pid);
+
+/**
+ * @brief 运行时修改了PIDBatchAdd()时传入的PID的参数(Kp/Ki/Kd/MaxOut/DeadBand/IntegralLimit)后,将其重新复制到batch中
+ *        积分等状态保持不变;Improve不能修改
+ *
+ * @param batch 批量计算实例
+ * @param lane  PIDBatchAdd()返回的编号
+ */
+void PIDBatchSync(PIDBatchInstance *batch, uint8_t lane);
+
+/**
+ * @brief 提交一个控制器本周期的输入,在下一次PIDBatchCalculate()时计算
+ *        同一周期内一个控制器只能提交一次
+ *
+ * @param batch   批量计算实例
+ * @param lane    PIDBatchAdd()返回的编号
+ * @param measure 反馈值
+ * @param ref     设定值
+ * @param dt      距离该控制器上一次计算的时间间隔,单位为秒/s,必须大于0
+ */
+void PIDBatchSet(PIDBatchInstance *batch, uint8_t lane, float measure, float ref, float dt);
+
+/**
+ * @brief 计算所有已提交的控制器,结果写入batch->Output[lane],然后清空提交列表
+ *
+ * @param batch 批量计算实例
+ */
+void PIDBatchCalculate(PIDBatchInstance *batch);
+
 #endif
\ No newline at end of file
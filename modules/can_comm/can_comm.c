@@ -106,19 +106,20 @@ CANCommInstance *CANCommInit(CANComm_Init_Config_s *comm_config)
 void CANCommSend(CANCommInstance *instance, uint8_t *data)
 {
     static uint8_t crc8;
-    static uint8_t send_len;
+    CAN_Tx_Frame_s frame;
     // 将data copy到raw_sendbuf中,计算crc8
     memcpy(instance->raw_sendbuf + 2, data, instance->send_data_len);
     crc8 = crc_8(data, instance->send_data_len);
     instance->raw_sendbuf[2 + instance->send_data_len] = crc8;
 
     // CAN单次发送最大为8字节,如果超过8字节,需要分包发送
+    // 每一包直接指向raw_sendbuf中对应的位置,不需要再拷贝到发送缓存
+    frame.std_id = instance->can_ins->tx_id;
     for (size_t i = 0; i < instance->send_buf_len; i += 8)
-    { // 如果是最后一包,send len将会小于8,要修改CAN的txconf中的DLC位,调用bsp_can提供的接口即可
-        send_len = instance->send_buf_len - i >= 8 ? 8 : instance->send_buf_len - i;
-        CANSetDLC(instance->can_ins, send_len);
-        memcpy(instance->can_ins->tx_buff, instance->raw_sendbuf + i, send_len);
-        CANTransmit(instance->can_ins, 1);
+    { // 如果是最后一包,dlc将会小于8
+        frame.dlc = instance->send_buf_len - i >= 8 ? 8 : instance->send_buf_len - i;
+        frame.data = instance->raw_sendbuf + i;
+        CANTransmitFrame(instance->can_ins->can_handle, &frame);
     }
 }
 
@@ -2,7 +2,6 @@
 #include "bsp_dwt.h" // 后续通过定时器来计时?
 #include "stdlib.h"
 #include "memory.h"
-#include "buzzer.h"
 
 // 用于保存所有的daemon instance
 static DaemonInstance *daemon_instances[DAEMON_MX_CNT] = {NULL};
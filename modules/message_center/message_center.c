@@ -1,13 +1,41 @@
 #include "message_center.h"
-#include "stdlib.h"
 #include "string.h"
 #include "bsp_log.h"
+#include "bsp_dwt.h"
+#include "cmsis_os.h"
 
-/* message_center是fake head node,是方便链表编写的技巧,这样就不需要处理链表头的特殊情况 */
-static Publisher_t message_center = {
-    .topic_name = "Message_Manager",
-    .first_subs = NULL,
-    .next_topic_node = NULL};
+/* 所有话题,前TOPIC_COUNT个是话题表中的话题,以话题ID为下标;之后的位置按注册顺序分配给通过字符串注册的话题 */
+static Publisher_t message_center[MAX_TOPIC_COUNT];
+static uint8_t topic_idx = TOPIC_COUNT; // 下一个字符串话题的下标
+
+/* 消息池,订阅者的队列和latest话题的缓冲区在注册时依次从中分配,运行时不使用堆 */
+static uint8_t message_pool[MESSAGE_POOL_SIZE] __attribute__((aligned(4)));
+static uint32_t message_pool_used;
+
+_Static_assert(TOPIC_COUNT <= MAX_TOPIC_COUNT, "message_topic.h has more topics than MAX_TOPIC_COUNT");
+
+#define MESSAGE_TOPIC_NAME(id, name, type, mode) [id] = name,
+#define MESSAGE_TOPIC_MODE(id, name, type, mode) [id] = mode,
+static const char *const topic_name_table[TOPIC_COUNT] = {MESSAGE_TOPIC_TABLE(MESSAGE_TOPIC_NAME)};
+static const uint8_t topic_mode_table[TOPIC_COUNT] = {MESSAGE_TOPIC_TABLE(MESSAGE_TOPIC_MODE)};
+
+/* latest模式的发布者和读取者可能在不同的任务中,保证缓冲区和序号的读写顺序 */
+#define LATEST_BARRIER() __sync_synchronize()
+#define LATEST_IDX_MASK 0x3u
+#define LATEST_SEQ(word) ((word) >> 2)
+
+#if MESSAGE_STAT_ENABLE
+// 记录订阅者获取了一条消息,cycle为该消息发布时的DWT->CYCCNT
+static inline void StatReceive(Subscriber_t *sub, uint32_t cycle, uint32_t seq)
+{
+    uint32_t latency = DWT->CYCCNT - cycle;
+    sub->stat.recv_cnt++;
+    sub->stat.seq = seq;
+    sub->latency_sum += latency;
+    if (latency > sub->window_max)
+        sub->window_max = latency;
+}
+#endif
 
 static void CheckName(char *name)
 {
@@ -29,89 +57,351 @@ static void CheckLen(uint8_t len1, uint8_t len2)
     }
 }
 
-Publisher_t *PubRegister(char *name, uint8_t data_len)
+// 从消息池中分配size字节,按4字节对齐
+static uint8_t *MessagePoolAlloc(uint32_t size, const char *name)
 {
-    CheckName(name);
-    Publisher_t *node = &message_center;
-    while (node->next_topic_node) // message_center会直接跳过,不需要特殊处理,这被称作dumb_head(编程技巧)
+    uint8_t *ret = &message_pool[message_pool_used];
+    size = (size + 3) & ~3u;
+    if (size > MESSAGE_POOL_SIZE - message_pool_used)
     {
-        node = node->next_topic_node;            // 切换到下一个发布者(话题)结点
-        if (strcmp(node->topic_name, name) == 0) // 如果已经注册了相同的话题,直接返回结点指针
-        {
-            CheckLen(data_len, node->data_len);
-            node->pub_registered_flag = 1;
-            return node;
-        }
-    } // 遍历完发现尚未创建name对应的话题
-    // 在链表尾部创建新的话题并初始化
-    node->next_topic_node = (Publisher_t *)malloc(sizeof(Publisher_t));
-    memset(node->next_topic_node, 0, sizeof(Publisher_t));
-    node->next_topic_node->data_len = data_len;
-    strcpy(node->next_topic_node->topic_name, name);
-    node->pub_registered_flag = 1;
-    return node->next_topic_node;
+        while (1)
+            LOGERROR("[message_center] message pool exhausted, increase MESSAGE_POOL_SIZE:%s", name);
+    }
+    message_pool_used += size;
+    return ret;
 }
 
-Subscriber_t *SubRegister(char *name, uint8_t data_len)
+/**
+ * @brief 取得下标为idx的话题,第一次注册时初始化话题名,数据长度和模式,之后检查数据长度是否一致
+ *        话题表中的话题已经在编译时检查过长度,这里只会拦截字符串注册的长度错误
+ */
+static Publisher_t *TopicAttach(uint8_t idx, const char *name, uint8_t data_len)
 {
-    Publisher_t *pub = PubRegister(name, data_len); // 查找或创建该话题的发布者
-    // 创建新的订阅者结点,申请内存,注意要memset因为新空间不一定是空的,可能有之前留存的垃圾值
-    Subscriber_t *ret = (Subscriber_t *)malloc(sizeof(Subscriber_t));
-    memset(ret, 0, sizeof(Subscriber_t));
-    // 对新建的Subscriber进行初始化
-    ret->data_len = data_len; // 设定数据长度
-    for (size_t i = 0; i < QUEUE_SIZE; ++i)
-    { // 给消息队列的每一个元素分配空间,queue里保存的实际上是数据执指针,这样可以兼容不同的数据长度
-        ret->queue[i] = malloc(data_len);
+    Publisher_t *topic = &message_center[idx];
+    if (topic->topic_name[0] == '\0') // 消息长度可能为0(空结构体),用话题名判断是否已经初始化
+    {
+        CheckName((char *)name);
+        strcpy(topic->topic_name, name);
+        topic->data_len = data_len;
+        topic->mode = idx < TOPIC_COUNT ? topic_mode_table[idx] : TOPIC_MODE_QUEUE; // 字符串注册的话题只支持队列模式
+        if (topic->mode == TOPIC_MODE_LATEST)
+            topic->latest_buf = MessagePoolAlloc(LATEST_BUF_NUM * data_len, name);
     }
-    // 如果是第一个订阅者,特殊处理一下,将first_subs指针指向新建的订阅者(详见文档)
-    if (pub->first_subs == NULL)
+    else
+    {
+        CheckLen(data_len, topic->data_len);
+    }
+    return topic;
+}
+
+// 按名称查找话题的下标,话题表中的话题即使尚未注册也能找到;不存在时分配一个新的下标
+static uint8_t TopicIndex(char *name)
+{
+    for (uint8_t i = 0; i < TOPIC_COUNT; i++)
+        if (strcmp(topic_name_table[i], name) == 0)
+            return i;
+    for (uint8_t i = TOPIC_COUNT; i < topic_idx; i++)
+        if (strcmp(message_center[i].topic_name, name) == 0)
+            return i;
+    if (topic_idx >= MAX_TOPIC_COUNT)
     {
-        pub->first_subs = ret;
-        return ret;
+        while (1)
+            LOGERROR("[message_center] topic count exceeded MAX_TOPIC_COUNT:%s", name);
     }
-    // 若该话题已经有订阅者, 遍历订阅者链表,直到到达尾部
-    Subscriber_t *sub = pub->first_subs; // 作为iterator
-    while (sub->next_subs_queue)         // 遍历订阅了该话题的订阅者链表
+    return topic_idx++;
+}
+
+static Subscriber_t *SubAttach(Publisher_t *topic, uint8_t data_len, uint8_t depth)
+{
+    Subscriber_t *ret;
+    if (topic->sub_cnt >= MAX_SUB_PER_TOPIC)
     {
-        sub = sub->next_subs_queue; // 移动到下一个订阅者,遇到空指针停下,说明到了链表尾部
+        while (1)
+            LOGERROR("[message_center] subscriber count exceeded MAX_SUB_PER_TOPIC:%s", topic->topic_name);
     }
-    sub->next_subs_queue = ret; // 把刚刚创建的订阅者接上
+    ret = &topic->subs[topic->sub_cnt++];
+    ret->data_len = data_len; // 设定数据长度
+    ret->topic = topic;
+    if (topic->mode == TOPIC_MODE_LATEST)
+        return ret; // 不需要自己的队列,直接读取发布者的缓冲区
+    ret->depth = depth ? depth : QUEUE_SIZE;
+    ret->queue = MessagePoolAlloc((uint32_t)ret->depth * data_len, topic->topic_name);
+#if MESSAGE_STAT_ENABLE
+    ret->stamp = (Message_Stamp_t *)MessagePoolAlloc(ret->depth * sizeof(Message_Stamp_t), topic->topic_name);
+#endif
     return ret;
 }
 
+Publisher_t *PubRegisterID(Topic_ID_e id, uint8_t data_len)
+{
+    Publisher_t *pub = TopicAttach(id, topic_name_table[id], data_len);
+    pub->pub_registered_flag = 1;
+    return pub;
+}
+
+Subscriber_t *SubRegisterID(Topic_ID_e id, uint8_t data_len, uint8_t depth)
+{
+    return SubAttach(TopicAttach(id, topic_name_table[id], data_len), data_len, depth);
+}
+
+Publisher_t *PubRegister(char *name, uint8_t data_len)
+{
+    Publisher_t *pub = TopicAttach(TopicIndex(name), name, data_len);
+    pub->pub_registered_flag = 1;
+    return pub;
+}
+
+Subscriber_t *SubRegisterDepth(char *name, uint8_t data_len, uint8_t depth)
+{
+    return SubAttach(TopicAttach(TopicIndex(name), name, data_len), data_len, depth);
+}
+
+Subscriber_t *SubRegister(char *name, uint8_t data_len)
+{
+    return SubRegisterDepth(name, data_len, 0);
+}
+
+static inline uint8_t *LatestSlot(Publisher_t *topic, uint32_t word)
+{
+    return topic->latest_buf + (word & LATEST_IDX_MASK) * topic->data_len;
+}
+
+/**
+ * @brief 读取期间发布者是否可能写入了word所在的缓冲区
+ *        发布者总是写入最新消息之后的下一个缓冲区,因此只有在读取期间又发布了LATEST_BUF_NUM-1条及以上的消息时,
+ *        word所在的缓冲区才会被覆盖;三个缓冲区时,读取期间被抢占一次发布不会导致重读
+ */
+static inline uint8_t LatestOverwritten(Publisher_t *topic, uint32_t word)
+{
+    LATEST_BARRIER(); // 先完成对缓冲区的读取,再检查序号
+    return ((LATEST_SEQ(topic->latest_seq) - LATEST_SEQ(word)) & (UINT32_MAX >> 2)) >= LATEST_BUF_NUM - 1;
+}
+
 /* 如果队列为空,会返回0;成功获取数据,返回1;后续可以做更多的修改,比如剩余消息数目等 */
 uint8_t SubGetMessage(Subscriber_t *sub, void *data_ptr)
 {
+    Publisher_t *topic = sub->topic;
+    uint32_t word;
+#if MESSAGE_STAT_ENABLE
+    uint32_t cycle;
+#endif
+    if (topic->mode == TOPIC_MODE_LATEST)
+    {
+        if (topic->latest_seq == sub->last_seq)
+            return 0; // 上次读取之后没有新消息
+        do
+        {
+            word = topic->latest_seq;
+            LATEST_BARRIER();
+            memcpy(data_ptr, LatestSlot(topic, word), sub->data_len);
+#if MESSAGE_STAT_ENABLE
+            cycle = topic->latest_cycle[word & LATEST_IDX_MASK]; // 和消息一起读取,同样受序号保护
+#endif
+        } while (LatestOverwritten(topic, word));
+        sub->drop_cnt += ((LATEST_SEQ(word) - LATEST_SEQ(sub->last_seq)) & (UINT32_MAX >> 2)) - 1; // 跳过的消息
+        sub->last_seq = word;
+#if MESSAGE_STAT_ENABLE
+        StatReceive(sub, cycle, LATEST_SEQ(word));
+#endif
+        return 1;
+    }
+
     if (sub->temp_size == 0)
     {
         return 0;
     }
-    memcpy(data_ptr, sub->queue[sub->front_idx], sub->data_len);
-    sub->front_idx = (sub->front_idx++) % QUEUE_SIZE; // 队列头索引增加
+    memcpy(data_ptr, sub->queue + sub->front_idx * sub->data_len, sub->data_len);
+#if MESSAGE_STAT_ENABLE
+    StatReceive(sub, sub->stamp[sub->front_idx].cycle, sub->stamp[sub->front_idx].seq);
+#endif
+    sub->front_idx = (sub->front_idx + 1) % sub->depth; // 队列头索引增加
     sub->temp_size--;                                 // pop一个数据,长度减1
     return 1;
 }
 
+uint8_t SubWaitMessage(Subscriber_t *sub, void *data_ptr, uint32_t timeout)
+{
+    float start = DWT_GetTimeline_ms(), elapsed;
+    uint32_t wait = timeout;
+
+    sub->wait_task = osThreadGetId(); // 此后发布者每次发布都会通知本任务
+    while (!SubGetMessage(sub, data_ptr))
+    {
+        if (timeout != osWaitForever)
+        {
+            elapsed = DWT_GetTimeline_ms() - start;
+            if (elapsed >= timeout)
+                return 0;
+            wait = timeout - (uint32_t)elapsed;
+        }
+        // 信号在检查队列之后到达也不会丢失,osSignalWait()会立即返回;被其他信号唤醒或消息已被取走时继续等待
+        if (osSignalWait(MESSAGE_WAIT_SIGNAL, wait).status == osEventTimeout)
+            return SubGetMessage(sub, data_ptr);
+    }
+    return 1;
+}
+
+const void *SubReadBegin(Subscriber_t *sub, uint32_t *seq)
+{
+    Publisher_t *topic = sub->topic;
+    uint32_t skipped;
+    *seq = topic->latest_seq;
+    LATEST_BARRIER();
+    skipped = (LATEST_SEQ(*seq) - LATEST_SEQ(sub->last_seq)) & (UINT32_MAX >> 2);
+    if (skipped > 1)
+        sub->drop_cnt += skipped - 1;
+#if MESSAGE_STAT_ENABLE
+    if (skipped > 0) // 重读时读到的是新的消息,同样计入
+        StatReceive(sub, topic->latest_cycle[*seq & LATEST_IDX_MASK], LATEST_SEQ(*seq));
+#endif
+    sub->last_seq = *seq;
+    return LatestSlot(topic, *seq);
+}
+
+uint8_t SubReadRetry(Subscriber_t *sub, uint32_t seq)
+{
+    return LatestOverwritten(sub->topic, seq);
+}
+
+// 唤醒在SubWaitMessage()中等待该话题的任务
+static void PubNotify(Publisher_t *pub)
+{
+    for (uint8_t i = 0; i < pub->sub_cnt; i++)
+        if (pub->subs[i].wait_task != NULL)
+            osSignalSet(pub->subs[i].wait_task, MESSAGE_WAIT_SIGNAL);
+}
+
 uint8_t PubPushMessage(Publisher_t *pub, void *data_ptr)
 {
-    static Subscriber_t *iter;
-    iter = pub->first_subs; // iter作为订阅者指针,遍历订阅该话题的所有订阅者;如果为空说明遍历结束
+    Subscriber_t *iter;
+    uint32_t word, idx;
+#if MESSAGE_STAT_ENABLE
+    pub->pub_stamp.cycle = DWT->CYCCNT;
+    pub->pub_stamp.seq++;
+#endif
+    if (pub->mode == TOPIC_MODE_LATEST)
+    {
+        // 写入最新消息之后的下一个缓冲区,写完再更新序号,读取者总是看到完整的消息
+        word = pub->latest_seq;
+        idx = (word & LATEST_IDX_MASK) + 1;
+        if (idx == LATEST_BUF_NUM)
+            idx = 0;
+        word = ((word & ~LATEST_IDX_MASK) + (1u << 2)) | idx;
+        memcpy(LatestSlot(pub, word), data_ptr, pub->data_len);
+#if MESSAGE_STAT_ENABLE
+        pub->latest_cycle[idx] = pub->pub_stamp.cycle;
+#endif
+        LATEST_BARRIER();
+        pub->latest_seq = word;
+        PubNotify(pub);
+        return pub->sub_cnt;
+    }
     // 遍历订阅了当前话题的所有订阅者,依次填入最新消息
-    while (iter)
+    for (uint8_t i = 0; i < pub->sub_cnt; i++)
     {
-        if (iter->temp_size == QUEUE_SIZE) // 如果队列已满,则需要删除最老的数据(头部),再填入
+        iter = &pub->subs[i];
+        if (iter->temp_size == iter->depth) // 如果队列已满,则需要删除最老的数据(头部),再填入
         {
             // 队列头索引前移动,相当于抛弃前一个位置的数据,被抛弃的位置稍后会被写入新的数据
-            iter->front_idx = (iter->front_idx + 1) % QUEUE_SIZE;
+            iter->front_idx = (iter->front_idx + 1) % iter->depth;
             iter->temp_size--; // 相当于出队,size-1
+            iter->drop_cnt++;
         }
         // 将Pub的数据复制到队列的尾部(最新)
-        memcpy(iter->queue[iter->back_idx], data_ptr, pub->data_len);
-        iter->back_idx = (iter->back_idx + 1) % QUEUE_SIZE; // 队列尾部前移
+        memcpy(iter->queue + iter->back_idx * pub->data_len, data_ptr, pub->data_len);
+#if MESSAGE_STAT_ENABLE
+        iter->stamp[iter->back_idx] = pub->pub_stamp;
+#endif
+        iter->back_idx = (iter->back_idx + 1) % iter->depth; // 队列尾部前移
         iter->temp_size++;                                  // 入队,size+1
+    }
+    PubNotify(pub);
+    return 1;
+}
+
+uint8_t MessageStatUpdate(void)
+{
+#if MESSAGE_STAT_ENABLE
+    static uint32_t window_start; // 本统计周期开始时的DWT->CYCCNT
+    uint32_t now = DWT->CYCCNT, elapsed = now - window_start, cycle_per_us = SystemCoreClock / 1000000;
+    uint32_t recv_cnt, latency_sum, window_max;
+    float elapsed_s;
+    Publisher_t *topic;
+    Subscriber_t *sub;
 
-        iter = iter->next_subs_queue; // 访问下一个订阅者
+    if (elapsed < MESSAGE_STAT_WINDOW_MS * (SystemCoreClock / 1000))
+        return 0;
+    elapsed_s = (float)elapsed / SystemCoreClock;
+    for (uint8_t i = 0; i < topic_idx; i++)
+    {
+        topic = &message_center[i];
+        topic->pub_rate = (uint16_t)((topic->pub_stamp.seq - topic->last_pub_cnt) / elapsed_s);
+        topic->last_pub_cnt = topic->pub_stamp.seq;
+        for (uint8_t j = 0; j < topic->sub_cnt; j++)
+        {
+            // 累计量只增不减,统计周期内的增量做差得到;最大值在读取后清零,期间的一次更新可能丢失
+            sub = &topic->subs[j];
+            recv_cnt = sub->stat.recv_cnt;
+            latency_sum = sub->latency_sum;
+            window_max = sub->window_max;
+            sub->window_max = 0;
+            sub->stat.latency_mean_us = recv_cnt == sub->last_recv_cnt ? 0 : (latency_sum - sub->last_latency_sum) / (recv_cnt - sub->last_recv_cnt) / cycle_per_us;
+            sub->stat.latency_max_us = window_max / cycle_per_us;
+            if (sub->stat.latency_max_us > sub->stat.latency_peak_us)
+                sub->stat.latency_peak_us = sub->stat.latency_max_us;
+            sub->last_recv_cnt = recv_cnt;
+            sub->last_latency_sum = latency_sum;
+        }
     }
+    window_start = now;
     return 1;
-}
\ No newline at end of file
+#else
+    return 0;
+#endif
+}
+
+static void TopicStatFill(Publisher_t *topic, Message_Topic_Stat_s *stat)
+{
+    memset(stat, 0, sizeof(Message_Topic_Stat_s));
+    stat->topic_name = topic->topic_name;
+    stat->sub_cnt = topic->sub_cnt;
+    for (uint8_t j = 0; j < topic->sub_cnt; j++)
+    {
+#if MESSAGE_STAT_ENABLE
+        stat->sub[j] = topic->subs[j].stat;
+#endif
+        stat->sub[j].drop_cnt = topic->subs[j].drop_cnt;
+    }
+#if MESSAGE_STAT_ENABLE
+    stat->pub_cnt = topic->pub_stamp.seq;
+    stat->pub_rate = topic->pub_rate;
+#endif
+}
+
+uint8_t MessageStatSnapshot(Message_Topic_Stat_s *snapshot, uint8_t max_topic)
+{
+    uint8_t cnt = 0;
+    for (uint8_t i = 0; i < topic_idx && cnt < max_topic; i++)
+        if (message_center[i].topic_name[0] != '\0') // 跳过话题表中没有被注册的话题
+            TopicStatFill(&message_center[i], &snapshot[cnt++]);
+    return cnt;
+}
+
+void MessageStatDump(void)
+{
+    static Message_Topic_Stat_s stat; // 逐个话题打印,不需要整张快照
+    Message_Sub_Stat_s *sub;
+    for (uint8_t i = 0; i < topic_idx; i++)
+    {
+        if (message_center[i].topic_name[0] == '\0')
+            continue;
+        TopicStatFill(&message_center[i], &stat);
+        LOGINFO("[message_center] %s: pub %u/s, seq %u, %u subs", stat.topic_name, stat.pub_rate, stat.pub_cnt, stat.sub_cnt);
+        for (uint8_t j = 0; j < stat.sub_cnt; j++)
+        {
+            sub = &stat.sub[j];
+            LOGINFO("[message_center]   sub%u: recv %u, drop %u, latency mean %uus max %uus peak %uus", j, sub->recv_cnt,
+                    sub->drop_cnt, sub->latency_mean_us, sub->latency_max_us, sub->latency_peak_us);
+        }
+    }
+}
@@ -13,26 +13,99 @@
 #define PUBSUB_H
 
 #include "stdint.h"
+#include "message_topic.h"
 
 #define MAX_TOPIC_NAME_LEN 32 // 最大的话题名长度,每个话题都有字符串来命名
-#define MAX_TOPIC_COUNT 12    // 最多支持的话题数量
-#define QUEUE_SIZE 1
+#define MAX_TOPIC_COUNT 12    // 最多支持的话题数量,包括话题表中的话题和通过字符串注册的话题
+#define MAX_SUB_PER_TOPIC 4   // 每个话题最多的订阅者数量
+#define QUEUE_SIZE 1          // 订阅时没有指定队列长度时的默认长度
+#ifndef MESSAGE_POOL_SIZE
+#define MESSAGE_POOL_SIZE 2048 // 消息池的字节数,所有订阅者的队列和latest话题的缓冲区都从中分配,不足时注册会进入死循环
+#endif
+#define MESSAGE_WAIT_SIGNAL 0x40000000 // SubWaitMessage()使用的信号,取cmsis_os v1信号的最高位,避免和其他模块的信号冲突
+#define LATEST_BUF_NUM 3      // latest模式的话题的缓冲区数量,发布时写入的缓冲区和最新消息所在的缓冲区不同
+
+#ifndef MESSAGE_STAT_ENABLE
+#define MESSAGE_STAT_ENABLE 0 // 为1时记录每条消息的发布时间和序号,统计发布频率,丢弃数和从发布到获取的延迟;Debug构建时由编译选项打开
+#endif
+#define MESSAGE_STAT_WINDOW_MS 1000 // 发布频率和延迟的统计周期
+#define MESSAGE_STAT_DUMP 0         // 为1时守护任务每个统计周期通过RTT打印一次所有话题的统计,用于测量链路延迟
+
+typedef enum
+{
+    TOPIC_MODE_QUEUE = 0, // 消息复制到每个订阅者的队列中
+    TOPIC_MODE_LATEST,    // 只保留最新消息,订阅者直接从发布者的缓冲区读取,见PubPushMessage()
+} Topic_Mode_e;
+
+/* 话题ID,由message_topic.h中的话题表生成,同时也是话题在message_center中的下标 */
+#define MESSAGE_TOPIC_ENUM(id, name, type, mode) id,
+typedef enum
+{
+    MESSAGE_TOPIC_TABLE(MESSAGE_TOPIC_ENUM)
+    TOPIC_COUNT, // 话题表中的话题数量
+} Topic_ID_e;
+
+/* 应用在包含了所有消息类型之后展开MESSAGE_TOPIC_TABLE(MESSAGE_TOPIC_TYPEDEF),为每个话题定义消息类型TOPIC_XXX_t */
+#define MESSAGE_TOPIC_TYPEDEF(id, name, type, mode) typedef type id##_t;
+
+/* 发布时给每条消息打上的时间戳和序号 */
+typedef struct
+{
+    uint32_t cycle; // 发布时的DWT->CYCCNT
+    uint32_t seq;   // 话题的第几条消息,从1开始
+} Message_Stamp_t;
+
+/**
+ * @brief 订阅者的统计信息,可以通过MessageStatSnapshot()获取
+ *        计数实时更新,延迟由MessageStatUpdate()每MESSAGE_STAT_WINDOW_MS计算一次
+ */
+typedef struct
+{
+    uint32_t recv_cnt;        // 累计获取的消息数
+    uint32_t drop_cnt;        // 累计没有被获取就被覆盖(队列模式)或跳过(latest模式)的消息数
+    uint32_t seq;             // 最近获取的消息的序号
+    uint32_t latency_mean_us; // 上一个统计周期从发布到获取的平均延迟
+    uint32_t latency_max_us;  // 上一个统计周期从发布到获取的最大延迟
+    uint32_t latency_peak_us; // 运行以来的最大延迟
+} Message_Sub_Stat_s;
+
+/* 话题的统计信息,MessageStatSnapshot()的输出 */
+typedef struct
+{
+    const char *topic_name;
+    uint32_t pub_cnt;  // 累计发布的消息数,也是最新消息的序号
+    uint16_t pub_rate; // 上一个统计周期的每秒发布次数
+    uint8_t sub_cnt;
+    Message_Sub_Stat_s sub[MAX_SUB_PER_TOPIC];
+} Message_Topic_Stat_s;
 
 typedef struct mqt
 {
-    /* 用数组模拟FIFO队列 */
-    void *queue[QUEUE_SIZE];
+    /* 用数组模拟FIFO队列,depth条消息连续存放,从消息池中分配 */
+    uint8_t *queue;
+    uint8_t depth; // 队列长度
     uint8_t data_len;
     uint8_t front_idx;
     uint8_t back_idx;
     uint8_t temp_size; // 当前队列长度
+    uint32_t drop_cnt; // 没有被获取就被覆盖(队列模式)或跳过(latest模式)的消息数
+    void *wait_task;   // 调用过SubWaitMessage()的任务(osThreadId),此后每次发布都会通知该任务
 
-    /* 指向下一个订阅了相同的话题的订阅者的指针 */
-    struct mqt *next_subs_queue; // 使得发布者可以通过链表访问所有订阅了相同话题的订阅者
+    struct ent *topic; // 订阅的话题
+    uint32_t last_seq; // latest模式下最后一次读取的消息的序号
+
+#if MESSAGE_STAT_ENABLE
+    Message_Stamp_t *stamp; // 队列中每条消息的时间戳,和queue一一对应
+    Message_Sub_Stat_s stat;
+    uint32_t latency_sum;      // 累计延迟,时钟周期,溢出后做差仍然正确
+    uint32_t window_max;       // 本统计周期的最大延迟,时钟周期
+    uint32_t last_recv_cnt;    // 上一个统计周期结束时的stat.recv_cnt
+    uint32_t last_latency_sum; // 上一个统计周期结束时的latency_sum
+#endif
 } Subscriber_t;
 
 /**
- * @brief 发布者类型.每个发布者拥有发布者实例,并且可以通过链表访问所有订阅了自己发布的话题的订阅者
+ * @brief 发布者类型,也就是话题本身.同一话题的所有发布者共用一个实例,订阅了该话题的订阅者连续存放在其中
  *
  */
 typedef struct ent
@@ -40,15 +113,62 @@ typedef struct ent
     /* 话题名称 */
     char topic_name[MAX_TOPIC_NAME_LEN + 1]; // 1个字节用于存放字符串结束符 '\0'
     uint8_t data_len;                        // 该话题的数据长度
-    /* 指向第一个订阅了该话题的订阅者,通过链表访问所有订阅者 */
-    Subscriber_t *first_subs;
-    /* 指向下一个Publisher的指针 */
-    struct ent *next_topic_node;
+    /* 订阅了该话题的订阅者,推送时顺序访问 */
+    Subscriber_t subs[MAX_SUB_PER_TOPIC];
+    uint8_t sub_cnt;
     uint8_t pub_registered_flag; // 用于标记该发布者是否已经注册
+    uint8_t mode;                // 话题模式,Topic_Mode_e
+
+    /* latest模式的缓冲区,seqlock: latest_seq的低2位为最新消息所在的缓冲区,其余位为消息序号 */
+    uint8_t *latest_buf; // LATEST_BUF_NUM * data_len
+    volatile uint32_t latest_seq;
+
+#if MESSAGE_STAT_ENABLE
+    Message_Stamp_t pub_stamp;             // 最近一次发布的时间戳和序号
+    uint32_t latest_cycle[LATEST_BUF_NUM]; // latest模式每个缓冲区中消息的发布时间
+    uint16_t pub_rate;                     // 上一个统计周期的每秒发布次数
+    uint32_t last_pub_cnt;                 // 上一个统计周期结束时的pub_stamp.seq
+#endif
 } Publisher_t;
 
 /**
- * @brief 订阅name的话题消息
+ * @brief 按话题ID注册成为消息发布者,不需要查找话题名.一般通过PubRegisterTopic()调用
+ *
+ * @param id 话题表中的话题ID
+ * @param data_len 消息长度,必须和话题表中的消息类型一致
+ * @return Publisher_t* 返回发布者实例
+ */
+Publisher_t *PubRegisterID(Topic_ID_e id, uint8_t data_len);
+
+/**
+ * @brief 按话题ID订阅话题,一般通过SubRegisterTopic()/SubRegisterTopicDepth()调用
+ *
+ * @param id 话题表中的话题ID
+ * @param data_len 消息长度,必须和话题表中的消息类型一致
+ * @param depth 队列长度,为0时使用QUEUE_SIZE;latest模式的话题只保留最新消息,忽略此参数
+ * @return Subscriber_t* 返回订阅者实例
+ */
+Subscriber_t *SubRegisterID(Topic_ID_e id, uint8_t data_len, uint8_t depth);
+
+/* 消息的长度和话题表中的类型不一致时编译报错(数组长度为-1) */
+#define MESSAGE_TOPIC_CHECK(id, ptr) ((void)sizeof(char[sizeof(*(ptr)) == sizeof(id##_t) ? 1 : -1]))
+
+/**
+ * @brief 话题表中的话题推荐使用以下接口,消息长度由话题的类型决定,收发时检查数据的长度
+ *        SubWaitTopic()见SubWaitMessage()
+ *        e.g. gimbal_pub = PubRegisterTopic(TOPIC_GIMBAL_FEED);
+ *             PubPushTopic(gimbal_pub, TOPIC_GIMBAL_FEED, &gimbal_feedback_data);
+ */
+#define PubRegisterTopic(id) PubRegisterID(id, sizeof(id##_t))
+#define SubRegisterTopic(id) SubRegisterID(id, sizeof(id##_t), 0)
+#define SubRegisterTopicDepth(id, depth) SubRegisterID(id, sizeof(id##_t), depth)
+#define PubPushTopic(pub, id, ptr) (MESSAGE_TOPIC_CHECK(id, ptr), PubPushMessage(pub, (void *)(ptr)))
+#define SubGetTopic(sub, id, ptr) (MESSAGE_TOPIC_CHECK(id, ptr), SubGetMessage(sub, (void *)(ptr)))
+#define SubWaitTopic(sub, id, ptr, timeout) (MESSAGE_TOPIC_CHECK(id, ptr), SubWaitMessage(sub, (void *)(ptr), timeout))
+
+/**
+ * @brief 订阅name的话题消息.若name在话题表中则等同于SubRegisterID(),否则作为动态话题注册
+ *        只在初始化时按名称查找一次,不影响收发消息的开销
  *
  * @param name 话题名称
  * @param data_len 消息长度,通过sizeof()获取
@@ -56,6 +176,14 @@ typedef struct ent
  */
 Subscriber_t *SubRegister(char *name, uint8_t data_len);
 
+/**
+ * @brief 同SubRegister(),并指定队列长度.消费者比发布者慢且不能丢失消息时(如事件类的话题),
+ *        加大队列长度,并在每次运行时用while(SubGetMessage())取出所有消息
+ *
+ * @param depth 队列长度,为0时使用QUEUE_SIZE
+ */
+Subscriber_t *SubRegisterDepth(char *name, uint8_t data_len, uint8_t depth);
+
 /**
  * @brief 注册成为消息发布者
  *
@@ -70,16 +198,76 @@ Publisher_t *PubRegister(char *name, uint8_t data_len);
  * @param sub 订阅者实例指针
  * @param data_ptr 数据指针,接收的消息将会放到此处
  * @return uint8_t 返回值为0说明没有新的消息(消息队列为空),为1说明获取到了新的消息
+ * @note latest模式的话题返回的是上次获取之后的最新消息,读取时发布者被抢占也能保证取得完整的一条消息
  */
 uint8_t SubGetMessage(Subscriber_t *sub, void *data_ptr);
 
+/**
+ * @brief 获取消息,没有新消息时挂起当前任务,直到发布者发布新消息或超时
+ *        发布者通过osSignalSet()(任务通知)唤醒等待的任务,从发布到订阅者开始运行只需要一次任务切换,
+ *        不再受订阅者的osDelay()周期限制.发布者可以在中断中发布
+ *
+ * @param sub 订阅者实例指针,只能由同一个任务等待
+ * @param data_ptr 数据指针,接收的消息将会放到此处
+ * @param timeout 最长等待时间,ms,osWaitForever为一直等待
+ * @return uint8_t 为1说明获取到了新的消息,为0说明超时
+ * @note 队列模式的话题没有对并发读写加锁,订阅任务的优先级应高于发布任务,使读取不会被发布打断;
+ *       或者使用latest模式的话题.等待期间任务收到其他信号时会继续等待,不影响超时时间
+ */
+uint8_t SubWaitMessage(Subscriber_t *sub, void *data_ptr, uint32_t timeout);
+
+/**
+ * @brief latest模式的话题不复制消息,直接读取发布者缓冲区中的最新消息
+ *        读取结束后用SubReadRetry()检查期间缓冲区是否被覆盖,被覆盖则重新读取:
+ *
+ *        do {
+ *            feed = SubReadBegin(sub, &seq);
+ *            yaw = feed->gimbal_imu_data.Yaw;
+ *        } while (SubReadRetry(sub, seq));
+ *
+ * @param seq 输出,传给SubReadRetry()
+ * @return const void* 最新消息的地址,还没有发布过消息时内容全为0
+ */
+const void *SubReadBegin(Subscriber_t *sub, uint32_t *seq);
+
+/**
+ * @brief 和SubReadBegin()配合使用
+ *
+ * @return uint8_t 为1说明读取期间消息被覆盖,读到的数据可能不完整,需要重新读取
+ */
+uint8_t SubReadRetry(Subscriber_t *sub, uint32_t seq);
+
 /**
  * @brief 发布者给所有订阅了话题的订阅者推送消息
  *
  * @param pub 发布者实例指针
  * @param data_ptr 指向要发布的数据的指针
  * @return uint8_t 新消息成功推送给几个订阅者
+ * @note latest模式的话题只复制一次,和订阅者数量无关;同一个latest话题只能有一个任务发布消息
  */
 uint8_t PubPushMessage(Publisher_t *pub, void *data_ptr);
 
-#endif // !PUBSUB_H
\ No newline at end of file
+/**
+ * @brief 更新所有话题的统计,每MESSAGE_STAT_WINDOW_MS计算一次发布频率和延迟
+ *        需要在任务中周期调用,调用间隔应远小于MESSAGE_STAT_WINDOW_MS(目前在daemon任务中以100Hz调用)
+ *
+ * @return uint8_t 本次调用完成了一个统计周期返回1,否则返回0;MESSAGE_STAT_ENABLE为0时总是返回0
+ */
+uint8_t MessageStatUpdate(void);
+
+/**
+ * @brief 获取所有已注册话题及其订阅者的统计信息
+ *
+ * @param snapshot 输出,按话题的注册位置排列
+ * @param max_topic snapshot的长度
+ * @return uint8_t 写入的话题数
+ */
+uint8_t MessageStatSnapshot(Message_Topic_Stat_s *snapshot, uint8_t max_topic);
+
+/**
+ * @brief 通过RTT打印所有话题的统计信息,每个话题一行,每个订阅者一行
+ *
+ */
+void MessageStatDump(void);
+
+#endif // !PUBSUB_H
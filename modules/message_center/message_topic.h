@@ -0,0 +1,25 @@
+/**
+ * @file message_topic.h
+ * @brief message_center的话题表,每个话题在编译时确定ID,话题名和消息类型
+ *
+ * @note 表项为 X(话题ID, 话题名, 消息类型, 话题模式),新增话题时在此处添加一行即可.
+ *       message_center只使用ID,话题名和模式,消息类型由应用通过MESSAGE_TOPIC_TYPEDEF展开(见robot_def.h),
+ *       因此本文件不包含任何消息类型的定义,module和bsp也可以包含message_center.h而不依赖application
+ *       不在表中的话题仍然可以用字符串注册,见message_center.h中的PubRegister()/SubRegister()
+ *
+ *       话题模式:
+ *       TOPIC_MODE_QUEUE  每个订阅者有自己的消息队列,适合不能丢失的事件和指令
+ *       TOPIC_MODE_LATEST 只保留最新的一条消息,所有订阅者共享发布者的缓冲区,适合周期更新的状态/反馈
+ */
+#ifndef MESSAGE_TOPIC_H
+#define MESSAGE_TOPIC_H
+
+#define MESSAGE_TOPIC_TABLE(X)                                                   \
+    X(TOPIC_GIMBAL_CMD, "gimbal_cmd", Gimbal_Ctrl_Cmd_s, TOPIC_MODE_QUEUE)       \
+    X(TOPIC_GIMBAL_FEED, "gimbal_feed", Gimbal_Upload_Data_s, TOPIC_MODE_LATEST) \
+    X(TOPIC_SHOOT_CMD, "shoot_cmd", Shoot_Ctrl_Cmd_s, TOPIC_MODE_QUEUE)          \
+    X(TOPIC_SHOOT_FEED, "shoot_feed", Shoot_Upload_Data_s, TOPIC_MODE_LATEST)    \
+    X(TOPIC_CHASSIS_CMD, "chassis_cmd", Chassis_Ctrl_Cmd_s, TOPIC_MODE_QUEUE)    \
+    X(TOPIC_CHASSIS_FEED, "chassis_feed", Chassis_Upload_Data_s, TOPIC_MODE_LATEST)
+
+#endif // !MESSAGE_TOPIC_H
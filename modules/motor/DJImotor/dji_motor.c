@@ -2,115 +2,110 @@
 #include "general_def.h"
 #include "bsp_dwt.h"
 #include "bsp_log.h"
+#include "cmsis_os.h"
+#include "motor_task.h"
+#include "bsp_tools.h"
 
 static uint8_t idx = 0; // register idx,是该文件的全局电机索引,在注册时使用
-/* DJI电机的实例,此处仅保存指针,内存的分配将通过电机实例初始化时通过malloc()进行 */
+/* DJI电机的实例,此处仅保存指针,内存的分配将通过电机实例初始化时通过CCMMalloc()进行 */
 static DJIMotorInstance *dji_motor_instance[DJI_MOTOR_CNT] = {NULL}; // 会在control任务中遍历该指针数组进行pid计算
 
+/* 共用一帧控制报文的一组电机,用于反馈同步模式 */
+typedef struct
+{
+    DJIMotorInstance *motor[4]; // 组内的电机,按注册顺序排列
+    uint8_t motor_cnt;
+    uint32_t send_cnt; // 上次发送时的DWT->CYCCNT
+} DJIMotorGroup_t;
+
+static uint8_t group_idx = 0;
+static DJIMotorGroup_t dji_motor_group[DJI_MOTOR_GROUP_CNT];
+static osThreadId dji_sync_task = NULL; // 调用DJIMotorSyncControl()的任务,为NULL时没有启用反馈同步模式
+
 /**
- * @brief 由于DJI电机发送以四个一组的形式进行,故对其进行特殊处理,用6个(2can*3group)can_instance专门负责发送
- *        该变量将在 DJIMotorControl() 中使用,分组在 MotorSenderGrouping()中进行
- *
- * @note  因为只用于发送,所以不需要在bsp_can中注册
+ * @brief 根据电调/拨码开关上的ID,根据说明书的默认id分配方式计算接收ID,
+ *        并在对应的聚合发送帧中注册槽位,至多4个电机共用一帧控制报文
  *
  * C610(m2006)/C620(m3508):0x1ff,0x200;
  * GM6020:0x1ff,0x2ff
  * 反馈(rx_id): GM6020: 0x204+id ; C610/C620: 0x200+id
- * can1: [0]:0x1FF,[1]:0x200,[2]:0x2FF
- * can2: [3]:0x1FF,[4]:0x200,[5]:0x2FF
- */
-static CANInstance sender_assignment[6] = {
-    [0] = {.can_handle = &hcan1, .txconf.StdId = 0x1ff, .txconf.IDE = CAN_ID_STD, .txconf.RTR = CAN_RTR_DATA, .txconf.DLC = 0x08, .tx_buff = {0}},
-    [1] = {.can_handle = &hcan1, .txconf.StdId = 0x200, .txconf.IDE = CAN_ID_STD, .txconf.RTR = CAN_RTR_DATA, .txconf.DLC = 0x08, .tx_buff = {0}},
-    [2] = {.can_handle = &hcan1, .txconf.StdId = 0x2ff, .txconf.IDE = CAN_ID_STD, .txconf.RTR = CAN_RTR_DATA, .txconf.DLC = 0x08, .tx_buff = {0}},
-    [3] = {.can_handle = &hcan2, .txconf.StdId = 0x1ff, .txconf.IDE = CAN_ID_STD, .txconf.RTR = CAN_RTR_DATA, .txconf.DLC = 0x08, .tx_buff = {0}},
-    [4] = {.can_handle = &hcan2, .txconf.StdId = 0x200, .txconf.IDE = CAN_ID_STD, .txconf.RTR = CAN_RTR_DATA, .txconf.DLC = 0x08, .tx_buff = {0}},
-    [5] = {.can_handle = &hcan2, .txconf.StdId = 0x2ff, .txconf.IDE = CAN_ID_STD, .txconf.RTR = CAN_RTR_DATA, .txconf.DLC = 0x08, .tx_buff = {0}},
-};
-
-/**
- * @brief 6个用于确认是否有电机注册到sender_assignment中的标志位,防止发送空帧,此变量将在DJIMotorControl()使用
- *        flag的初始化在 MotorSenderGrouping()中进行
- */
-static uint8_t sender_enable_flag[6] = {0};
-
-/**
- * @brief 根据电调/拨码开关上的ID,根据说明书的默认id分配方式计算发送ID和接收ID,
- *        并对电机进行分组以便处理多电机控制命令
+ * 每个电机在帧中占2字节,偏移为2*(组内编号)
  */
 static void MotorSenderGrouping(DJIMotorInstance *motor, CAN_Init_Config_s *config)
 {
     uint8_t motor_id = config->tx_id - 1; // 下标从零开始,先减一方便赋值
-    uint8_t motor_send_num;
-    uint8_t motor_grouping;
+    uint8_t motor_send_num = motor_id < 4 ? motor_id : motor_id - 4; // 组内编号
+    uint32_t group_id;
 
     switch (motor->motor_type)
     {
     case M2006:
     case M3508:
-        if (motor_id < 4) // 根据ID分组
-        {
-            motor_send_num = motor_id;
-            motor_grouping = config->can_handle == &hcan1 ? 1 : 4;
-        }
-        else
-        {
-            motor_send_num = motor_id - 4;
-            motor_grouping = config->can_handle == &hcan1 ? 0 : 3;
-        }
-
-        // 计算接收id并设置分组发送id
-        config->rx_id = 0x200 + motor_id + 1;   // 把ID+1,进行分组设置
-        sender_enable_flag[motor_grouping] = 1; // 设置发送标志位,防止发送空帧
-        motor->message_num = motor_send_num;
-        motor->sender_group = motor_grouping;
-
-        // 检查是否发生id冲突
-        for (size_t i = 0; i < idx; ++i)
-        {
-            if (dji_motor_instance[i]->motor_can_instance->can_handle == config->can_handle && dji_motor_instance[i]->motor_can_instance->rx_id == config->rx_id)
-            {
-                LOGERROR("[dji_motor] ID crash. Check in debug mode, add dji_motor_instance to watch to get more information.");
-                uint16_t can_bus = config->can_handle == &hcan1 ? 1 : 2;
-                while (1) // 6020的id 1-4和2006/3508的id 5-8会发生冲突(若有注册,即1!5,2!6,3!7,4!8) (1!5!,LTC! (((不是)
-                    LOGERROR("[dji_motor] id [%d], can_bus [%d]", config->rx_id, can_bus);
-            }
-        }
+        group_id = motor_id < 4 ? 0x200 : 0x1ff; // 根据ID分组
+        config->rx_id = 0x200 + motor_id + 1;    // 把ID+1,计算接收id
         break;
 
     case GM6020:
-        if (motor_id < 4)
-        {
-            motor_send_num = motor_id;
-            motor_grouping = config->can_handle == &hcan1 ? 0 : 3;
-        }
-        else
-        {
-            motor_send_num = motor_id - 4;
-            motor_grouping = config->can_handle == &hcan1 ? 2 : 5;
-        }
-
-        config->rx_id = 0x204 + motor_id + 1;   // 把ID+1,进行分组设置
-        sender_enable_flag[motor_grouping] = 1; // 只要有电机注册到这个分组,置为1;在发送函数中会通过此标志判断是否有电机注册
-        motor->message_num = motor_send_num;
-        motor->sender_group = motor_grouping;
-
-        for (size_t i = 0; i < idx; ++i)
-        {
-            if (dji_motor_instance[i]->motor_can_instance->can_handle == config->can_handle && dji_motor_instance[i]->motor_can_instance->rx_id == config->rx_id)
-            {
-                LOGERROR("[dji_motor] ID crash. Check in debug mode, add dji_motor_instance to watch to get more information.");
-                uint16_t can_bus = config->can_handle == &hcan1 ? 1 : 2;
-                while (1) // 6020的id 1-4和2006/3508的id 5-8会发生冲突(若有注册,即1!5,2!6,3!7,4!8) (1!5!,LTC! (((不是)
-                    LOGERROR("[dji_motor] id [%d], can_bus [%d]", config->rx_id, can_bus);
-            }
-        }
+        group_id = motor_id < 4 ? 0x1ff : 0x2ff;
+        config->rx_id = 0x204 + motor_id + 1;
         break;
 
     default: // other motors should not be registered here
         while (1)
             LOGERROR("[dji_motor]You must not register other motors using the API of DJI motor."); // 其他电机不应该在这里注册
     }
+
+    // 检查是否发生id冲突
+    for (size_t i = 0; i < idx; ++i)
+    {
+        if (dji_motor_instance[i]->motor_can_instance->can_handle == config->can_handle && dji_motor_instance[i]->motor_can_instance->rx_id == config->rx_id)
+        {
+            LOGERROR("[dji_motor] ID crash. Check in debug mode, add dji_motor_instance to watch to get more information.");
+            uint16_t can_bus = config->can_handle == &hcan1 ? 1 : 2;
+            while (1) // 6020的id 1-4和2006/3508的id 5-8会发生冲突(若有注册,即1!5,2!6,3!7,4!8) (1!5!,LTC! (((不是)
+                LOGERROR("[dji_motor] id [%d], can_bus [%d]", config->rx_id, can_bus);
+        }
+    }
+
+    // 在聚合发送帧中注册槽位,同一总线上group_id相同的电机共用一帧
+    CAN_Tx_Slot_Config_s slot_config = {
+        .can_handle = config->can_handle,
+        .group_id = group_id,
+        .slot_offset = 2 * motor_send_num,
+        .slot_len = 2,
+        .priority = CAN_TX_PRIO_HIGH,
+        .deadline_us = MOTOR_CAN_TX_DEADLINE_US,
+    };
+    motor->sender_slot = CANTxSlotRegister(&slot_config);
+
+    // 记录所在的分组,同一聚合帧中的电机属于同一组
+    uint8_t i;
+    for (i = 0; i < group_idx; i++)
+        if (dji_motor_group[i].motor[0]->sender_slot->group == motor->sender_slot->group)
+            break;
+    if (i == group_idx)
+        group_idx++; // 槽位注册成功说明总线和id组合有效,分组数不会超过DJI_MOTOR_GROUP_CNT
+    dji_motor_group[i].motor[dji_motor_group[i].motor_cnt++] = motor;
+    motor->sync_group = i;
+}
+
+/**
+ * @brief 分组中所有在线的电机是否都收到了新的反馈,至少要有一个在线的电机
+ */
+static uint8_t DJIMotorGroupReady(DJIMotorGroup_t *group)
+{
+    DJIMotorInstance *motor;
+    uint8_t online = 0;
+    for (uint8_t i = 0; i < group->motor_cnt; i++)
+    {
+        motor = group->motor[i];
+        if (!DaemonIsOnline(motor->daemon))
+            continue;
+        if (motor->feed_seq == motor->feed_seq_used)
+            return 0;
+        online++;
+    }
+    return online;
 }
 
 /**
@@ -128,7 +123,7 @@ static void DecodeDJIMotor(CANInstance *_instance)
     DJI_Motor_Measure_s *measure = &motor->measure; // measure要多次使用,保存指针减小访存开销
 
     DaemonReload(motor->daemon);
-    motor->dt = DWT_GetDeltaT(&motor->feed_cnt);
+    motor->dt = DWT_GetStampDeltaT(_instance->rx_stamp, &motor->feed_cnt); // 使用报文到达时间,不受中断延迟影响
 
     // 解析数据并对电流和速度进行滤波,电机的反馈报文具体格式见电机说明手册
     measure->last_ecd = measure->ecd;
@@ -146,6 +141,16 @@ static void DecodeDJIMotor(CANInstance *_instance)
     else if (measure->ecd - measure->last_ecd < -4096)
         measure->total_round++;
     measure->total_angle = measure->total_round * 360 + measure->angle_single_round;
+
+    // 串级控制使用的反馈,角度环对total angle闭环,防止在边界处出现突跃
+    motor->base.feedback.angle = measure->total_angle;
+    motor->base.feedback.speed = measure->speed_aps;
+    motor->base.feedback.current = measure->real_current;
+
+    // 反馈同步模式下,本组反馈到齐时唤醒电机任务
+    motor->feed_seq++;
+    if (dji_sync_task != NULL && DJIMotorGroupReady(&dji_motor_group[motor->sync_group]))
+        osSignalSet(dji_sync_task, DJI_MOTOR_SYNC_SIGNAL);
 }
 
 static void DJIMotorLostCallback(void *motor_ptr)
@@ -155,32 +160,45 @@ static void DJIMotorLostCallback(void *motor_ptr)
     LOGWARNING("[dji_motor] Motor lost, can bus [%d] , id [%d]", can_bus, motor->motor_can_instance->tx_id);
 }
 
+/**
+ * @brief 将控制量写入所在聚合帧的槽位,由CANTxGroupFlush()或CANTxSlotFlush()发送
+ */
+static void DJIMotorPack(MotorInstance *base, float output)
+{
+    DJIMotorInstance *motor = (DJIMotorInstance *)base;
+    int16_t set = (int16_t)output; // 电机控制CAN发送设定值
+    uint8_t set_buff[2];
+
+    set_buff[0] = (uint8_t)(set >> 8);     // 高八位在前
+    set_buff[1] = (uint8_t)(set & 0x00ff); // 低八位在后
+    CANTxSlotWrite(motor->sender_slot, set_buff);
+}
+
+static const Motor_Ops_s dji_motor_ops = {
+    .decode = DecodeDJIMotor,
+    .pack = DJIMotorPack,
+    .output_min = -32767,
+    .output_max = 32767,
+    .shared_frame = 1,
+};
+
 // 电机初始化,返回一个电机实例
 DJIMotorInstance *DJIMotorInit(Motor_Init_Config_s *config)
 {
-    DJIMotorInstance *instance = (DJIMotorInstance *)malloc(sizeof(DJIMotorInstance));
-    memset(instance, 0, sizeof(DJIMotorInstance));
-
-    // motor basic setting 电机基本设置
-    instance->motor_type = config->motor_type;                         // 6020 or 2006 or 3508
-    instance->motor_settings = config->controller_setting_init_config; // 正反转,闭环类型等
-
-    // motor controller init 电机控制器初始化
-    PIDInit(&instance->motor_controller.current_PID, &config->controller_param_init_config.current_PID);
-    PIDInit(&instance->motor_controller.speed_PID, &config->controller_param_init_config.speed_PID);
-    PIDInit(&instance->motor_controller.angle_PID, &config->controller_param_init_config.angle_PID);
-    instance->motor_controller.other_angle_feedback_ptr = config->controller_param_init_config.other_angle_feedback_ptr;
-    instance->motor_controller.other_speed_feedback_ptr = config->controller_param_init_config.other_speed_feedback_ptr;
-    instance->motor_controller.current_feedforward_ptr = config->controller_param_init_config.current_feedforward_ptr;
-    instance->motor_controller.speed_feedforward_ptr = config->controller_param_init_config.speed_feedforward_ptr;
-    // 后续增加电机前馈控制器(速度和电流)
+    DJIMotorInstance *instance = (DJIMotorInstance *)CCMMalloc(sizeof(DJIMotorInstance)); // 控制任务每周期都会访问,放在CCM中,已清零
+
+    // 电机设置,控制器和分频
+    instance->motor_type = config->motor_type; // 6020 or 2006 or 3508
+    MotorInstanceInit(&instance->base, config, &dji_motor_ops);
+#if DJI_MOTOR_FEEDBACK_SYNC
+    instance->base.self_driven = 1; // 由DJIMotorSyncControl()控制
+#endif
 
     // 电机分组,因为至多4个电机可以共用一帧CAN控制报文
     MotorSenderGrouping(instance, &config->can_init_config);
 
-    // 注册电机到CAN总线
-    config->can_init_config.can_module_callback = DecodeDJIMotor; // set callback
-    config->can_init_config.id = instance;                        // set id,eq to address(it is identity)
+    // 注册电机到CAN总线,回调已由MotorInstanceInit()设置
+    config->can_init_config.id = instance; // set id,eq to address(it is identity)
     instance->motor_can_instance = CANRegister(&config->can_init_config);
 
     // 注册守护线程
@@ -191,7 +209,7 @@ DJIMotorInstance *DJIMotorInit(Motor_Init_Config_s *config)
     };
     instance->daemon = DaemonRegister(&daemon_config);
 
-    DJIMotorEnable(instance);
+    MotorRegister(&instance->base);
     dji_motor_instance[idx++] = instance;
     return instance;
 }
@@ -200,115 +218,57 @@ DJIMotorInstance *DJIMotorInit(Motor_Init_Config_s *config)
 void DJIMotorChangeFeed(DJIMotorInstance *motor, Closeloop_Type_e loop, Feedback_Source_e type)
 {
     if (loop == ANGLE_LOOP)
-        motor->motor_settings.angle_feedback_source = type;
+        motor->base.motor_settings.angle_feedback_source = type;
     else if (loop == SPEED_LOOP)
-        motor->motor_settings.speed_feedback_source = type;
+        motor->base.motor_settings.speed_feedback_source = type;
     else
         LOGERROR("[dji_motor] loop type error, check memory access and func param"); // 检查是否传入了正确的LOOP类型,或发生了指针越界
 }
 
 void DJIMotorStop(DJIMotorInstance *motor)
 {
-    motor->stop_flag = MOTOR_STOP;
+    motor->base.stop_flag = MOTOR_STOP;
 }
 
 void DJIMotorEnable(DJIMotorInstance *motor)
 {
-    motor->stop_flag = MOTOR_ENALBED;
+    motor->base.stop_flag = MOTOR_ENALBED;
 }
 
 /* 修改电机的实际闭环对象 */
 void DJIMotorOuterLoop(DJIMotorInstance *motor, Closeloop_Type_e outer_loop)
 {
-    motor->motor_settings.outer_loop_type = outer_loop;
+    motor->base.motor_settings.outer_loop_type = outer_loop;
 }
 
 // 设置参考值
 void DJIMotorSetRef(DJIMotorInstance *motor, float ref)
 {
-    motor->motor_controller.pid_ref = ref;
+    motor->base.motor_controller.pid_ref = ref;
 }
 
-// 为所有电机实例计算三环PID,发送控制报文
-void DJIMotorControl()
+void DJIMotorSyncControl(uint32_t wait_ms)
 {
-    // 直接保存一次指针引用从而减小访存的开销,同样可以提高可读性
-    uint8_t group, num; // 电机组号和组内编号
-    int16_t set;        // 电机控制CAN发送设定值
-    DJIMotorInstance *motor;
-    Motor_Control_Setting_s *motor_setting; // 电机控制参数
-    Motor_Controller_s *motor_controller;   // 电机控制器
-    DJI_Motor_Measure_s *measure;           // 电机测量值
-    float pid_measure, pid_ref;             // 电机PID测量值和设定值
+    DJIMotorGroup_t *group;
+    uint8_t timeout;
 
-    // 遍历所有电机实例,进行串级PID的计算并设置发送报文的值
-    for (size_t i = 0; i < idx; ++i)
-    { // 减小访存开销,先保存指针引用
-        motor = dji_motor_instance[i];
-        motor_setting = &motor->motor_settings;
-        motor_controller = &motor->motor_controller;
-        measure = &motor->measure;
-        pid_ref = motor_controller->pid_ref; // 保存设定值,防止motor_controller->pid_ref在计算过程中被修改
-        if (motor_setting->motor_reverse_flag == MOTOR_DIRECTION_REVERSE)
-            pid_ref *= -1; // 设置反转
-
-        // pid_ref会顺次通过被启用的闭环充当数据的载体
-        // 计算位置环,只有启用位置环且外层闭环为位置时会计算速度环输出
-        if ((motor_setting->close_loop_type & ANGLE_LOOP) && motor_setting->outer_loop_type == ANGLE_LOOP)
-        {
-            if (motor_setting->angle_feedback_source == OTHER_FEED)
-                pid_measure = *motor_controller->other_angle_feedback_ptr;
-            else
-                pid_measure = measure->total_angle; // MOTOR_FEED,对total angle闭环,防止在边界处出现突跃
-            // 更新pid_ref进入下一个环
-            pid_ref = PIDCalculate(&motor_controller->angle_PID, pid_measure, pid_ref);
-        }
-
-        // 计算速度环,(外层闭环为速度或位置)且(启用速度环)时会计算速度环
-        if ((motor_setting->close_loop_type & SPEED_LOOP) && (motor_setting->outer_loop_type & (ANGLE_LOOP | SPEED_LOOP)))
-        {
-            if (motor_setting->feedforward_flag & SPEED_FEEDFORWARD)
-                pid_ref += *motor_controller->speed_feedforward_ptr;
-
-            if (motor_setting->speed_feedback_source == OTHER_FEED)
-                pid_measure = *motor_controller->other_speed_feedback_ptr;
-            else // MOTOR_FEED
-                pid_measure = measure->speed_aps;
-            // 更新pid_ref进入下一个环
-            pid_ref = PIDCalculate(&motor_controller->speed_PID, pid_measure, pid_ref);
-        }
-
-        // 计算电流环,目前只要启用了电流环就计算,不管外层闭环是什么,并且电流只有电机自身传感器的反馈
-        if (motor_setting->feedforward_flag & CURRENT_FEEDFORWARD)
-            pid_ref += *motor_controller->current_feedforward_ptr;
-        if (motor_setting->close_loop_type & CURRENT_LOOP)
-        {
-            pid_ref = PIDCalculate(&motor_controller->current_PID, measure->real_current, pid_ref);
-        }
-
-        if (motor_setting->feedback_reverse_flag == FEEDBACK_DIRECTION_REVERSE)
-            pid_ref *= -1;
-
-        // 获取最终输出
-        set = (int16_t)pid_ref;
-
-        // 分组填入发送数据
-        group = motor->sender_group;
-        num = motor->message_num;
-        sender_assignment[group].tx_buff[2 * num] = (uint8_t)(set >> 8);         // 低八位
-        sender_assignment[group].tx_buff[2 * num + 1] = (uint8_t)(set & 0x00ff); // 高八位
-
-        // 若该电机处于停止状态,直接将buff置零
-        if (motor->stop_flag == MOTOR_STOP)
-            memset(sender_assignment[group].tx_buff + 2 * num, 0, sizeof(uint16_t));
-    }
+    if (dji_sync_task == NULL) // 第一次调用,此后接收回调会在分组反馈到齐时通知本任务
+        dji_sync_task = osThreadGetId();
+    osSignalWait(DJI_MOTOR_SYNC_SIGNAL, wait_ms);
+    MotorClockLatch();
 
-    // 遍历flag,检查是否要发送这一帧报文
-    for (size_t i = 0; i < 6; ++i)
+    for (uint8_t i = 0; i < group_idx; i++)
     {
-        if (sender_enable_flag[i])
+        group = &dji_motor_group[i];
+        timeout = DWT_GetStampAge(group->send_cnt) * 1000.0f >= DJI_MOTOR_SYNC_TIMEOUT_MS;
+        if (!timeout && !DJIMotorGroupReady(group))
+            continue; // 反馈还没有到齐
+        for (uint8_t j = 0; j < group->motor_cnt; j++)
         {
-            CANTransmit(&sender_assignment[i], 1);
+            group->motor[j]->feed_seq_used = group->motor[j]->feed_seq; // 记录本次计算使用的反馈
+            MotorCalculate(&group->motor[j]->base);
         }
+        CANTxSlotFlush(group->motor[0]->sender_slot); // 立即发送本组的控制帧
+        group->send_cnt = DWT->CYCCNT;
     }
 }
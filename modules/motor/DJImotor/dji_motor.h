@@ -22,6 +22,9 @@
 #include "daemon.h"
 
 #define DJI_MOTOR_CNT 12
+#define DJI_MOTOR_GROUP_CNT 6         // 每条总线至多3个控制帧(0x1ff,0x200,0x2ff)
+#define DJI_MOTOR_SYNC_SIGNAL 0x01    // 反馈同步模式下,一组电机反馈到齐时发给电机任务的信号
+#define DJI_MOTOR_SYNC_TIMEOUT_MS 2   // 反馈同步模式下,一组电机超过此时间没有发送时不再等待反馈,强制计算并发送
 
 /* 滤波系数设置为1的时候即关闭滤波 */
 #define SPEED_SMOOTH_COEF 0.85f      // 最好大于0.85
@@ -48,21 +51,23 @@ typedef struct
  */
 typedef struct
 {
-    DJI_Motor_Measure_s measure;            // 电机测量值
-    Motor_Control_Setting_s motor_settings; // 电机设置
-    Motor_Controller_s motor_controller;    // 电机控制器
+    MotorInstance base;          // 各类电机通用的部分,必须是第一个成员
+    DJI_Motor_Measure_s measure; // 电机测量值
 
     CANInstance *motor_can_instance; // 电机CAN实例
     // 分组发送设置
-    uint8_t sender_group;
-    uint8_t message_num;
+    CANTxSlotInstance *sender_slot; // 在分组控制报文中的槽位
 
-    Motor_Type_e motor_type;        // 电机类型
-    Motor_Working_Type_e stop_flag; // 启停标志
+    Motor_Type_e motor_type; // 电机类型
 
     DaemonInstance* daemon;
     uint32_t feed_cnt;
     float dt;
+
+    // 反馈同步模式
+    uint8_t sync_group;           // 所在的控制帧分组
+    volatile uint8_t feed_seq;    // 每收到一帧反馈加一,只在接收回调中写入
+    uint8_t feed_seq_used;        // 上次计算时使用的feed_seq,两者不等说明有新的反馈
 } DJIMotorInstance;
 
 /**
@@ -72,7 +77,7 @@ typedef struct
  *                                            .member2=xx,
  *                                             ....};
  *        请注意不要在一条总线上挂载过多的电机(超过6个),若一定要这么做,请降低每个电机的反馈频率(设为500Hz),
- *        并减小DJIMotorControl()任务的运行频率.
+ *        并减小MotorControlTask()任务的运行频率.
  *
  * @attention M3508和M2006的反馈报文都是0x200+id,而GM6020的反馈是0x204+id,请注意前两者和后者的id不要冲突.
  *            如果产生冲突,在初始化电机的时候会进入IDcrash_Handler(),可以通过debug来判断是否出现冲突.
@@ -102,9 +107,15 @@ void DJIMotorSetRef(DJIMotorInstance *motor, float ref);
 void DJIMotorChangeFeed(DJIMotorInstance *motor, Closeloop_Type_e loop, Feedback_Source_e type);
 
 /**
- * @brief 该函数被motor_task调用运行在rtos上,motor_stask内通过osDelay()确定控制频率
+ * @brief 反馈同步模式的控制函数,由电机任务循环调用,此时MotorControlTask()不再控制DJI电机
+ *        一组(共用一帧控制报文的)电机的反馈全部到达后,接收回调通过任务通知唤醒调用者,
+ *        随即只计算这一组电机并立刻发送该组的控制帧,使控制量的计算和发送紧跟在反馈之后
+ *
+ * @note 离线的电机不参与等待;一组电机超过DJI_MOTOR_SYNC_TIMEOUT_MS没有发送时,不论反馈是否到齐都会计算并发送
+ *
+ * @param wait_ms 没有分组就绪时的最长等待时间,超时后返回,调用者可以借此处理其他周期性的工作
  */
-void DJIMotorControl();
+void DJIMotorSyncControl(uint32_t wait_ms);
 
 /**
  * @brief 停止电机,注意不是将设定值设为零,而是直接给电机发送的电流值置零
@@ -114,7 +125,7 @@ void DJIMotorStop(DJIMotorInstance *motor);
 
 /**
  * @brief 启动电机,此时电机会响应设定值
- *        初始化时不需要此函数,因为stop_flag的默认值为0
+ *        初始化时不需要此函数,电机注册后默认处于启动状态
  *
  */
 void DJIMotorEnable(DJIMotorInstance *motor);
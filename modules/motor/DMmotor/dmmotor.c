@@ -7,52 +7,59 @@
 #include "daemon.h"
 #include "stdlib.h"
 #include "bsp_log.h"
+#include "bsp_dwt.h"
+#include "motor_task.h"
+#include "bsp_tools.h"
+
+#define DM_MOTOR_DEFAULT_PERIOD 2 // 默认的控制周期,单位ms
 
 static uint8_t idx;
 static DMMotorInstance *dm_motor_instance[DM_MOTOR_CNT];
-static osThreadId dm_task_handle[DM_MOTOR_CNT];
-/* 两个用于将uint值和float值进行映射的函数,在设定发送值和解析反馈值时使用 */
-static uint16_t float_to_uint(float x, float x_min, float x_max, uint8_t bits)
-{
-    float span = x_max - x_min;
-    float offset = x_min;
-    return (uint16_t)((x - offset) * ((float)((1 << bits) - 1)) / span);
-}
-static float uint_to_float(int x_int, float x_min, float x_max, int bits)
-{
-    float span = x_max - x_min;
-    float offset = x_min;
-    return ((float)x_int) * span / ((float)((1 << bits) - 1)) + offset;
-}
+/* MIT报文的映射范围,需要和达妙上位机中的PMAX/VMAX/TMAX设置一致 */
+static const MIT_Range_s dm_mit_range = {
+    .p_min = DM_P_MIN,
+    .p_max = DM_P_MAX,
+    .v_min = DM_V_MIN,
+    .v_max = DM_V_MAX,
+    .kp_min = DM_KP_MIN,
+    .kp_max = DM_KP_MAX,
+    .kd_min = DM_KD_MIN,
+    .kd_max = DM_KD_MAX,
+    .t_min = DM_T_MIN,
+    .t_max = DM_T_MAX,
+};
 
 static void DMMotorSetMode(DMMotor_Mode_e cmd, DMMotorInstance *motor)
 {
-    memset(motor->motor_can_instace->tx_buff, 0xff, 7);  // 发送电机指令的时候前面7bytes都是0xff
-    motor->motor_can_instace->tx_buff[7] = (uint8_t)cmd; // 最后一位是命令id
-    CANTransmit(motor->motor_can_instace, 1);
+    uint8_t buf[8];
+    memset(buf, 0xff, 7);  // 发送电机指令的时候前面7bytes都是0xff
+    buf[7] = (uint8_t)cmd; // 最后一位是命令id
+    CANTransmit(motor->motor_can_instace, buf);
 }
 
 static void DMMotorDecode(CANInstance *motor_can)
 {
-    uint16_t tmp; // 用于暂存解析值,稍后转换成float数据,避免多次创建临时变量
+    MIT_Feedback_s feedback;
     uint8_t *rxbuff = motor_can->rx_buff;
     DMMotorInstance *motor = (DMMotorInstance *)motor_can->id;
     DM_Motor_Measure_s *measure = &(motor->measure); // 将can实例中保存的id转换成电机实例的指针
 
     DaemonReload(motor->motor_daemon);
+    measure->feed_dt = DWT_GetStampDeltaT(motor_can->rx_stamp, &measure->feed_cnt); // 使用报文到达时间,不受中断延迟影响
 
+    MITUnpackFeedback(rxbuff, &dm_mit_range, &feedback);
     measure->last_position = measure->position;
-    tmp = (uint16_t)((rxbuff[1] << 8) | rxbuff[2]);
-    measure->position = uint_to_float(tmp, DM_P_MIN, DM_P_MAX, 16);
-
-    tmp = (uint16_t)((rxbuff[3] << 4) | rxbuff[4] >> 4);
-    measure->velocity = uint_to_float(tmp, DM_V_MIN, DM_V_MAX, 12);
-
-    tmp = (uint16_t)(((rxbuff[4] & 0x0f) << 8) | rxbuff[5]);
-    measure->torque = uint_to_float(tmp, DM_T_MIN, DM_T_MAX, 12);
+    measure->position = feedback.position;
+    measure->velocity = feedback.velocity;
+    measure->torque = feedback.torque;
 
     measure->T_Mos = (float)rxbuff[6];
     measure->T_Rotor = (float)rxbuff[7];
+
+    // 和HT电机一样,位置/速度换算到角度制后参与闭环
+    motor->base.feedback.angle = measure->position * RAD_2_DEGREE;
+    motor->base.feedback.speed = measure->velocity * RAD_2_DEGREE;
+    motor->base.feedback.current = measure->torque;
 }
 
 static void DMMotorLostCallback(void *motor_ptr)
@@ -63,20 +70,43 @@ void DMMotorCaliEncoder(DMMotorInstance *motor)
     DMMotorSetMode(DM_CMD_ZERO_POSITION, motor);
     DWT_Delay(0.1);
 }
+/**
+ * @brief 以MIT模式打包并发送控制报文,MCU串级控制的输出叠加在前馈力矩上
+ *        停止时发送全零的指令(kp=kd=0),电机不再保持位置
+ */
+static void DMMotorPack(MotorInstance *base, float output)
+{
+    DMMotorInstance *motor = (DMMotorInstance *)base;
+    MIT_Command_s cmd = motor->mit;
+    uint8_t tx_buff[8]; // 报文在此打包后直接交给bsp_can发送
+
+    if (motor->base.stop_flag == MOTOR_STOP)
+        memset(&cmd, 0, sizeof(cmd));
+    else
+        cmd.torque += output;
+    MITPackCommand(tx_buff, &cmd, &dm_mit_range);
+
+    CANTransmit(motor->motor_can_instace, tx_buff);
+}
+
+static const Motor_Ops_s dm_motor_ops = {
+    .decode = DMMotorDecode,
+    .pack = DMMotorPack,
+    .output_min = DM_T_MIN,
+    .output_max = DM_T_MAX,
+};
+
 DMMotorInstance *DMMotorInit(Motor_Init_Config_s *config)
 {
-    DMMotorInstance *motor = (DMMotorInstance *)malloc(sizeof(DMMotorInstance));
-    memset(motor, 0, sizeof(DMMotorInstance));
+    DMMotorInstance *motor = (DMMotorInstance *)CCMMalloc(sizeof(DMMotorInstance));
     
-    motor->motor_settings = config->controller_setting_init_config;
-    PIDInit(&motor->current_PID, &config->controller_param_init_config.current_PID);
-    PIDInit(&motor->speed_PID, &config->controller_param_init_config.speed_PID);
-    PIDInit(&motor->angle_PID, &config->controller_param_init_config.angle_PID);
-    motor->other_angle_feedback_ptr = config->controller_param_init_config.other_angle_feedback_ptr;
-    motor->other_speed_feedback_ptr = config->controller_param_init_config.other_speed_feedback_ptr;
-
-    config->can_init_config.can_module_callback = DMMotorDecode;
+    if (config->control_divider == 0)
+        config->control_divider = DM_MOTOR_DEFAULT_PERIOD;
+    MotorInstanceInit(&motor->base, config, &dm_motor_ops);
+
     config->can_init_config.id = motor;
+    config->can_init_config.tx_priority = CAN_TX_PRIO_HIGH;
+    config->can_init_config.tx_deadline_us = MOTOR_CAN_TX_DEADLINE_US;
     motor->motor_can_instace = CANRegister(&config->can_init_config);
 
     Daemon_Init_Config_s conf = {
@@ -86,90 +116,45 @@ DMMotorInstance *DMMotorInit(Motor_Init_Config_s *config)
     };
     motor->motor_daemon = DaemonRegister(&conf);
 
-    DMMotorEnable(motor);
     DMMotorSetMode(DM_CMD_MOTOR_MODE, motor);
     DWT_Delay(0.1);
     DMMotorCaliEncoder(motor);
     DWT_Delay(0.1);
+
+    MotorRegister(&motor->base);
     dm_motor_instance[idx++] = motor;
     return motor;
 }
 
 void DMMotorSetRef(DMMotorInstance *motor, float ref)
 {
-    motor->pid_ref = ref;
+    motor->base.motor_controller.pid_ref = ref;
 }
 
-void DMMotorEnable(DMMotorInstance *motor)
+void DMMotorSetMIT(DMMotorInstance *motor, float position, float velocity, float torque)
 {
-    motor->stop_flag = MOTOR_ENALBED;
+    motor->mit.position = position;
+    motor->mit.velocity = velocity;
+    motor->mit.torque = torque;
 }
 
-void DMMotorStop(DMMotorInstance *motor)//不使用使能模式是因为需要收到反馈
+void DMMotorSetGain(DMMotorInstance *motor, float kp, float kd)
 {
-    motor->stop_flag = MOTOR_STOP;
+    motor->mit.kp = kp;
+    motor->mit.kd = kd;
 }
 
-void DMMotorOuterLoop(DMMotorInstance *motor, Closeloop_Type_e type)
+void DMMotorEnable(DMMotorInstance *motor)
 {
-    motor->motor_settings.outer_loop_type = type;
+    motor->base.stop_flag = MOTOR_ENALBED;
 }
 
-
-//@Todo: 目前只实现了力控，更多位控PID等请自行添加
-void DMMotorTask(void const *argument)
+void DMMotorStop(DMMotorInstance *motor)//不使用使能模式是因为需要收到反馈
 {
-    float  pid_ref, set;
-    DMMotorInstance *motor = (DMMotorInstance *)argument;
-   //DM_Motor_Measure_s *measure = &motor->measure;
-    Motor_Control_Setting_s *setting = &motor->motor_settings;
-    //CANInstance *motor_can = motor->motor_can_instace;
-    //uint16_t tmp;
-    DMMotor_Send_s motor_send_mailbox;
-    while (1)
-    {
-        pid_ref = motor->pid_ref;
-        
-        set = pid_ref;
-        if (setting->motor_reverse_flag == MOTOR_DIRECTION_REVERSE)
-            set *= -1;
-       
-        LIMIT_MIN_MAX(set, DM_T_MIN, DM_T_MAX);
-        motor_send_mailbox.position_des = float_to_uint(0, DM_P_MIN, DM_P_MAX, 16);
-        motor_send_mailbox.velocity_des = float_to_uint(0, DM_V_MIN, DM_V_MAX, 12);
-        motor_send_mailbox.torque_des = float_to_uint(pid_ref, DM_T_MIN, DM_T_MAX, 12);
-        motor_send_mailbox.Kp = 0;
-        motor_send_mailbox.Kd = 0;
-
-        if(motor->stop_flag == MOTOR_STOP)
-            motor_send_mailbox.torque_des = float_to_uint(0, DM_T_MIN, DM_T_MAX, 12);
-
-        motor->motor_can_instace->tx_buff[0] = (uint8_t)(motor_send_mailbox.position_des >> 8);
-        motor->motor_can_instace->tx_buff[1] = (uint8_t)(motor_send_mailbox.position_des);
-        motor->motor_can_instace->tx_buff[2] = (uint8_t)(motor_send_mailbox.velocity_des >> 4);
-        motor->motor_can_instace->tx_buff[3] = (uint8_t)(((motor_send_mailbox.velocity_des & 0xF) << 4) | (motor_send_mailbox.Kp >> 8));
-        motor->motor_can_instace->tx_buff[4] = (uint8_t)(motor_send_mailbox.Kp);
-        motor->motor_can_instace->tx_buff[5] = (uint8_t)(motor_send_mailbox.Kd >> 4);
-        motor->motor_can_instace->tx_buff[6] = (uint8_t)(((motor_send_mailbox.Kd & 0xF) << 4) | (motor_send_mailbox.torque_des >> 8));
-        motor->motor_can_instace->tx_buff[7] = (uint8_t)(motor_send_mailbox.torque_des);
-
-        CANTransmit(motor->motor_can_instace, 1);
-
-        osDelay(2);
-    }
+    motor->base.stop_flag = MOTOR_STOP;
 }
-void DMMotorControlInit()
+
+void DMMotorOuterLoop(DMMotorInstance *motor, Closeloop_Type_e type)
 {
-    char dm_task_name[5] = "dm";
-    // 遍历所有电机实例,创建任务
-    if (!idx)
-        return;
-    for (size_t i = 0; i < idx; i++)
-    {
-        char dm_id_buff[2] = {0};
-        __itoa(i, dm_id_buff, 10);
-        strcat(dm_task_name, dm_id_buff);
-        osThreadDef(dm_task_name, DMMotorTask, osPriorityNormal, 0, 128);
-        dm_task_handle[i] = osThreadCreate(osThread(dm_task_name), dm_motor_instance[i]);
-    }
-}
\ No newline at end of file
+    motor->base.motor_settings.outer_loop_type = type;
+}
@@ -4,6 +4,7 @@
 #include "bsp_can.h"
 #include "controller.h"
 #include "motor_def.h"
+#include "motor_mit.h"
 #include "daemon.h"
 
 #define DM_MOTOR_CNT 4
@@ -14,6 +15,10 @@
 #define DM_V_MAX  45.0f
 #define DM_T_MIN  (-18.0f)
 #define DM_T_MAX   18.0f
+#define DM_KP_MIN  0.0f
+#define DM_KP_MAX  500.0f
+#define DM_KD_MIN  0.0f
+#define DM_KD_MAX  5.0f
 
 typedef struct 
 {
@@ -26,29 +31,16 @@ typedef struct
     float T_Mos;
     float T_Rotor;
     int32_t total_round;
+
+    float feed_dt;
+    uint32_t feed_cnt;
 }DM_Motor_Measure_s;
 
-typedef struct
-{
-    uint16_t position_des;
-    uint16_t velocity_des;
-    uint16_t torque_des;
-    uint16_t Kp;
-    uint16_t Kd;
-}DMMotor_Send_s;
 typedef struct 
 {
+    MotorInstance base; // 各类电机通用的部分,必须是第一个成员,默认控制周期为2ms
     DM_Motor_Measure_s measure;
-    Motor_Control_Setting_s motor_settings;
-    PIDInstance current_PID;
-    PIDInstance speed_PID;
-    PIDInstance angle_PID;
-    float *other_angle_feedback_ptr;
-    float *other_speed_feedback_ptr;
-    float *speed_feedforward_ptr;
-    float *current_feedforward_ptr;
-    float pid_ref;
-    Motor_Working_Type_e stop_flag;
+    MIT_Command_s mit; // MIT指令,MCU串级控制的输出叠加在mit.torque上作为前馈力矩
     CANInstance *motor_can_instace;
     DaemonInstance* motor_daemon;
     uint32_t lost_cnt;
@@ -66,11 +58,29 @@ DMMotorInstance *DMMotorInit(Motor_Init_Config_s *config);
 
 void DMMotorSetRef(DMMotorInstance *motor, float ref);
 
+/**
+ * @brief 设置MIT指令的目标位置/速度和前馈力矩,由电机驱动器完成阻抗控制:
+ *        T = kp*(position-p) + kd*(velocity-v) + torque + MCU串级控制的输出
+ *        位置闭环在电机中以驱动器的频率运行,MCU只需低频更新目标(如control_divider设为5,200Hz)
+ *
+ * @param position 目标位置,rad,范围DM_P_MIN~DM_P_MAX
+ * @param velocity 目标速度,rad/s
+ * @param torque   前馈力矩,N·m
+ */
+void DMMotorSetMIT(DMMotorInstance *motor, float position, float velocity, float torque);
+
+/**
+ * @brief 设置MIT指令的位置/速度增益,默认均为0,此时只有力矩控制
+ *
+ * @param kp 位置增益,N·m/rad,范围DM_KP_MIN~DM_KP_MAX
+ * @param kd 速度增益,N·m/(rad/s),范围DM_KD_MIN~DM_KD_MAX
+ */
+void DMMotorSetGain(DMMotorInstance *motor, float kp, float kd);
+
 void DMMotorOuterLoop(DMMotorInstance *motor,Closeloop_Type_e closeloop_type);
 
 void DMMotorEnable(DMMotorInstance *motor);
 
 void DMMotorStop(DMMotorInstance *motor);
 void DMMotorCaliEncoder(DMMotorInstance *motor);
-void DMMotorControlInit();
 #endif // !DMMOTOR
\ No newline at end of file
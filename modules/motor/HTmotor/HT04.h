@@ -5,6 +5,7 @@
 #include "bsp_can.h"
 #include "controller.h"
 #include "motor_def.h"
+#include "motor_mit.h"
 #include "daemon.h"
 
 #define HT_MOTOR_CNT 4
@@ -41,22 +42,11 @@ typedef struct // HT04
 /* HT电机类型定义*/
 typedef struct
 {
+    MotorInstance base; // 各类电机通用的部分,必须是第一个成员
     HTMotor_Measure_t measure;
 
-    Motor_Control_Setting_s motor_settings;
-
-    PIDInstance current_PID;
-    PIDInstance speed_PID;
-    PIDInstance angle_PID;
-    float *other_angle_feedback_ptr;
-    float *other_speed_feedback_ptr;
-    float *speed_feedforward_ptr;
-    float *current_feedforward_ptr;
-    float pid_ref;
-
-    Motor_Working_Type_e stop_flag; // 启停标志
-
     CANInstance *motor_can_instace;
+    uint8_t tx_buff[8]; // 控制报文发送缓存,前6字节为位置/速度/kp/kd均为零时的编码,由HTMotorCalibEncoder()设置
 
     DaemonInstance *motor_daemon;
     uint32_t lost_cnt;
@@ -71,7 +61,8 @@ typedef enum
 } HTMotor_Mode_t;
 
 /**
- * @brief
+ * @brief 初始化HT电机,并将其注册到motor_task中,由MotorControlTask()控制
+ *        config->control_divider为控制周期(ms),默认为1
  *
  * @param config
  * @return HTMotorInstance*
@@ -86,12 +77,6 @@ HTMotorInstance *HTMotorInit(Motor_Init_Config_s *config);
  */
 void HTMotorSetRef(HTMotorInstance *motor, float ref);
 
-/**
- * @brief 初始化电机任务,若要使用,需要在motortask的死循环前调用
- *
- */
-void HTMotorControlInit();
-
 /**
  * @brief 停止电机,之后电机不会响应HTMotorSetRef设定的值
  *
@@ -1,4 +1,6 @@
 #include "LK9025.h"
+#include "motor_task.h"
+#include "bsp_tools.h"
 #include "stdlib.h"
 #include "general_def.h"
 #include "daemon.h"
@@ -7,7 +9,6 @@
 
 static uint8_t idx;
 static LKMotorInstance *lkmotor_instance[LK_MOTOR_MX_CNT] = {NULL};
-static CANInstance *sender_instance; // 多电机发送时使用的caninstance(当前保存的是注册的第一个电机的caninstance)
 // 后续考虑兼容单电机和多电机指令.
 
 /**
@@ -22,7 +23,7 @@ static void LKMotorDecode(CANInstance *_instance)
     uint8_t *rx_buff = _instance->rx_buff;
 
     DaemonReload(motor->daemon); // 喂狗
-    measure->feed_dt = DWT_GetDeltaT(&measure->feed_dwt_cnt);
+    measure->feed_dt = DWT_GetStampDeltaT(_instance->rx_stamp, &measure->feed_dwt_cnt); // 使用报文到达时间,不受中断延迟影响
 
     measure->last_ecd = measure->ecd;
     measure->ecd = (uint16_t)((rx_buff[7] << 8) | rx_buff[6]);
@@ -42,6 +43,10 @@ static void LKMotorDecode(CANInstance *_instance)
     else if (measure->ecd - measure->last_ecd < -32768)
         measure->total_round++;
     measure->total_angle = measure->total_round * 360 + measure->angle_single_round;
+
+    motor->base.feedback.angle = measure->total_angle;
+    motor->base.feedback.speed = measure->speed_rads;
+    motor->base.feedback.current = measure->real_current;
 }
 
 static void LKMotorLostCallback(void *motor_ptr)
@@ -50,33 +55,46 @@ static void LKMotorLostCallback(void *motor_ptr)
     LOGWARNING("[LKMotor] motor lost, id: %d", motor->motor_can_ins->tx_id);
 }
 
+/* 设定值写入在多电机指令中的槽位,小端,低字节在前,由CANTxGroupFlush()统一发送 */
+static void LKMotorPack(MotorInstance *base, float output)
+{
+    LKMotorInstance *motor = (LKMotorInstance *)base;
+    int16_t set = (int16_t)output;
+    CANTxSlotWrite(motor->sender_slot, (uint8_t *)&set);
+}
+
+static const Motor_Ops_s lk_motor_ops = {
+    .decode = LKMotorDecode,
+    .pack = LKMotorPack,
+    .output_min = I_MIN,
+    .output_max = I_MAX,
+    .shared_frame = 1,
+};
+
 LKMotorInstance *LKMotorInit(Motor_Init_Config_s *config)
 {
-    LKMotorInstance *motor = (LKMotorInstance *)malloc(sizeof(LKMotorInstance));
-    motor = (LKMotorInstance *)malloc(sizeof(LKMotorInstance));
-    memset(motor, 0, sizeof(LKMotorInstance));
+    LKMotorInstance *motor = (LKMotorInstance *)CCMMalloc(sizeof(LKMotorInstance));
 
-    motor->motor_settings = config->controller_setting_init_config;
-    PIDInit(&motor->current_PID, &config->controller_param_init_config.current_PID);
-    PIDInit(&motor->speed_PID, &config->controller_param_init_config.speed_PID);
-    PIDInit(&motor->angle_PID, &config->controller_param_init_config.angle_PID);
-    motor->other_angle_feedback_ptr = config->controller_param_init_config.other_angle_feedback_ptr;
-    motor->other_speed_feedback_ptr = config->controller_param_init_config.other_speed_feedback_ptr;
+    MotorInstanceInit(&motor->base, config, &lk_motor_ops);
 
     config->can_init_config.id = motor;
-    config->can_init_config.can_module_callback = LKMotorDecode;
+    // 多电机指令id为0x280,每个电机占2字节,按电机id排列
+    CAN_Tx_Slot_Config_s slot_config = {
+        .can_handle = config->can_init_config.can_handle,
+        .group_id = 0x280,
+        .slot_offset = (config->can_init_config.tx_id - 1) * 2,
+        .slot_len = 2,
+        .priority = CAN_TX_PRIO_HIGH,
+        .deadline_us = MOTOR_CAN_TX_DEADLINE_US,
+    };
+    motor->sender_slot = CANTxSlotRegister(&slot_config);
+
     config->can_init_config.rx_id = 0x140 + config->can_init_config.tx_id;
-    config->can_init_config.tx_id = config->can_init_config.tx_id + 0x280 - 1; // 这样在发送写入buffer的时候更方便,因为下标从0开始,LK多电机发送id为0x280
+    config->can_init_config.tx_id = 0x140 + config->can_init_config.tx_id; // 单电机指令id,与反馈id相同
     motor->motor_can_ins = CANRegister(&config->can_init_config);
 
-    if (idx == 0) // 用第一个电机的can instance发送数据
-    {
-        sender_instance = motor->motor_can_ins;
-        sender_instance->tx_id = 0x280; //  修改tx_id为0x280,用于多电机发送,不用管其他LKMotorInstance的tx_id,它们仅作初始化用
-    }
-
-    LKMotorEnable(motor);
     DWT_GetDeltaT(&motor->measure.feed_dwt_cnt);
+    MotorRegister(&motor->base);
     lkmotor_instance[idx++] = motor;
 
     Daemon_Init_Config_s daemon_config = {
@@ -89,79 +107,19 @@ LKMotorInstance *LKMotorInit(Motor_Init_Config_s *config)
     return motor;
 }
 
-/* 第一个电机的can instance用于发送数据,向其tx_buff填充数据 */
-void LKMotorControl()
-{
-    float pid_measure, pid_ref;
-    int16_t set;
-    LKMotorInstance *motor;
-    LKMotor_Measure_t *measure;
-    Motor_Control_Setting_s *setting;
-
-    for (size_t i = 0; i < idx; ++i)
-    {
-        motor = lkmotor_instance[i];
-        measure = &motor->measure;
-        setting = &motor->motor_settings;
-        pid_ref = motor->pid_ref;
-        if (setting->motor_reverse_flag == MOTOR_DIRECTION_REVERSE)
-            pid_ref *= -1;
-
-        if ((setting->close_loop_type & ANGLE_LOOP) && setting->outer_loop_type == ANGLE_LOOP)
-        {
-            if (setting->angle_feedback_source == OTHER_FEED)
-                pid_measure = *motor->other_angle_feedback_ptr;
-            else
-                pid_measure = measure->real_current;
-            pid_ref = PIDCalculate(&motor->angle_PID, pid_measure, pid_ref);
-            if (setting->feedforward_flag & SPEED_FEEDFORWARD)
-                pid_ref += *motor->speed_feedforward_ptr;
-        }
-
-        if ((setting->close_loop_type & SPEED_LOOP) && setting->outer_loop_type & (ANGLE_LOOP | SPEED_LOOP))
-        {
-            if (setting->angle_feedback_source == OTHER_FEED)
-                pid_measure = *motor->other_speed_feedback_ptr;
-            else
-                pid_measure = measure->speed_rads;
-            pid_ref = PIDCalculate(&motor->angle_PID, pid_measure, pid_ref);
-            if (setting->feedforward_flag & CURRENT_FEEDFORWARD)
-                pid_ref += *motor->current_feedforward_ptr;
-        }
-
-        if (setting->close_loop_type & CURRENT_LOOP)
-        {
-            pid_ref = PIDCalculate(&motor->current_PID, measure->real_current, pid_ref);
-        }
-
-        set = (int16_t)pid_ref;
-
-        // 这里随便写的,为了兼容多电机命令.后续应该将tx_id以更好的方式表达电机id,单独使用一个CANInstance,而不是用第一个电机的CANInstance
-        memcpy(sender_instance->tx_buff + (motor->motor_can_ins->tx_id - 0x280) * 2, &set, sizeof(uint16_t));
-
-        if (motor->stop_flag == MOTOR_STOP)
-        { // 若该电机处于停止状态,直接将发送buff置零
-            memset(sender_instance->tx_buff + (motor->motor_can_ins->tx_id - 0x280) * 2, 0, sizeof(uint16_t));
-        }
-    }
-
-    if (idx) // 如果有电机注册了
-        CANTransmit(sender_instance, 0.2);
-}
-
 void LKMotorStop(LKMotorInstance *motor)
 {
-    motor->stop_flag = MOTOR_STOP;
+    motor->base.stop_flag = MOTOR_STOP;
 }
 
 void LKMotorEnable(LKMotorInstance *motor)
 {
-    motor->stop_flag = MOTOR_ENALBED;
+    motor->base.stop_flag = MOTOR_ENALBED;
 }
 
 void LKMotorSetRef(LKMotorInstance *motor, float ref)
 {
-    motor->pid_ref = ref;
+    motor->base.motor_controller.pid_ref = ref;
 }
 
 uint8_t LKMotorIsOnline(LKMotorInstance *motor)
@@ -35,25 +35,13 @@ typedef struct // 9025
 
 typedef struct
 {
+    MotorInstance base; // 各类电机通用的部分,必须是第一个成员
     LKMotor_Measure_t measure;
 
-    Motor_Control_Setting_s motor_settings;
-
-    float *other_angle_feedback_ptr; // 其他反馈来源的反馈数据指针
-    float *other_speed_feedback_ptr;
-    float *speed_feedforward_ptr;   // 速度前馈数据指针,可以通过此指针设置速度前馈值,或LQR等时作为速度状态变量的输入
-    float *current_feedforward_ptr; // 电流前馈指针
-    PIDInstance current_PID;
-    PIDInstance speed_PID;
-    PIDInstance angle_PID;
-    float pid_ref;
-
-    Motor_Working_Type_e stop_flag; // 启停标志
-
     CANInstance *motor_can_ins;
+    CANTxSlotInstance *sender_slot; // 在0x280多电机指令中的槽位
 
     DaemonInstance *daemon;
-
 } LKMotorInstance;
 
 /**
@@ -73,12 +61,6 @@ LKMotorInstance *LKMotorInit(Motor_Init_Config_s *config);
  */
 void LKMotorSetRef(LKMotorInstance *motor, float ref);
 
-/**
- * @brief 为所有LK电机计算pid/反转/模式控制,并通过bspcan发送电流值(发送CAN报文)
- *
- */
-void LKMotorControl();
-
 /**
  * @brief 停止LK电机,之后电机不会响应任何指令
  *
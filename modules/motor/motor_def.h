@@ -13,10 +13,14 @@
 #define MOTOR_DEF_H
 
 #include "controller.h"
+#include "bsp_can.h"
 #include "stdint.h"
 
 #define LIMIT_MIN_MAX(x, min, max) (x) = (((x) <= (min)) ? (min) : (((x) >= (max)) ? (max) : (x)))
 
+// 电机控制指令的CAN发送截止时间,电机任务以1kHz运行,排队超过一个周期的指令已经被新的指令取代,没有必要再发送
+#define MOTOR_CAN_TX_DEADLINE_US 1000
+
 /**
  * @brief 闭环类型,如果需要多个闭环,则使用或运算
  *        例如需要速度环和电流环: CURRENT_LOOP|SPEED_LOOP
@@ -133,6 +137,87 @@ typedef struct
     Motor_Control_Setting_s controller_setting_init_config;
     Motor_Type_e motor_type;
     CAN_Init_Config_s can_init_config;
+    uint8_t control_divider; // 控制分频,每control_divider个控制周期计算一次PID,其余周期重发上一次的指令;0和1表示每个周期都计算
 } Motor_Init_Config_s;
 
+/* 电机的控制分频和实际控制频率统计 */
+typedef struct
+{
+    uint8_t divider;       // 控制分频,见Motor_Init_Config_s
+    uint8_t tick;          // 距离下一次计算还有几个周期
+    uint16_t calc_cnt;     // 统计窗口内的计算次数
+    uint32_t window_start; // 统计窗口开始时的DWT->CYCCNT
+    float rate_hz;         // 实际的PID计算频率,每秒更新一次,可以添加到watch中查看
+} Motor_Rate_s;
+
+/* 串级控制使用的电机自身反馈,由各电机的反馈解析函数更新,单位和该电机各闭环参考值的单位一致 */
+typedef struct
+{
+    float angle;   // 角度环反馈
+    float speed;   // 速度环反馈
+    float current; // 电流环反馈
+} Motor_Feedback_s;
+
+typedef struct Motor_Ops_s Motor_Ops_s;
+
+/**
+ * @brief 各类电机通用的部分,作为各电机实例的第一个成员(名为base)
+ *        串级控制、启停、分频等只依赖这一部分,由motor_task中的MotorCalculate()统一完成
+ */
+typedef struct
+{
+    Motor_Control_Setting_s motor_settings; // 电机设置
+    Motor_Controller_s motor_controller;    // 电机控制器
+    Motor_Feedback_s feedback;              // 电机自身的反馈
+    Motor_Working_Type_e stop_flag;         // 启停标志
+    Motor_Working_Type_e sent_flag;         // 上一帧控制报文发送时的stop_flag,用于停止时立即发送
+    Motor_Rate_s rate;                      // 控制分频和实际控制频率
+    float output;                           // 上一次的控制量(已限幅),不需要计算的周期重发此控制量
+    uint32_t calc_stamp;                    // 上一次计算时的周期时间戳,用于计算PID的dt
+    uint8_t self_driven;                    // 由驱动自行调度(如DJI电机的反馈同步模式),MotorControlTask()不处理
+    int8_t speed_lane;                      // 速度环在motor_task的批量PID中的编号,-1表示使用motor_controller.speed_PID
+    Motor_Ops_s const *ops;                 // 电机类型相关的操作
+} MotorInstance;
+
+/**
+ * @brief 电机类型相关的操作,每种电机定义一个常量表
+ *        新增电机类型时只需要实现反馈解析和报文打包,串级控制等由MotorCalculate()完成
+ */
+struct Motor_Ops_s
+{
+    void (*decode)(CANInstance *can);                 // 反馈报文解析,作为CAN接收回调,需要更新base.feedback
+    void (*pack)(MotorInstance *motor, float output); // 将限幅后的控制量打包,写入聚合帧槽位或直接发送
+    float output_min;                                 // 控制量下限
+    float output_max;                                 // 控制量上限
+    uint8_t shared_frame;                             // 控制报文由多个电机共用,不需要计算的周期也要写入上一次的控制量
+};
+
+/**
+ * @brief 本控制周期是否需要计算PID,每个控制周期对每个电机调用一次
+ *        同时统计实际的计算频率,保存在rate->rate_hz
+ *
+ * @return uint8_t 需要计算时返回1,否则应重发上一次的指令
+ */
+static inline uint8_t MotorRateDue(Motor_Rate_s *rate)
+{
+    float window;
+    uint8_t due = 0;
+    if (rate->tick == 0)
+    {
+        rate->tick = rate->divider > 1 ? rate->divider : 1;
+        rate->calc_cnt++;
+        due = 1;
+    }
+    rate->tick--;
+
+    window = DWT_GetStampAge(rate->window_start);
+    if (window >= 1.0f) // 每秒更新一次实际频率
+    {
+        rate->rate_hz = rate->calc_cnt / window;
+        rate->calc_cnt = 0;
+        rate->window_start = DWT->CYCCNT;
+    }
+    return due;
+}
+
 #endif // !MOTOR_DEF_H
@@ -0,0 +1,49 @@
+#include "motor_mit.h"
+
+uint16_t MITFloatToUint(float x, float x_min, float x_max, uint8_t bits)
+{
+    float span = x_max - x_min;
+    if (x < x_min) // 超出范围时映射结果会回绕,例如略小于x_min的力矩会变成接近x_max
+        x = x_min;
+    else if (x > x_max)
+        x = x_max;
+    return (uint16_t)((x - x_min) * ((float)((1 << bits) - 1)) / span);
+}
+
+float MITUintToFloat(uint16_t x_int, float x_min, float x_max, uint8_t bits)
+{
+    float span = x_max - x_min;
+    return ((float)x_int) * span / ((float)((1 << bits) - 1)) + x_min;
+}
+
+void MITPackCommand(uint8_t *buf, MIT_Command_s const *cmd, MIT_Range_s const *range)
+{
+    uint16_t p, v, kp, kd, t;
+    p = MITFloatToUint(cmd->position, range->p_min, range->p_max, 16);
+    v = MITFloatToUint(cmd->velocity, range->v_min, range->v_max, 12);
+    kp = MITFloatToUint(cmd->kp, range->kp_min, range->kp_max, 12);
+    kd = MITFloatToUint(cmd->kd, range->kd_min, range->kd_max, 12);
+    t = MITFloatToUint(cmd->torque, range->t_min, range->t_max, 12);
+
+    buf[0] = (uint8_t)(p >> 8);
+    buf[1] = (uint8_t)(p & 0xff);
+    buf[2] = (uint8_t)(v >> 4);
+    buf[3] = (uint8_t)(((v & 0xf) << 4) | (kp >> 8));
+    buf[4] = (uint8_t)(kp & 0xff);
+    buf[5] = (uint8_t)(kd >> 4);
+    buf[6] = (uint8_t)(((kd & 0xf) << 4) | (t >> 8));
+    buf[7] = (uint8_t)(t & 0xff);
+}
+
+void MITUnpackFeedback(uint8_t const *buf, MIT_Range_s const *range, MIT_Feedback_s *feedback)
+{
+    uint16_t tmp;
+    tmp = (uint16_t)((buf[1] << 8) | buf[2]);
+    feedback->position = MITUintToFloat(tmp, range->p_min, range->p_max, 16);
+
+    tmp = (uint16_t)((buf[3] << 4) | (buf[4] >> 4));
+    feedback->velocity = MITUintToFloat(tmp, range->v_min, range->v_max, 12);
+
+    tmp = (uint16_t)(((buf[4] & 0x0f) << 8) | buf[5]);
+    feedback->torque = MITUintToFloat(tmp, range->t_min, range->t_max, 12);
+}
@@ -0,0 +1,73 @@
+/**
+ * @file motor_mit.h
+ * @brief MIT协议(HT04/达妙等关节电机共用的阻抗控制协议)的报文打包和解析
+ *
+ * @note 控制报文: p_des 16bit | v_des 12bit | kp 12bit | kd 12bit | t_ff 12bit,共8字节,大端
+ *       电机端执行 T = kp*(p_des-p) + kd*(v_des-v) + t_ff,kp/kd不为零时位置/速度闭环在电机驱动器中完成
+ *       反馈报文: id 8bit | p 16bit | v 12bit | t 12bit | ...
+ *       各物理量和整数之间按电机上位机中设置的范围线性映射,范围由MIT_Range_s给出
+ *
+ *       此文件只依赖stdint,可以直接在主机上编译
+ */
+#ifndef MOTOR_MIT_H
+#define MOTOR_MIT_H
+
+#include <stdint.h>
+
+/* 各物理量的映射范围,必须和电机中设置的一致 */
+typedef struct
+{
+    float p_min, p_max;   // 位置,rad
+    float v_min, v_max;   // 速度,rad/s
+    float kp_min, kp_max; // 位置增益,N·m/rad
+    float kd_min, kd_max; // 速度增益,N·m/(rad/s)
+    float t_min, t_max;   // 力矩,N·m
+} MIT_Range_s;
+
+/* 一帧MIT控制指令,单位同MIT_Range_s */
+typedef struct
+{
+    float position;
+    float velocity;
+    float kp;
+    float kd;
+    float torque; // 前馈力矩
+} MIT_Command_s;
+
+/* MIT反馈报文中的位置/速度/力矩 */
+typedef struct
+{
+    float position;
+    float velocity;
+    float torque;
+} MIT_Feedback_s;
+
+/**
+ * @brief 将x从[x_min,x_max]线性映射到bits位无符号整数,超出范围的值先限幅
+ */
+uint16_t MITFloatToUint(float x, float x_min, float x_max, uint8_t bits);
+
+/**
+ * @brief MITFloatToUint()的逆映射
+ */
+float MITUintToFloat(uint16_t x_int, float x_min, float x_max, uint8_t bits);
+
+/**
+ * @brief 打包一帧MIT控制报文
+ *
+ * @param buf   8字节的发送缓存
+ * @param cmd   控制指令
+ * @param range 映射范围
+ */
+void MITPackCommand(uint8_t *buf, MIT_Command_s const *cmd, MIT_Range_s const *range);
+
+/**
+ * @brief 解析MIT反馈报文的第1~5字节(位置/速度/力矩),第0字节和第6,7字节的含义因电机而异,由调用者解析
+ *
+ * @param buf      收到的报文
+ * @param range    映射范围
+ * @param feedback 解析结果
+ */
+void MITUnpackFeedback(uint8_t const *buf, MIT_Range_s const *range, MIT_Feedback_s *feedback);
+
+#endif // !MOTOR_MIT_H
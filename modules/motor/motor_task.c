@@ -1,25 +1,246 @@
 #include "motor_task.h"
-#include "LK9025.h"
-#include "HT04.h"
-#include "dji_motor.h"
 #include "step_motor.h"
-#include "servo_motor.h"
+#include "bsp_log.h"
+#include "bsp_tools.h"
 
-void MotorControlTask()
+static uint8_t idx = 0;
+static MotorInstance *motor_registry[MOTOR_REGISTRY_CNT]; // 所有类型的电机,MotorControlTask()遍历此数组
+static uint8_t schedule_load[MOTOR_SCHEDULE_HYPERPERIOD]; // 每个周期已分配的电机数
+static DWT_Cycle_t motor_clock;                           // 电机控制周期时钟
+#if MOTOR_SPEED_PID_BATCH
+static CCMRAM PIDBatchInstance speed_batch;              // 所有电机的速度环
+static MotorInstance *speed_pending[MOTOR_REGISTRY_CNT]; // 本周期速度环已提交到speed_batch,等待计算电流环的电机
+static uint8_t speed_pending_cnt;
+#endif
+
+uint8_t MotorSchedulePhase(uint8_t period)
+{
+    uint8_t phase = 0;
+    uint16_t load, min_load = UINT16_MAX;
+    if (period == 0)
+        period = 1;
+    for (uint8_t p = 0; p < period; p++) // 选择累计负载最小的相位
+    {
+        load = 0;
+        for (uint8_t k = p; k < MOTOR_SCHEDULE_HYPERPERIOD; k += period)
+            load += schedule_load[k];
+        if (load < min_load)
+        {
+            min_load = load;
+            phase = p;
+        }
+    }
+    for (uint8_t k = phase; k < MOTOR_SCHEDULE_HYPERPERIOD; k += period)
+        schedule_load[k]++;
+    return phase;
+}
+
+void MotorInstanceInit(MotorInstance *motor, Motor_Init_Config_s *config, Motor_Ops_s const *ops)
 {
-    // static uint8_t cnt = 0; 设定不同电机的任务频率
-    // if(cnt%5==0) //200hz
-    // if(cnt%10==0) //100hz
-    DJIMotorControl();
+    Motor_Controller_Init_s *controller_config = &config->controller_param_init_config;
+    Motor_Controller_s *controller = &motor->motor_controller;
+
+    motor->motor_settings = config->controller_setting_init_config; // 正反转,闭环类型等
+    PIDInit(&controller->current_PID, &controller_config->current_PID);
+    PIDInit(&controller->speed_PID, &controller_config->speed_PID);
+    PIDInit(&controller->angle_PID, &controller_config->angle_PID);
+    controller->other_angle_feedback_ptr = controller_config->other_angle_feedback_ptr;
+    controller->other_speed_feedback_ptr = controller_config->other_speed_feedback_ptr;
+    controller->speed_feedforward_ptr = controller_config->speed_feedforward_ptr;
+    controller->current_feedforward_ptr = controller_config->current_feedforward_ptr;
 
-    /* 如果有对应的电机则取消注释,可以加入条件编译或者register对应的idx判断是否注册了电机 */
-    LKMotorControl();
+    motor->rate.divider = config->control_divider;
+    motor->ops = ops;
+    motor->stop_flag = MOTOR_ENALBED;
+    motor->sent_flag = MOTOR_ENALBED;
+    motor->speed_lane = -1;
+    config->can_init_config.can_module_callback = ops->decode;
+}
+
+void MotorRegister(MotorInstance *motor)
+{
+    if (idx >= MOTOR_REGISTRY_CNT)
+    {
+        while (1)
+            LOGERROR("[motor_task] motor registry exceeded MAX num");
+    }
+    motor->rate.tick = MotorSchedulePhase(motor->rate.divider);
+    motor->calc_stamp = DWT->CYCCNT; // 和PIDInit()一样,以注册的时刻作为第一次计算的起点
+    motor->rate.window_start = motor->calc_stamp; // 第一个统计窗口同样从注册时开始,而不是上电时
+#if MOTOR_SPEED_PID_BATCH
+    if (motor->motor_settings.close_loop_type & SPEED_LOOP)
+        motor->speed_lane = PIDBatchAdd(&speed_batch, &motor->motor_controller.speed_PID);
+#endif
+    motor_registry[idx++] = motor;
+}
 
-    // legacy support
-    // 由于ht04电机的反馈方式为接收到一帧消息后立刻回传,以此方式连续发送可能导致总线拥塞
-    // 为了保证高频率控制,HTMotor中提供了以任务方式启动控制的接口,可通过宏定义切换
-    // HTMotorControl();
-    // 将所有的CAN设备集中在一处发送,最高反馈频率仅能达到500Hz,为了更好的控制效果,应使用新的HTMotorControlInit()接口
+void MotorSpeedPIDSync(MotorInstance *motor)
+{
+#if MOTOR_SPEED_PID_BATCH
+    if (motor->speed_lane >= 0)
+        PIDBatchSync(&speed_batch, (uint8_t)motor->speed_lane);
+#endif
+}
+
+void MotorClockLatch()
+{
+    DWT_CycleLatch(&motor_clock);
+}
+
+/**
+ * @brief 串级PID的位置环和速度环,pid_ref依次通过被启用的闭环,各类电机共用
+ *        速度环在speed_batch中时只提交输入,由调用者批量计算后再调用MotorCascadeInner()
+ *
+ * @param dt      距离该电机上一次计算的时间,三个环共用
+ * @param pid_ref 输出,速度环(或位置环)的输出
+ * @return uint8_t 速度环已提交到speed_batch时返回1,此时pid_ref无效;未启用MOTOR_SPEED_PID_BATCH时总是返回0
+ */
+static uint8_t MotorCascadeOuter(MotorInstance *motor, float dt, float *pid_ref)
+{
+    Motor_Control_Setting_s *setting = &motor->motor_settings; // 电机控制参数
+    Motor_Controller_s *controller = &motor->motor_controller; // 电机控制器
+    Motor_Feedback_s *feedback = &motor->feedback;             // 电机自身的反馈
+    float pid_measure, ref;                                    // 电机PID测量值和设定值
+
+    ref = controller->pid_ref; // 保存设定值,防止motor_controller->pid_ref在计算过程中被修改
+    if (setting->motor_reverse_flag == MOTOR_DIRECTION_REVERSE)
+        ref *= -1; // 设置反转
+
+    // 计算位置环,只有启用位置环且外层闭环为位置时会计算速度环输出
+    if ((setting->close_loop_type & ANGLE_LOOP) && setting->outer_loop_type == ANGLE_LOOP)
+    {
+        if (setting->angle_feedback_source == OTHER_FEED)
+            pid_measure = *controller->other_angle_feedback_ptr;
+        else
+            pid_measure = feedback->angle;
+        ref = PIDCalculateDt(&controller->angle_PID, pid_measure, ref, dt); // 更新pid_ref进入下一个环
+    }
+
+    // 计算速度环,(外层闭环为速度或位置)且(启用速度环)时会计算速度环
+    if ((setting->close_loop_type & SPEED_LOOP) && (setting->outer_loop_type & (ANGLE_LOOP | SPEED_LOOP)))
+    {
+        if (setting->feedforward_flag & SPEED_FEEDFORWARD)
+            ref += *controller->speed_feedforward_ptr;
+
+        if (setting->speed_feedback_source == OTHER_FEED)
+            pid_measure = *controller->other_speed_feedback_ptr;
+        else
+            pid_measure = feedback->speed;
+#if MOTOR_SPEED_PID_BATCH
+        if (motor->speed_lane >= 0)
+        {
+            PIDBatchSet(&speed_batch, (uint8_t)motor->speed_lane, pid_measure, ref, dt);
+            return 1;
+        }
+#endif
+        ref = PIDCalculateDt(&controller->speed_PID, pid_measure, ref, dt);
+    }
+    *pid_ref = ref;
+    return 0;
+}
+
+/**
+ * @brief 串级PID的电流环,并处理反馈反向
+ *
+ * @param pid_ref 速度环(或位置环)的输出
+ * @return float 未限幅的控制量
+ */
+static float MotorCascadeInner(MotorInstance *motor, float pid_ref, float dt)
+{
+    Motor_Control_Setting_s *setting = &motor->motor_settings;
+    Motor_Controller_s *controller = &motor->motor_controller;
+
+    // 计算电流环,目前只要启用了电流环就计算,不管外层闭环是什么,并且电流只有电机自身传感器的反馈
+    if (setting->feedforward_flag & CURRENT_FEEDFORWARD)
+        pid_ref += *controller->current_feedforward_ptr;
+    if (setting->close_loop_type & CURRENT_LOOP)
+        pid_ref = PIDCalculateDt(&controller->current_PID, motor->feedback.current, pid_ref, dt);
+
+    if (setting->feedback_reverse_flag == FEEDBACK_DIRECTION_REVERSE)
+        pid_ref *= -1;
+    return pid_ref;
+}
+
+// 打包控制量,停止时为0,并记录发送时的启停状态
+static void MotorPack(MotorInstance *motor, float output)
+{
+    motor->sent_flag = motor->stop_flag;
+    motor->ops->pack(motor, motor->stop_flag == MOTOR_STOP ? 0 : output);
+}
+
+// 限幅并保存控制量,然后打包
+static void MotorOutput(MotorInstance *motor, float output)
+{
+    Motor_Ops_s const *ops = motor->ops;
+    LIMIT_MIN_MAX(output, ops->output_min, ops->output_max);
+    motor->output = output;
+    MotorPack(motor, output);
+}
+
+/**
+ * @brief 控制一个电机,速度环在speed_batch中时:defer为1则加入speed_pending,等待MotorControlTask()批量计算;
+ *        为0则立即计算(此时speed_batch中只有这一个电机);未启用MOTOR_SPEED_PID_BATCH时defer无效
+ */
+static void MotorStep(MotorInstance *motor, uint8_t defer)
+{
+    Motor_Ops_s const *ops = motor->ops;
+    float dt, pid_ref;
+
+    if (MotorRateDue(&motor->rate))
+    {
+        dt = DWT_CycleDeltaT(&motor_clock, &motor->calc_stamp);
+#if MOTOR_SPEED_PID_BATCH
+        if (MotorCascadeOuter(motor, dt, &pid_ref))
+        {
+            if (defer)
+            {
+                speed_pending[speed_pending_cnt++] = motor;
+                return;
+            }
+            PIDBatchCalculate(&speed_batch);
+            pid_ref = speed_batch.Output[motor->speed_lane];
+        }
+#else
+        MotorCascadeOuter(motor, dt, &pid_ref);
+#endif
+        MotorOutput(motor, MotorCascadeInner(motor, pid_ref, dt));
+    }
+    // 单独发送的电机在不需要计算的周期不发送,但刚停止时立即发送一帧停止指令,不等到下一个计算周期;
+    // 使能则在下一个计算周期生效
+    else if (ops->shared_frame || (motor->stop_flag == MOTOR_STOP && motor->sent_flag != MOTOR_STOP))
+    {
+        MotorPack(motor, motor->output);
+    }
+}
+
+void MotorCalculate(MotorInstance *motor)
+{
+    MotorStep(motor, 0);
+}
+
+void MotorControlTask()
+{
+    MotorClockLatch(); // 本周期所有电机共用一个时间戳
+    // 不同电机的控制频率通过Motor_Init_Config_s的control_divider设定,如设为5则为200Hz,实际频率见电机实例的base.rate.rate_hz
+    // HT04/DM电机每收到一帧控制报文回复一帧反馈,各自单独发送,注册时分配的相位错开了它们的发送时刻
+    for (uint8_t i = 0; i < idx; i++)
+    {
+        if (!motor_registry[i]->self_driven) // 反馈同步模式下DJI电机由StartMOTORTASK()中的DJIMotorSyncControl()驱动
+            MotorStep(motor_registry[i], 1);
+    }
+
+#if MOTOR_SPEED_PID_BATCH
+    // 所有电机的速度环一次算完,再完成各自的电流环和打包
+    PIDBatchCalculate(&speed_batch);
+    for (uint8_t i = 0; i < speed_pending_cnt; i++)
+    {
+        MotorInstance *motor = speed_pending[i];
+        MotorOutput(motor, MotorCascadeInner(motor, speed_batch.Output[motor->speed_lane], speed_batch.dt[motor->speed_lane]));
+    }
+    speed_pending_cnt = 0;
+#endif
 
     // StepMotorControl();
+
+    CANTxGroupFlush(); // 所有电机都已写入各自的槽位,每个被写入的聚合帧发送一次
 }
@@ -11,12 +11,87 @@
 #ifndef MOTOR_TASK_H
 #define MOTOR_TASK_H
 
+/**
+ * @brief 为1时DJI电机工作在反馈同步模式:电机任务等待反馈,一组电机的反馈到齐后立即计算并发送该组的控制帧,
+ *        见DJIMotorSyncControl();为0时和其他电机一样在MotorControlTask()中按1kHz计算
+ */
+#define DJI_MOTOR_FEEDBACK_SYNC 0
+
+/**
+ * @brief 为1时所有电机的速度环在MotorControlTask()中通过一次PIDBatchCalculate()计算,见controller.h
+ *        速度环使用了批量计算不支持的优化环节的电机仍单独计算
+ *
+ * @note 速度环的参数在MotorRegister()时复制到批量计算实例中,此后修改motor_controller.speed_PID的Kp/Ki/Kd等参数
+ *       不会生效,必须再调用MotorSpeedPIDSync();speed_PID的Output/Iout/Err等状态每次计算后都会写回,仍可用于观察
+ *       批量计算在主机上比逐个计算慢(见host/bench/pid_bench),尚未在开发板上测得收益,因此默认关闭
+ */
+#ifndef MOTOR_SPEED_PID_BATCH
+#define MOTOR_SPEED_PID_BATCH 0
+#endif
+
+#include <stdint.h>
+#include "motor_def.h"
+
+#define MOTOR_REGISTRY_CNT 24        // 所有类型的电机总数上限,DJI 12个,LK/HT/DM各4个
+#define MOTOR_SCHEDULE_HYPERPERIOD 60 // 相位均衡的统计长度(周期数),是1~6,10,12,15,20,30的公倍数
+
+/**
+ * @brief 初始化电机实例的通用部分:控制设置,三环PID,反馈/前馈指针,控制分频和电机类型的操作表
+ *        各电机的Init函数在注册CAN实例之前调用
+ *
+ * @param motor  电机实例的base成员
+ * @param config 电机初始化配置
+ * @param ops    电机类型的操作表
+ */
+void MotorInstanceInit(MotorInstance *motor, Motor_Init_Config_s *config, Motor_Ops_s const *ops);
+
+/**
+ * @brief 将初始化完成的电机加入注册表,此后由MotorControlTask()控制
+ *        注册时会通过MotorSchedulePhase()为电机分配相位,错开分频后各电机的计算和发送时刻
+ *
+ * @param motor 电机实例的base成员
+ */
+void MotorRegister(MotorInstance *motor);
+
+/**
+ * @brief 锁存电机控制周期的时间戳,本周期内所有电机的PID都以此计算dt,不再各自读取DWT
+ *        MotorControlTask()开始时会自动调用;在其之外调用MotorCalculate()时(如DJIMotorSyncControl()),需要先调用此函数
+ */
+void MotorClockLatch();
+
+/**
+ * @brief 控制一个电机:按分频决定是否计算,计算串级PID,限幅后交给ops->pack打包
+ *        停止的电机输出0;分频后不需要计算的周期,共用控制报文的电机重新写入上一次的控制量,其余电机不发送
+ *
+ * @param motor 电机实例的base成员
+ */
+void MotorCalculate(MotorInstance *motor);
+
+/**
+ * @brief 运行时修改了电机motor_controller.speed_PID的参数后调用,使批量计算的速度环使用新的参数
+ *        未启用MOTOR_SPEED_PID_BATCH或该电机的速度环单独计算时不需要调用,调用也没有影响
+ *
+ * @param motor 电机实例的base成员
+ */
+void MotorSpeedPIDSync(MotorInstance *motor);
+
+/**
+ * @brief 为控制周期为period的电机选择相位:在已分配的电机中,选择计算次数最少的那些控制周期
+ *        返回值可以直接作为Motor_Rate_s.tick的初值,电机会在第tick个周期第一次计算
+ *        由MotorRegister()调用
+ *
+ * @param period 控制周期,单位为MotorControlTask()的周期数,0和1表示每个周期
+ * @return uint8_t 相位,0~period-1
+ */
+uint8_t MotorSchedulePhase(uint8_t period);
 
 /**
  * @brief 电机控制闭环任务,在RTOS中应该设定为1Khz运行
  *        舵机控制任务的频率设定为20Hz或更低
  * 
- * @note 好无语,就一个函数罢了,干脆全部放到头文件里好了.
+ * @note 一次遍历注册表控制所有电机:DJI/LK电机写入聚合帧的槽位,周期末尾统一发送;
+ *       HT/DM电机按各自的周期和相位单独发送,不再各自占用一个任务
+ *       启用MOTOR_SPEED_PID_BATCH时,遍历中先计算位置环并提交速度环,所有速度环批量计算后再计算电流环并打包
  * 
  */
 void MotorControlTask();
@@ -28,14 +28,14 @@ SuperCapInstance *SuperCapInit(SuperCap_Init_Config_s *supercap_config)
     memset(super_cap_instance, 0, sizeof(SuperCapInstance));
     
     supercap_config->can_config.can_module_callback = SuperCapRxCallback;
+    supercap_config->can_config.tx_priority = CAN_TX_PRIO_LOW; // 状态报文,不能影响电机控制指令
     super_cap_instance->can_ins = CANRegister(&supercap_config->can_config);
     return super_cap_instance;
 }
 
 void SuperCapSend(SuperCapInstance *instance, uint8_t *data)
 {
-    memcpy(instance->can_ins->tx_buff, data, 8);
-    CANTransmit(instance->can_ins,1);
+    CANTransmit(instance->can_ins, data);
 }
 
 SuperCap_Msg_s SuperCapGet(SuperCapInstance *instance)
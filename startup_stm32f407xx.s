@@ -43,6 +43,10 @@ defined in linker script */
 .word  _sbss
 /* end address for the .bss section. defined in linker script */
 .word  _ebss
+/* start address for the .ccmram section. defined in linker script */
+.word  _sccmram
+/* end address for the .ccmram section. defined in linker script */
+.word  _eccmram
 /* stack used for SystemInit_ExtMemCtl; always internal RAM used */
 
 /**
@@ -91,6 +95,20 @@ LoopFillZerobss:
   cmp r2, r4
   bcc FillZerobss
 
+/* Zero fill the ccmram segment. */
+  ldr r2, =_sccmram
+  ldr r4, =_eccmram
+  movs r3, #0
+  b LoopFillZeroccm
+
+FillZeroccm:
+  str  r3, [r2]
+  adds r2, r2, #4
+
+LoopFillZeroccm:
+  cmp r2, r4
+  bcc FillZeroccm
+
 /* Call the clock system initialization function.*/
   bl  SystemInit   
 /* Call static constructors */